@@ -19,8 +19,53 @@
 #include "libc/intrin/kprintf.h"
 #include "libc/intrin/maps.h"
 
+// looks up address without taking the lock, which is safe because map
+// objects are never unmapped, and tree nodes only ever point to other
+// map objects, even after they've been freed. racing with a writer can
+// produce nonsense or a cycle, but the generation check and step limit
+// catch both, in which case we return -1 so the caller can lock.
+privileged optimizesize static int kisdangerous_nolock(const char *addr) {
+  uint64_t gen;
+  int i, c, n, res;
+  struct Map *map;
+  struct Tree *node, *floor;
+  for (i = 0; i < 3; ++i) {
+    gen = atomic_load_explicit(&__maps.gen, memory_order_acquire);
+    if (gen & 1)
+      break;
+    floor = 0;
+    node = __maps.maps;
+    for (n = 0; node && n < 128; ++n) {
+      if ((c = __maps_search(addr, node)) < 0) {
+        node = tree_get_left(node);
+      } else {
+        floor = node;
+        if (!c)
+          break;
+        node = node->right;
+      }
+    }
+    if (!__maps.maps) {
+      res = false;
+    } else if (floor) {
+      map = MAP_TREE_CONTAINER(floor);
+      res = !(addr >= map->addr && addr < map->addr + map->size);
+    } else {
+      res = true;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (n < 128 &&
+        atomic_load_explicit(&__maps.gen, memory_order_relaxed) == gen)
+      return res;
+  }
+  return -1;
+}
+
 privileged optimizesize bool32 kisdangerous(const void *addr) {
+  int rc;
   bool32 res = true;
+  if ((rc = kisdangerous_nolock(addr)) != -1)
+    return rc;
   __maps_lock();
   if (__maps.maps) {
     struct Map *map;
@@ -99,6 +99,14 @@ void __maps_init(void) {
   __maps_adder(&text, pagesz);
 }
 
+forceinline void __maps_pause(void) {
+#ifdef __x86_64__
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ volatile("yield");
+#endif
+}
+
 #if DEBUG_MAPS_LOCK
 privileged static void __maps_panic(const char *msg) {
   // it's only safe to pass a format string. if we use directives such
@@ -108,6 +116,10 @@ privileged static void __maps_panic(const char *msg) {
 }
 #endif
 
+// writers, i.e. mmap(), munmap(), mprotect() and mremap(), all update
+// the one tree under this lock. they make their system calls before or
+// after holding it, but updates from many threads still serialize here
+// and only kisdangerous() is able to read the tree without it
 ABI bool __maps_lock(void) {
   int me;
   uint64_t word, lock;
@@ -142,6 +154,9 @@ ABI bool __maps_lock(void) {
     if (atomic_compare_exchange_weak_explicit(&__maps.lock.word, &word, lock,
                                               memory_order_acquire,
                                               memory_order_relaxed)) {
+      // let kisdangerous() know its lockless lookup might be torn
+      atomic_fetch_add_explicit(&__maps.gen, 1, memory_order_relaxed);
+      atomic_thread_fence(memory_order_release);
 #if DEBUG_MAPS_LOCK
       __deadlock_track(&__maps.lock, 0);
       __deadlock_record(&__maps.lock, 0);
@@ -154,6 +169,7 @@ ABI bool __maps_lock(void) {
         break;
       if (!word)
         break;
+      __maps_pause();
     }
   }
 }
@@ -176,6 +192,8 @@ ABI void __maps_unlock(void) {
   if (__deadlock_tracked(&__maps.lock) == 0)
     __maps_panic("error: maps lock not owned by caller\n");
 #endif
+  if (!MUTEX_DEPTH(word))
+    atomic_fetch_add_explicit(&__maps.gen, 1, memory_order_release);
   for (;;) {
     if (MUTEX_DEPTH(word)) {
       if (atomic_compare_exchange_weak_explicit(
@@ -19,10 +19,8 @@ struct Map {
   bool readonlyfile; /* windows nt only */
   unsigned visited;  /* checks and fork */
   intptr_t hand;     /* windows nt only */
-  union {
-    struct Tree tree;
-    struct Map *freed;
-  };
+  struct Tree tree;  /* stays pointed at maps after free */
+  struct Map *freed; /* next in freelist */
 };
 
 struct MapLock {
@@ -34,6 +32,7 @@ struct Maps {
   uint128_t rand;
   struct Tree *maps;
   struct MapLock lock;
+  _Atomic(uint64_t) gen; /* odd while locked */
   _Atomic(uintptr_t) freed;
   size_t count;
   size_t pages;
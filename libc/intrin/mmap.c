@@ -232,27 +232,38 @@ StartOver:
   return rc;
 }
 
-void __maps_free(struct Map *map) {
+// pushes maps linked by their freed field onto freelist w/ one cas
+static void __maps_free_chain(struct Map *first, struct Map *last) {
   uintptr_t tip;
-  ASSERT(!TAG(map));
-  map->size = 0;
-  map->addr = MAP_FAILED;
+  ASSERT(!TAG(first));
+  ASSERT(!TAG(last));
   for (tip = atomic_load_explicit(&__maps.freed, memory_order_relaxed);;) {
-    map->freed = (struct Map *)PTR(tip);
+    last->freed = (struct Map *)PTR(tip);
     if (atomic_compare_exchange_weak_explicit(
-            &__maps.freed, &tip, ABA(map, TAG(tip) + 1), memory_order_release,
-            memory_order_relaxed))
+            &__maps.freed, &tip, ABA(first, TAG(tip) + 1),
+            memory_order_release, memory_order_relaxed))
       break;
     pthread_pause_np();
   }
 }
 
+void __maps_free(struct Map *map) {
+  map->size = 0;
+  map->addr = MAP_FAILED;
+  __maps_free_chain(map, map);
+}
+
 static void __maps_free_all(struct Map *list) {
-  struct Map *next;
-  for (struct Map *map = list; map; map = next) {
-    next = map->freed;
-    __maps_free(map);
+  struct Map *map;
+  if (!list)
+    return;
+  for (map = list;; map = map->freed) {
+    map->size = 0;
+    map->addr = MAP_FAILED;
+    if (!map->freed)
+      break;
   }
+  __maps_free_chain(list, map);
 }
 
 void __maps_insert(struct Map *map) {
@@ -343,8 +354,12 @@ struct Map *__maps_alloc(void) {
     return 0;
   map = sys.addr;
   __maps_track_insert(map, sys.addr, gransz, sys.maphandle);
-  for (int i = 1; i < gransz / sizeof(struct Map); ++i)
-    __maps_free(map + i);
+  int n = gransz / sizeof(struct Map);
+  for (int i = 1; i < n; ++i) {
+    map[i].addr = MAP_FAILED;
+    map[i].freed = i + 1 < n ? map + i + 1 : 0;
+  }
+  __maps_free_chain(map + 1, map + n - 1);
   return MAPS_RETRY;
 }
 
@@ -510,7 +525,9 @@ TryAgain:
   // untrack mapping we blew away
   if (!IsWindows() && should_untrack) {
     struct Map *deleted = 0;
+    __maps_lock();
     __muntrack(res.addr, size, pagesz, &deleted);
+    __maps_unlock();
     __maps_free_all(deleted);
   }
 
@@ -31,7 +31,8 @@ void _memsummary(int fd) {
           "usmblks\t\t%,-12zu\t# maximum total allocated space\n"
           "uordblks\t%,-12zu\t# total allocated space\n"
           "fordblks\t%,-12zu\t# total free space\n"
-          "keepcost\t%,-12zu\t# releasable (via malloc_trim) space\n\n",
+          "keepcost\t%,-12zu\t# releasable (via malloc_trim) space\n"
+          "hugepages\t%,-12zu\t# space advised to use huge pages\n\n",
           mi.arena, mi.ordblks, mi.hblkhd, mi.usmblks, mi.uordblks, mi.fordblks,
-          mi.keepcost);
+          mi.keepcost, mi.hugepages);
 }
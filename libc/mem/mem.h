@@ -4,6 +4,7 @@
 #define M_TRIM_THRESHOLD (-1)
 #define M_GRANULARITY    (-2)
 #define M_MMAP_THRESHOLD (-3)
+#define M_HUGEPAGES      (-4)
 
 COSMOPOLITAN_C_START_
 /*───────────────────────────────────────────────────────────────────────────│─╗
@@ -46,6 +47,7 @@ struct mallinfo {
   size_t uordblks; /* total allocated space */
   size_t fordblks; /* total free space */
   size_t keepcost; /* releasable (via malloc_trim) space */
+  size_t hugepages; /* space in segments advised to use huge pages */
 };
 
 struct mallinfo mallinfo(void) libcesque;
@@ -162,6 +162,8 @@ static void fork_child(void) {
     if (_weaken(__sig_init))
       _weaken(__sig_init)();
   }
+  if (_weaken(__pprof_fork_child))
+    _weaken(__pprof_fork_child)();
   if (_weaken(_pthread_onfork_child))
     _weaken(_pthread_onfork_child)();
   pthread_mutex_wipe_np(&supreme_lock);
@@ -201,6 +203,7 @@ int _fork(uint32_t dwCreationFlags) {
 
     // tracing and kisdangerous need this lock wiped a little earlier
     atomic_store_explicit(&__maps.lock.word, 0, memory_order_relaxed);
+    atomic_store_explicit(&__maps.gen, 0, memory_order_relaxed);
 
     /*
      * it's now safe to call normal functions again
@@ -23,6 +23,7 @@
 #include "libc/nexgen32e/gc.internal.h"
 #include "libc/thread/posixthread.internal.h"
 #include "libc/thread/tls.h"
+#include "third_party/dlmalloc/dlmalloc.h"
 #include "third_party/nsync/wait_s.internal.h"
 
 struct Dtor {
@@ -101,6 +102,10 @@ void __cxa_thread_finalize(void) {
     ((void (*)(void *))dtor->fun)(dtor->arg);
     _weaken(free)(dtor);
   }
+
+  // give chunks cached by this thread's malloc back to their arenas
+  if (_weaken(dlmalloc_thread_exit))
+    _weaken(dlmalloc_thread_exit)();
 }
 
 int __cxa_thread_atexit_impl(void *fun, void *arg, void *dso_symbol) {
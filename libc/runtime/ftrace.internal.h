@@ -0,0 +1,44 @@
+#ifndef COSMOPOLITAN_LIBC_RUNTIME_FTRACE_INTERNAL_H_
+#define COSMOPOLITAN_LIBC_RUNTIME_FTRACE_INTERNAL_H_
+COSMOPOLITAN_C_START_
+
+#define FTRACE_RING_MAGIC     0x43525446 /* FTRC */
+#define FTRACE_RING_ABI       1
+#define FTRACE_RING_EVENTS    1048576 /* per thread; power of two */
+#define FTRACE_RING_NESTING   480
+#define FTRACE_RING_CALIBRATE 65536 /* events between clock readings */
+
+struct FtraceEvent { /* 16 */
+  uint64_t tsc;      /* rdtsc() upon function entry */
+  uint32_t addr;     /* function address relative to `base` */
+  uint16_t depth;    /* nesting level */
+  uint16_t stack;    /* stack bytes in use divided by 16, saturated */
+};
+
+/* header page of <prog>.<tid>.ftrace file, followed by events ring */
+struct FtraceRing {          /* 4096 */
+  uint32_t magic;            /* FTRACE_RING_MAGIC */
+  uint32_t abi;              /* FTRACE_RING_ABI */
+  int32_t pid;               /* process that wrote this file */
+  int32_t tid;               /* thread that wrote this file */
+  uint64_t base;             /* __executable_start */
+  uint64_t starttsc;         /* kStartTsc */
+  uint64_t tsc[2];           /* rdtsc() at creation and last calibration */
+  int64_t nanos[2];          /* CLOCK_REALTIME at same moments as tsc */
+  uint64_t events;           /* capacity of ring */
+  uint64_t count;            /* events written so far, which may wrap */
+  uint32_t frames;           /* used by writer to track nesting */
+  uint32_t __pad;
+  uintptr_t frame[FTRACE_RING_NESTING];
+  char __pad2[4096 - 88 - FTRACE_RING_NESTING * sizeof(uintptr_t)];
+};
+
+extern bool __ftrace_ring;
+
+struct FtraceRing *__ftrace_ring_open(void);
+void __ftrace_ring_calibrate(struct FtraceRing *);
+void __ftrace_ring_close(struct FtraceRing *);
+void __ftrace_ring_exit(void);
+
+COSMOPOLITAN_C_END_
+#endif /* COSMOPOLITAN_LIBC_RUNTIME_FTRACE_INTERNAL_H_ */
@@ -0,0 +1,149 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "ape/sections.internal.h"
+#include "libc/calls/calls.h"
+#include "libc/calls/struct/timespec.h"
+#include "libc/calls/syscall-sysv.internal.h"
+#include "libc/dce.h"
+#include "libc/errno.h"
+#include "libc/fmt/itoa.h"
+#include "libc/intrin/directmap.h"
+#include "libc/intrin/getenv.h"
+#include "libc/limits.h"
+#include "libc/nexgen32e/rdtsc.h"
+#include "libc/runtime/ftrace.internal.h"
+#include "libc/runtime/internal.h"
+#include "libc/runtime/runtime.h"
+#include "libc/str/str.h"
+#include "libc/sysv/consts/at.h"
+#include "libc/sysv/consts/clock.h"
+#include "libc/sysv/consts/map.h"
+#include "libc/sysv/consts/o.h"
+#include "libc/sysv/consts/prot.h"
+#include "libc/thread/tls.h"
+
+/**
+ * @fileoverview Binary function call logging.
+ *
+ * When `--ftrace-ring` is passed, ftracer() appends a 16 byte event to
+ * a ring that's owned by the calling thread, rather than formatting a
+ * line of text and writing it to stderr. Each thread's ring is backed
+ * by a shared file mapping named `$FTRACE_DIR/<prog>.<tid>.ftrace` so
+ * the most recent million events survive even if the process crashes.
+ * Existing files are never overwritten, so if a thread id gets reused,
+ * a number is added to the name, e.g. `<prog>.<tid>.1.ftrace`. Use the
+ * `o//tool/decode/ftrace` program to turn these files into text or JSON.
+ */
+
+bool __ftrace_ring;
+
+/**
+ * Records current time so decoder can convert timestamps to nanoseconds.
+ */
+dontinstrument void __ftrace_ring_calibrate(struct FtraceRing *r) {
+  r->nanos[1] = timespec_tonanos(timespec_real());
+  r->tsc[1] = rdtsc();
+}
+
+/**
+ * Creates ring for calling thread.
+ *
+ * This function goes straight to the system call layer, since ftracer()
+ * may be called while mmap() or open() are holding locks.
+ *
+ * @return new ring, or null on error
+ */
+dontinstrument struct FtraceRing *__ftrace_ring_open(void) {
+  size_t size;
+  const char *s;
+  int e, fd, tid, n;
+  struct DirectMap dm;
+  struct FtraceRing *r;
+  char *p, *q, path[PATH_MAX];
+  p = path;
+  tid = sys_gettid();
+  if ((s = __getenv(__envp, "FTRACE_DIR").s) && *s) {
+    if (strlen(s) + strlen(program_invocation_short_name) + 32 > PATH_MAX)
+      return 0;
+    p = stpcpy(p, s);
+    *p++ = '/';
+  }
+  p = stpcpy(p, program_invocation_short_name);
+  *p++ = '.';
+  p = FormatInt32(p, tid);
+  size = sizeof(*r) + FTRACE_RING_EVENTS * sizeof(struct FtraceEvent);
+  e = errno;
+  for (n = 0;; ++n) {
+    q = p;
+    if (n) {
+      *q++ = '.';
+      q = FormatInt32(q, n);
+    }
+    stpcpy(q, ".ftrace");
+    if ((fd = sys_openat(AT_FDCWD, path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                         0644)) != -1)
+      break;
+    if (errno != EEXIST || n == 1000) {
+      errno = e;
+      return 0;
+    }
+  }
+  errno = e;
+  if (sys_ftruncate(fd, size, size) == -1) {
+    sys_close(fd);
+    return 0;
+  }
+  dm = sys_mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  sys_close(fd);
+  if (dm.addr == MAP_FAILED)
+    return 0;
+  r = dm.addr;
+  r->abi = FTRACE_RING_ABI;
+  r->pid = __pid;
+  r->tid = tid;
+  r->base = (uintptr_t)__executable_start;
+  r->starttsc = kStartTsc;
+  r->events = FTRACE_RING_EVENTS;
+  __ftrace_ring_calibrate(r);
+  r->tsc[0] = r->tsc[1];
+  r->nanos[0] = r->nanos[1];
+  r->magic = FTRACE_RING_MAGIC;
+  return r;
+}
+
+/**
+ * Unmaps ring.
+ */
+dontinstrument void __ftrace_ring_close(struct FtraceRing *r) {
+  if (!IsWindows())
+    sys_munmap(r, sizeof(*r) + r->events * sizeof(struct FtraceEvent));
+}
+
+/**
+ * Unmaps ring of calling thread, which is called by pthread_exit().
+ */
+dontinstrument void __ftrace_ring_exit(void) {
+  struct CosmoTib *tib;
+  struct FtraceRing *r;
+  tib = __get_tls();
+  r = tib->tib_ftrace_ring;
+  tib->tib_ftrace_ring = (void *)-1;  // don't reopen while exiting
+  if (r && r != (void *)-1)
+    __ftrace_ring_close(r);
+}
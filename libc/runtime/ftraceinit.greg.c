@@ -17,6 +17,8 @@
 │ PERFORMANCE OF THIS SOFTWARE.                                                │
 ╚─────────────────────────────────────────────────────────────────────────────*/
 #include "libc/dce.h"
+#include "libc/intrin/getenv.h"
+#include "libc/runtime/ftrace.internal.h"
 #include "libc/runtime/internal.h"
 #include "libc/runtime/runtime.h"
 #include "libc/runtime/symbols.internal.h"
@@ -35,15 +37,27 @@ __static_yoink("zipos");
  * `sed | sort | uniq -c | sort`. A compressed trace can be made by
  * appending `--ftrace 2>&1 | gzip -4 >trace.gz` to the CLI arguments.
  *
+ * If `--ftrace-ring` is passed instead, then calls are logged to binary
+ * files in the current directory (or `$FTRACE_DIR`) which is much less
+ * expensive. Those files may be decoded with `o//tool/decode/ftrace`.
+ *
+ * This also enables the sampling profiler if the `--pprof` flag is
+ * passed or the `PPROF` environment variable is set.
+ *
  * @see libc/runtime/_init.S for documentation
  */
 textstartup int ftrace_init(void) {
   if (IsModeDbg() || strace_enabled(0) > 0) {
     GetSymbolTable();
   }
-  if (__intercept_flag(&__argc, __argv, "--ftrace")) {
+  __ftrace_ring = __intercept_flag(&__argc, __argv, "--ftrace-ring");
+  if (__intercept_flag(&__argc, __argv, "--ftrace") || __ftrace_ring) {
     ftrace_install();
     ftrace_enabled(+1);
   }
+  if (__intercept_flag(&__argc, __argv, "--pprof") ||
+      __getenv(__envp, "PPROF").s) {
+    __pprof_init();
+  }
   return __argc;
 }
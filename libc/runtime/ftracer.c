@@ -22,7 +22,9 @@
 #include "libc/intrin/cmpxchg.h"
 #include "libc/intrin/kprintf.h"
 #include "libc/macros.h"
+#include "libc/nexgen32e/rdtsc.h"
 #include "libc/nexgen32e/stackframe.h"
+#include "libc/runtime/ftrace.internal.h"
 #include "libc/runtime/internal.h"
 #include "libc/runtime/runtime.h"
 #include "libc/runtime/stack.h"
@@ -47,6 +49,7 @@
 #endif
 
 static struct CosmoFtrace g_ftrace;
+static struct FtraceRing *g_ftrace_ring;
 
 __funline int GetNestingLevelImpl(struct StackFrame *frame) {
   int nesting = -2;
@@ -66,12 +69,49 @@ __funline int GetNestingLevel(struct CosmoFtrace *ft, struct StackFrame *sf) {
   return MIN(MAX_NESTING, nesting);
 }
 
+// frames are remembered as they're entered; any remembered frame that
+// isn't above the new frame on the stack must have returned by now
+__funline void LogEvent(struct FtraceRing **rp, uintptr_t frame, uintptr_t fn,
+                        long stackuse) {
+  unsigned n;
+  uint64_t i;
+  struct FtraceRing *r;
+  struct FtraceEvent *e;
+  if ((r = *rp) == (struct FtraceRing *)-1)
+    return;
+  if (!r || r->pid != __pid) {
+    if (r)
+      __ftrace_ring_close(r);  // inherited across fork()
+    if (!(r = __ftrace_ring_open())) {
+      *rp = (struct FtraceRing *)-1;
+      return;
+    }
+    *rp = r;
+  }
+  n = r->frames;
+  while (n && r->frame[n - 1] <= frame)
+    --n;
+  if (n < FTRACE_RING_NESTING)
+    r->frame[n++] = frame;
+  r->frames = n;
+  i = r->count++;
+  e = (struct FtraceEvent *)(r + 1) + (i & (FTRACE_RING_EVENTS - 1));
+  e->tsc = rdtsc();
+  e->addr = fn - r->base;
+  e->depth = n - 1;
+  e->stack = MIN(stackuse >> 4, 65535);
+  if (!(r->count & (FTRACE_RING_CALIBRATE - 1)))
+    __ftrace_ring_calibrate(r);
+}
+
 /**
  * Prints name of function being called.
  *
  * Whenever a function is called, ftrace_hook() will be called from the
  * function prologue which saves the parameter registers and calls this
- * function, which is responsible for logging the function call.
+ * function, which is responsible for logging the function call. If
+ * `--ftrace-ring` was passed, then the call is appended to a per-thread
+ * ring buffer instead, which is much faster.
  *
  * @see ftrace_install()
  */
@@ -99,6 +139,7 @@ privileged void ftracer(void) {
       st = (uintptr_t)pt->pt_attr.__stackaddr + pt->pt_attr.__stacksize;
     }
   } else {
+    tib = 0;
     ft = &g_ftrace;
   }
   stackuse = st - (intptr_t)sf;
@@ -109,7 +150,21 @@ privileged void ftracer(void) {
   if (_cmpxchg(&ft->ft_noreentry, false, true)) {
     sf = sf->next;
     fn = sf->addr + DETOUR_SKEW;
-    if (fn != ft->ft_lastaddr) {
+    if (__ftrace_ring) {
+      if (!tib) {
+        LogEvent(&g_ftrace_ring, (uintptr_t)sf, fn, stackuse);
+      } else if (!(tib->tib_flags & TIB_FLAG_VFORKED)) {
+        // main thread keeps the ring it was using before tls existed
+        if (!tib->tib_ftrace_ring && g_ftrace_ring &&
+            g_ftrace_ring != (struct FtraceRing *)-1 &&
+            g_ftrace_ring->tid == tib->tib_tid) {
+          tib->tib_ftrace_ring = g_ftrace_ring;
+          g_ftrace_ring = 0;
+        }
+        LogEvent((struct FtraceRing **)&tib->tib_ftrace_ring, (uintptr_t)sf,
+                 fn, stackuse);
+      }
+    } else if (fn != ft->ft_lastaddr) {
       kprintf("%rFUN %6P %6H %'18T %'*ld %*s%t\n", ftrace_stackdigs, stackuse,
               GetNestingLevel(ft, sf) * 2, "", fn);
       ft->ft_lastaddr = fn;
@@ -32,6 +32,9 @@ extern unsigned char _tls_content[] __attribute__((__weak__));
 
 void _init(void);
 int ftrace_init(void);
+void __pprof_init(void);
+void __pprof_fork_child(void);
+void __pprof_thread_exit(void);
 void ftrace_hook(void);
 void __morph_tls(void);
 void __enable_tls(void);
@@ -0,0 +1,680 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/atomic.h"
+#include "libc/calls/calls.h"
+#include "libc/calls/struct/itimerval.h"
+#include "libc/calls/struct/sigaction.h"
+#include "libc/calls/struct/siginfo.h"
+#include "libc/calls/struct/timespec.h"
+#include "libc/calls/struct/ucontext.internal.h"
+#include "libc/calls/ucontext.h"
+#include "libc/dce.h"
+#include "libc/errno.h"
+#include "libc/fmt/itoa.h"
+#include "libc/intrin/getenv.h"
+#include "libc/intrin/maps.h"
+#include "libc/intrin/strace.h"
+#include "libc/limits.h"
+#include "libc/macros.h"
+#include "libc/nexgen32e/stackframe.h"
+#include "libc/runtime/internal.h"
+#include "libc/runtime/runtime.h"
+#include "libc/runtime/symbols.internal.h"
+#include "libc/str/str.h"
+#include "libc/sysv/consts/itimer.h"
+#include "libc/sysv/consts/map.h"
+#include "libc/sysv/consts/o.h"
+#include "libc/sysv/consts/prot.h"
+#include "libc/sysv/consts/sa.h"
+#include "libc/sysv/consts/sig.h"
+#include "libc/sysv/errfuns.h"
+#include "libc/thread/posixthread.internal.h"
+#include "libc/thread/tls.h"
+
+/**
+ * @fileoverview Statistical CPU profiler.
+ *
+ * Once armed, the kernel delivers SIGPROF to whichever thread happens
+ * to be burning CPU whenever the process consumes another 1/hz second
+ * of it. The signal handler walks the frame pointer chain and appends
+ * the backtrace to a ring owned by that thread, which is drained into
+ * a table of distinct stacks by whoever wins the drain lock, which is
+ * either a handler whose ring is getting full, or pprof_write(). None
+ * of this allocates memory or makes system calls once started.
+ *
+ * Rings are given back when threads exit, so they can be reused. Since
+ * `ITIMER_PROF` isn't inherited across fork(), children that fork while
+ * sampling is running arm it again, and start a profile of their own.
+ */
+
+#define PPROF_DEPTH   64
+#define PPROF_THREADS 128
+#define PPROF_RING    16384          /* words per thread */
+#define PPROF_TABLE   32768          /* max distinct stacks */
+#define PPROF_ARENA   (1024 * 1024)  /* words of distinct stack storage */
+
+struct PprofRing {
+  atomic_int tid;
+  atomic_uint head;  // written by thread that owns ring
+  atomic_uint tail;  // written by whoever holds drain lock
+};
+
+struct PprofStack {
+  uint64_t hash;
+  uint32_t off;  // into arena
+  uint32_t depth;
+  uint64_t count;
+};
+
+struct PprofOut {
+  int fd;
+  int rc;
+  size_t n;
+  char b[2048];
+};
+
+static struct Pprof {
+  atomic_bool draining;
+  bool running;
+  int pid;
+  int hz;
+  size_t size;
+  uint32_t used;
+  uint32_t stacks;
+  atomic_ulong dropped;
+  struct timespec start;
+  uintptr_t *rings;
+  uintptr_t *arena;
+  struct PprofStack *table;
+  char path[PATH_MAX];
+  struct PprofRing ring[PPROF_THREADS];
+} g_pprof;
+
+static uintptr_t pprof_stacktop(uintptr_t sp) {
+  uintptr_t lo, hi;
+  struct CosmoTib *tib;
+  struct PosixThread *pt;
+  tib = __get_tls();
+  lo = (uintptr_t)tib->tib_sigstack_addr;
+  hi = lo + tib->tib_sigstack_size;
+  if (lo <= sp && sp < hi)
+    return hi;
+  if ((pt = (struct PosixThread *)tib->tib_pthread) &&
+      pt->pt_attr.__stacksize) {
+    lo = (uintptr_t)pt->pt_attr.__stackaddr;
+    hi = lo + pt->pt_attr.__stacksize;
+  } else {
+    lo = (uintptr_t)__maps.stack.addr;
+    hi = lo + __maps.stack.size;
+  }
+  if (lo <= sp && sp < hi)
+    return hi;
+  return 0;  // running on some other stack
+}
+
+// frames are only followed while they're on the interrupted stack and
+// moving towards its top, so code that lacks frame pointers won't crash
+static int pprof_unwind(ucontext_t *ctx, uintptr_t pc[PPROF_DEPTH]) {
+  int n;
+  uintptr_t sp, top;
+  struct StackFrame *f;
+  n = 0;
+  pc[n++] = ctx->uc_mcontext.PC;
+  sp = ctx->uc_mcontext.SP;
+  if (!(top = pprof_stacktop(sp)))
+    return n;
+  for (f = (struct StackFrame *)ctx->uc_mcontext.BP; n < PPROF_DEPTH;
+       f = f->next) {
+    if ((uintptr_t)f < sp || (uintptr_t)f + sizeof(*f) > top ||
+        ((uintptr_t)f & (sizeof(void *) - 1)) || !f->addr) {
+      break;
+    }
+    pc[n++] = f->addr;
+    sp = (uintptr_t)f + sizeof(*f);
+  }
+  return n;
+}
+
+static int pprof_claim(void) {
+  int i, t, tid;
+  tid = gettid();
+  for (i = 0; i < PPROF_THREADS; ++i) {
+    t = atomic_load_explicit(&g_pprof.ring[i].tid, memory_order_relaxed);
+    if (t == tid)
+      return i;
+    if (!t && atomic_compare_exchange_strong_explicit(
+                  &g_pprof.ring[i].tid, &t, tid, memory_order_acquire,
+                  memory_order_relaxed)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static uint64_t pprof_hash(const uintptr_t *pc, int n) {
+  int i;
+  uint64_t h = 0x9e3779b97f4a7c15;
+  for (i = 0; i < n; ++i) {
+    h ^= pc[i];
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+static void pprof_add(const uintptr_t *pc, int n) {
+  uint64_t h;
+  uint32_t i;
+  struct PprofStack *s;
+  h = pprof_hash(pc, n);
+  for (i = h;; ++i) {
+    s = g_pprof.table + (i & (PPROF_TABLE - 1));
+    if (!s->count)
+      break;
+    if (s->hash == h && s->depth == n &&
+        !memcmp(g_pprof.arena + s->off, pc, n * sizeof(*pc))) {
+      ++s->count;
+      return;
+    }
+  }
+  if (g_pprof.stacks >= PPROF_TABLE / 4 * 3 ||
+      g_pprof.used + n > PPROF_ARENA) {
+    atomic_fetch_add_explicit(&g_pprof.dropped, 1, memory_order_relaxed);
+    return;
+  }
+  memcpy(g_pprof.arena + g_pprof.used, pc, n * sizeof(*pc));
+  s->hash = h;
+  s->off = g_pprof.used;
+  s->depth = n;
+  s->count = 1;
+  g_pprof.used += n;
+  g_pprof.stacks += 1;
+}
+
+// moves samples from per-thread rings into table of distinct stacks
+// this must only be called by the holder of the drain lock
+static void pprof_drain(void) {
+  int i, j, n;
+  unsigned h, t;
+  uintptr_t *w, pc[PPROF_DEPTH];
+  for (i = 0; i < PPROF_THREADS; ++i) {
+    w = g_pprof.rings + (size_t)i * PPROF_RING;
+    h = atomic_load_explicit(&g_pprof.ring[i].head, memory_order_acquire);
+    t = atomic_load_explicit(&g_pprof.ring[i].tail, memory_order_relaxed);
+    while (t != h) {
+      n = w[t++ % PPROF_RING];
+      for (j = 0; j < n; ++j)
+        pc[j] = w[t++ % PPROF_RING];
+      pprof_add(pc, n);
+    }
+    atomic_store_explicit(&g_pprof.ring[i].tail, t, memory_order_release);
+  }
+}
+
+static bool pprof_trylock(void) {
+  return !atomic_exchange_explicit(&g_pprof.draining, true,
+                                   memory_order_acquire);
+}
+
+static void pprof_lock(void) {
+  while (!pprof_trylock())
+    sched_yield();
+}
+
+static void pprof_unlock(void) {
+  atomic_store_explicit(&g_pprof.draining, false, memory_order_release);
+}
+
+static void pprof_onsig(int sig, siginfo_t *si, void *arg) {
+  int i, j, n;
+  unsigned h, t;
+  struct PosixThread *pt;
+  uintptr_t *w, pc[PPROF_DEPTH];
+  if ((pt = (struct PosixThread *)__get_tls()->tib_pthread) &&
+      (pt->pt_flags & PT_EXITING))
+    return;  // don't claim ring again after __pprof_thread_exit()
+  if ((i = pprof_claim()) == -1) {
+    atomic_fetch_add_explicit(&g_pprof.dropped, 1, memory_order_relaxed);
+    return;
+  }
+  n = pprof_unwind(arg, pc);
+  w = g_pprof.rings + (size_t)i * PPROF_RING;
+  h = atomic_load_explicit(&g_pprof.ring[i].head, memory_order_relaxed);
+  t = atomic_load_explicit(&g_pprof.ring[i].tail, memory_order_acquire);
+  if (h - t + 1 + n > PPROF_RING) {
+    atomic_fetch_add_explicit(&g_pprof.dropped, 1, memory_order_relaxed);
+  } else {
+    w[h++ % PPROF_RING] = n;
+    for (j = 0; j < n; ++j)
+      w[h++ % PPROF_RING] = pc[j];
+    atomic_store_explicit(&g_pprof.ring[i].head, h, memory_order_release);
+  }
+  if (h - t > PPROF_RING / 2 && pprof_trylock()) {
+    pprof_drain();
+    pprof_unlock();
+  }
+}
+
+static void pprof_flush(struct PprofOut *o) {
+  if (o->n && o->rc != -1 && write(o->fd, o->b, o->n) != o->n)
+    o->rc = -1;
+  o->n = 0;
+}
+
+static void pprof_put(struct PprofOut *o, const void *p, size_t n) {
+  size_t m;
+  while (n) {
+    if (o->n == sizeof(o->b))
+      pprof_flush(o);
+    m = MIN(n, sizeof(o->b) - o->n);
+    memcpy(o->b + o->n, p, m);
+    o->n += m;
+    p = (const char *)p + m;
+    n -= m;
+  }
+}
+
+static void pprof_puts(struct PprofOut *o, const char *s) {
+  pprof_put(o, s, strlen(s));
+}
+
+// return addresses are rewound into the call instruction
+static uintptr_t pprof_pc(const struct PprofStack *s, int i) {
+  uintptr_t pc = g_pprof.arena[s->off + i];
+  return i ? pc - 1 : pc;
+}
+
+static const char *pprof_name(struct SymbolTable *st, uintptr_t pc,
+                              char buf[19]) {
+  int i;
+  char *p;
+  const char *s;
+  if (st && (i = __get_symbol(st, pc)) != -1 &&
+      (s = __get_symbol_name(st, i))) {
+    return s;
+  }
+  p = stpcpy(buf, "0x");
+  p += uint64toarray_radix16(pc, p);
+  return buf;
+}
+
+// writes one `outer;inner;leaf count` line per distinct stack
+static void pprof_folded(struct PprofOut *o) {
+  int j;
+  uint32_t i;
+  char buf[21];
+  struct SymbolTable *st;
+  struct PprofStack *s;
+  st = GetSymbolTable();
+  for (i = 0; i < PPROF_TABLE; ++i) {
+    s = g_pprof.table + i;
+    if (!s->count)
+      continue;
+    for (j = s->depth; j--;) {
+      pprof_puts(o, pprof_name(st, pprof_pc(s, j), buf));
+      pprof_put(o, j ? ";" : " ", 1);
+    }
+    pprof_put(o, buf, FormatUint64(buf, s->count) - buf);
+    pprof_put(o, "\n", 1);
+  }
+}
+
+static char *pb_varint(char *p, uint64_t x) {
+  while (x > 127) {
+    *p++ = x | 128;
+    x >>= 7;
+  }
+  *p++ = x;
+  return p;
+}
+
+static char *pb_int(char *p, int field, uint64_t x) {
+  p = pb_varint(p, field << 3);
+  return pb_varint(p, x);
+}
+
+static void pb_bytes(struct PprofOut *o, int field, const void *p, size_t n) {
+  char b[20], *q;
+  q = pb_varint(b, field << 3 | 2);
+  q = pb_varint(q, n);
+  pprof_put(o, b, q - b);
+  pprof_put(o, p, n);
+}
+
+static void pb_valuetype(struct PprofOut *o, int field, int type, int unit) {
+  char b[20], *q;
+  q = pb_int(b, 1, type);
+  q = pb_int(q, 2, unit);
+  pb_bytes(o, field, b, q - b);
+}
+
+static uint32_t pprof_find(const long *a, size_t n, long x) {
+  size_t l, r, m;
+  for (l = 0, r = n; l < r;) {
+    m = (l + r) / 2;
+    if (a[m] < x) {
+      l = m + 1;
+    } else {
+      r = m;
+    }
+  }
+  return l + 1;
+}
+
+// writes profile.proto message that `go tool pprof` understands, where
+// every address that appears in a stack becomes a location, and every
+// symbol those addresses resolve to becomes a function
+static void pprof_protobuf(struct PprofOut *o) {
+  int j;
+  const char *name;
+  struct SymbolTable *st;
+  struct PprofStack *s;
+  int32_t *fid, *sym, sy;
+  long *pcs, period;
+  char *q, m[512], ids[PPROF_DEPTH * 5];
+  size_t i, k, n, size, nfuncs;
+  enum { kSamples = 1, kCount, kCpu, kNanos, kFile, kNames };
+  st = GetSymbolTable();
+  period = 1000000000 / g_pprof.hz;
+  size = g_pprof.used * (sizeof(long) + sizeof(int32_t) * 2);
+  if (st)
+    size += st->count * sizeof(int32_t);
+  if (!(pcs = _mapanon(size + 1))) {
+    o->rc = -1;
+    return;
+  }
+  sym = (int32_t *)(pcs + g_pprof.used);
+  fid = sym + g_pprof.used * 2;
+  for (n = i = 0; i < PPROF_TABLE; ++i) {
+    s = g_pprof.table + i;
+    for (j = 0; s->count && j < s->depth; ++j) {
+      pcs[n++] = pprof_pc(s, j);
+    }
+  }
+  _longsort(pcs, n);
+  for (k = i = 0; i < n; ++i) {
+    if (!k || pcs[i] != pcs[k - 1]) {
+      pcs[k++] = pcs[i];
+    }
+  }
+  n = k;
+  pb_valuetype(o, 1, kSamples, kCount);
+  pb_valuetype(o, 1, kCpu, kNanos);
+  for (i = 0; i < PPROF_TABLE; ++i) {
+    s = g_pprof.table + i;
+    if (!s->count)
+      continue;
+    for (q = ids, j = 0; j < s->depth; ++j) {
+      q = pb_varint(q, pprof_find(pcs, n, pprof_pc(s, j)));
+    }
+    k = q - ids;
+    q = pb_varint(m, 1 << 3 | 2);
+    q = pb_varint(q, k);
+    q = mempcpy(q, ids, k);
+    q = pb_varint(q, 2 << 3 | 2);
+    k = pb_varint(pb_varint(ids, s->count), s->count * period) - ids;
+    q = pb_varint(q, k);
+    q = mempcpy(q, ids, k);
+    pb_bytes(o, 2, m, q - m);
+  }
+  if (st) {
+    q = pb_int(m, 1, 1);
+    q = pb_int(q, 2, st->addr_base);
+    q = pb_int(q, 3, st->addr_end + 1);
+    q = pb_int(q, 5, kFile);
+    q = pb_int(q, 7, 1);
+    pb_bytes(o, 3, m, q - m);
+  }
+  for (nfuncs = i = 0; i < n; ++i) {
+    sy = st ? __get_symbol(st, pcs[i]) : -1;
+    sym[i] = sy;
+    if (sy != -1 && !fid[sy]) {
+      fid[sy] = ++nfuncs;
+      sym[g_pprof.used + nfuncs - 1] = sy;
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    q = pb_int(m, 1, i + 1);
+    if (st && st->addr_base <= pcs[i] && pcs[i] <= st->addr_end)
+      q = pb_int(q, 2, 1);
+    q = pb_int(q, 3, pcs[i]);
+    if (sym[i] != -1) {
+      k = pb_int(ids, 1, fid[sym[i]]) - ids;
+      q = pb_varint(q, 4 << 3 | 2);
+      q = pb_varint(q, k);
+      q = mempcpy(q, ids, k);
+    }
+    pb_bytes(o, 4, m, q - m);
+  }
+  for (i = 0; i < nfuncs; ++i) {
+    q = pb_int(m, 1, i + 1);
+    q = pb_int(q, 2, kNames + i);
+    q = pb_int(q, 3, kNames + i);
+    pb_bytes(o, 5, m, q - m);
+  }
+  pb_bytes(o, 6, "", 0);
+  pb_bytes(o, 6, "samples", 7);
+  pb_bytes(o, 6, "count", 5);
+  pb_bytes(o, 6, "cpu", 3);
+  pb_bytes(o, 6, "nanoseconds", 11);
+  name = GetProgramExecutableName();
+  pb_bytes(o, 6, name, strlen(name));
+  for (i = 0; i < nfuncs; ++i) {
+    name = __get_symbol_name(st, sym[g_pprof.used + i]);
+    pb_bytes(o, 6, name, strlen(name));
+  }
+  q = pb_int(m, 9, timespec_tonanos(g_pprof.start));
+  q = pb_int(q, 10,
+             timespec_tonanos(timespec_sub(timespec_real(), g_pprof.start)));
+  pprof_put(o, m, q - m);
+  pb_valuetype(o, 11, kCpu, kNanos);
+  q = pb_int(m, 12, period);
+  pprof_put(o, m, q - m);
+  munmap(pcs, size + 1);
+}
+
+/**
+ * Starts sampling CPU usage of all threads.
+ *
+ * This arms `ITIMER_PROF` so the thread that's consuming CPU receives
+ * `SIGPROF` `hz` times per second of CPU time consumed. Backtraces are
+ * obtained by following frame pointers. Calling this again after it's
+ * been stopped resumes sampling, adding to the same profile. Up to 128
+ * threads are sampled at once. Processes created by fork() while this
+ * is running keep sampling, into a profile of their own.
+ *
+ * @param hz is sampling frequency, where 100 is a good choice
+ * @return 0 on success, or -1 w/ errno
+ * @raise ENOTSUP on Windows and bare metal
+ * @raise EINVAL if `hz` isn't within 1 to 10000
+ * @see pprof_write()
+ */
+int pprof_start(int hz) {
+  struct itimerval it;
+  struct sigaction sa = {.sa_sigaction = pprof_onsig,
+                         .sa_flags = SA_SIGINFO | SA_RESTART};
+  if (IsWindows() || IsMetal())
+    return enotsup();
+  if (hz < 1 || hz > 10000)
+    return einval();
+  if (!g_pprof.rings) {
+    g_pprof.size = PPROF_THREADS * PPROF_RING * sizeof(uintptr_t) +
+                   PPROF_ARENA * sizeof(uintptr_t) +
+                   PPROF_TABLE * sizeof(struct PprofStack);
+    if (!(g_pprof.rings = _mapanon(g_pprof.size)))
+      return -1;
+    g_pprof.arena = g_pprof.rings + PPROF_THREADS * PPROF_RING;
+    g_pprof.table = (struct PprofStack *)(g_pprof.arena + PPROF_ARENA);
+    g_pprof.start = timespec_real();
+  }
+  g_pprof.pid = getpid();
+  g_pprof.hz = hz;
+  if (sigaction(SIGPROF, &sa, 0))
+    return -1;
+  it.it_interval.tv_sec = 0;
+  it.it_interval.tv_usec = 1000000 / hz;
+  it.it_value = it.it_interval;
+  if (setitimer(ITIMER_PROF, &it, 0))
+    return -1;
+  g_pprof.running = true;
+  return 0;
+}
+
+/**
+ * Stops sampling CPU usage.
+ *
+ * Samples that have already been collected are retained.
+ */
+int pprof_stop(void) {
+  struct itimerval it = {0};
+  if (!g_pprof.rings)
+    return 0;
+  g_pprof.running = false;
+  return setitimer(ITIMER_PROF, &it, 0);
+}
+
+// gives ring of exiting thread to whichever thread claims one next, as
+// samples that are still in it get drained along with everything else
+void __pprof_thread_exit(void) {
+  int i, tid;
+  if (!g_pprof.rings)
+    return;
+  tid = gettid();
+  for (i = 0; i < PPROF_THREADS; ++i) {
+    if (atomic_load_explicit(&g_pprof.ring[i].tid, memory_order_relaxed) ==
+        tid) {
+      atomic_store_explicit(&g_pprof.ring[i].tid, 0, memory_order_release);
+      break;
+    }
+  }
+}
+
+// turns e.g. `prog.pprof` into `prog.<pid>.pprof`
+static void pprof_rename(void) {
+  size_t n;
+  char *p, ext[16];
+  n = strlen(g_pprof.path);
+  if (!(p = strrchr(g_pprof.path, '.')) || strchr(p, '/') ||
+      strlen(p) >= sizeof(ext))
+    p = g_pprof.path + n;
+  if (n + 12 >= sizeof(g_pprof.path))
+    return;
+  strcpy(ext, p);
+  *p++ = '.';
+  p = FormatInt32(p, getpid());
+  strcpy(p, ext);
+}
+
+// called by fork() in child, which didn't inherit the itimer
+void __pprof_fork_child(void) {
+  if (!g_pprof.running)
+    return;
+  // discard what the parent sampled, which mmap() zeroes lazily
+  if (mmap(g_pprof.rings, g_pprof.size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+    g_pprof.running = false;
+    return;
+  }
+  bzero(g_pprof.ring, sizeof(g_pprof.ring));
+  atomic_store_explicit(&g_pprof.draining, false, memory_order_relaxed);
+  atomic_store_explicit(&g_pprof.dropped, 0, memory_order_relaxed);
+  g_pprof.used = 0;
+  g_pprof.stacks = 0;
+  g_pprof.start = timespec_real();
+  if (*g_pprof.path)
+    pprof_rename();
+  if (pprof_start(g_pprof.hz) == -1)
+    g_pprof.running = false;
+}
+
+/**
+ * Writes CPU profile collected so far.
+ *
+ * Symbols are resolved using GetSymbolTable(), so a `.dbg` file or an
+ * embedded symbol table needs to be available for names to show up.
+ *
+ * @param fd is where output is written
+ * @param format is `PPROF_FOLDED` to write stacks in the format that's
+ *     accepted by `flamegraph.pl`, or `PPROF_PROTOBUF` to write an
+ *     uncompressed profile which `go tool pprof` accepts
+ * @return 0 on success, or -1 w/ errno
+ * @raise EINVAL if profiling was never started
+ */
+int pprof_write(int fd, int format) {
+  struct PprofOut o;
+  if (!g_pprof.rings)
+    return einval();
+  o.fd = fd;
+  o.rc = 0;
+  o.n = 0;
+  pprof_lock();
+  pprof_drain();
+  if (format == PPROF_PROTOBUF) {
+    pprof_protobuf(&o);
+  } else {
+    pprof_folded(&o);
+  }
+  pprof_unlock();
+  pprof_flush(&o);
+  if (atomic_load_explicit(&g_pprof.dropped, memory_order_relaxed))
+    STRACE("pprof_write() %lu samples dropped",
+           atomic_load_explicit(&g_pprof.dropped, memory_order_relaxed));
+  return o.rc;
+}
+
+static void pprof_atexit(void) {
+  int fd;
+  size_t n;
+  if (getpid() != g_pprof.pid)
+    return;  // forked child
+  pprof_stop();
+  if ((fd = open(g_pprof.path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+    return;
+  n = strlen(g_pprof.path);
+  if ((n >= 7 && !strcmp(g_pprof.path + n - 7, ".folded")) ||
+      (n >= 4 && !strcmp(g_pprof.path + n - 4, ".txt"))) {
+    pprof_write(fd, PPROF_FOLDED);
+  } else {
+    pprof_write(fd, PPROF_PROTOBUF);
+  }
+  close(fd);
+}
+
+/**
+ * Enables CPU profiling if `--pprof` flag or `PPROF` variable is set.
+ *
+ * The profile is written when the process exits to the path in the
+ * `PPROF` environment variable, or `$PROG.pprof` if that's not set.
+ * Paths ending with `.folded` or `.txt` get folded stacks for making
+ * flame graphs, and everything else gets pprof protobuf. The sampling
+ * rate is 100hz. Forked children write their own profiles, which have
+ * their pid inserted before the extension, e.g. `$PROG.$PID.pprof`.
+ */
+textstartup void __pprof_init(void) {
+  const char *s;
+  if (!(s = __getenv(environ, "PPROF").s) || !*s) {
+    strlcpy(g_pprof.path, program_invocation_short_name,
+            sizeof(g_pprof.path) - 6);
+    strcat(g_pprof.path, ".pprof");
+  } else {
+    strlcpy(g_pprof.path, s, sizeof(g_pprof.path));
+  }
+  if (pprof_start(100) != -1)
+    atexit(pprof_atexit);
+}
@@ -94,6 +94,9 @@ void ShowCrashReports(void) libcesque;
 int ftrace_install(void) libcesque;
 int ftrace_enabled(int) libcesque;
 int strace_enabled(int) libcesque;
+int pprof_start(int) libcesque;
+int pprof_stop(void) libcesque;
+int pprof_write(int, int) libcesque;
 void __print_maps(size_t) libcesque;
 void __print_maps_win32(void) libcesque;
 void __printargs(const char *) libcesque;
@@ -137,6 +140,8 @@ long __get_phys_pages(void) pureconst libcesque;
 long __get_minsigstksz(void) pureconst libcesque;
 long __get_safe_size(long, long) libcesque;
 char *__get_tmpdir(void) libcesque;
+#define PPROF_FOLDED   0
+#define PPROF_PROTOBUF 1
 forceinline int __trace_disabled(int x) {
   return 0;
 }
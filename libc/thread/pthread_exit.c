@@ -28,6 +28,7 @@
 #include "libc/limits.h"
 #include "libc/mem/gc.h"
 #include "libc/mem/mem.h"
+#include "libc/runtime/ftrace.internal.h"
 #include "libc/runtime/internal.h"
 #include "libc/runtime/runtime.h"
 #include "libc/str/str.h"
@@ -92,6 +93,10 @@ wontreturn void pthread_exit(void *rc) {
 
   // free resources
   __cxa_thread_finalize();
+  if (_weaken(__ftrace_ring_exit))
+    _weaken(__ftrace_ring_exit)();
+  if (_weaken(__pprof_thread_exit))
+    _weaken(__pprof_thread_exit)();
 
   // run atexit handlers if orphaned thread
   // notice how we avoid acquiring the pthread gil
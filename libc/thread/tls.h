@@ -39,6 +39,7 @@ struct CosmoTib {
   uint32_t tib_sigstack_flags;
   void *tib_nsync;
   void *tib_atexit;
+  void *tib_ftrace_ring;
   _Atomic(void *) tib_keys[46];
   void *tib_locks[64];
 } __attribute__((__aligned__(64)));
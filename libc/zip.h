@@ -59,12 +59,14 @@
 #define kZipEra1989 10 /* PKZIP 1.0 */
 #define kZipEra1993 20 /* PKZIP 2.0: deflate/subdir/etc. support */
 #define kZipEra2001 45 /* PKZIP 4.5: kZipExtraZip64 support */
+#define kZipEra2020 63 /* PKZIP 6.3.7: zstandard support */
 
 #define kZipIattrBinary 0 /* first bit not set */
 #define kZipIattrText   1 /* first bit set */
 
 #define kZipCompressionNone    0
 #define kZipCompressionDeflate 8
+#define kZipCompressionZstd    93
 
 #define kZipCdirHdrMagic            ZM_(0x06054b50) /* PK♣♠ "PK\5\6" */
 #define kZipCdirHdrMagicTodo        ZM_(0x19184b50) /* PK♣♠ "PK\30\31" */
@@ -0,0 +1,487 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/macros.h"
+#include "libc/mem/mem.h"
+#include "libc/str/str.h"
+#include "libc/str/tab.h"
+#include "net/http/http2.h"
+
+/**
+ * @fileoverview HPACK header compression for HTTP/2 (RFC 7541)
+ */
+
+static const struct HpackStatic {
+  const char *k, *v;
+} kHpackStatic[61] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+// canonical huffman code from RFC 7541 appendix b, where index 256 is
+// the end-of-string symbol; count and symbol are in puff.c's layout
+static const uint32_t kHpackHuffmanCode[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5,
+    0xfffffe6, 0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9,
+    0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee,
+    0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9,
+    0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9, 0xffa,
+    0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+    0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b,
+    0x1c, 0x1d, 0x1e, 0x1f, 0x5c, 0xfb,
+    0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21,
+    0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+    0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73,
+    0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+    0x25, 0x26, 0x27, 0x6, 0x74, 0x75,
+    0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76,
+    0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+    0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8,
+    0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda,
+    0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1,
+    0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5,
+    0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+    0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf,
+    0x7fffeb, 0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2,
+    0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2,
+    0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2,
+    0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+    0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+    0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3,
+    0x7ffffe4, 0x7ffffe5, 0xfffec, 0xfffff3, 0xfffed, 0x1fffe6,
+    0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3, 0x3fffea, 0x3fffeb,
+    0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+    0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+    0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee, 0x3fffffff,
+};
+
+static const uint8_t kHpackHuffmanBits[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+static const uint8_t kHpackHuffmanCount[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+
+static const uint16_t kHpackHuffmanSymbol[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37,
+    45, 46, 47, 51, 52, 53, 54, 55, 56, 57, 61, 65,
+    95, 98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+    58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89,
+    106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44, 59,
+    88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35, 62,
+    0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+    167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+    173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+    151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+    183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+    255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+    246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5,
+    6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220,
+    249, 10, 13, 22, 256,
+};
+
+/**
+ * Initializes HPACK decoder dynamic table.
+ *
+ * @param cap is SETTINGS_HEADER_TABLE_SIZE we advertised to peer
+ */
+void InitHpack(struct Hpack *h, uint32_t cap) {
+  bzero(h, sizeof(*h));
+  h->max = h->cap = cap;
+}
+
+/**
+ * Frees memory held by HPACK dynamic table.
+ */
+void DestroyHpack(struct Hpack *h) {
+  uint32_t i;
+  for (i = 0; i < h->n; ++i)
+    free(h->p[i].p);
+  free(h->p);
+  free(h->b);
+  bzero(h, sizeof(*h));
+}
+
+static void EvictHpack(struct Hpack *h, uint32_t max) {
+  while (h->n && h->size > max) {
+    h->size -= h->p[0].k + h->p[0].v + 32;
+    free(h->p[0].p);
+    memmove(h->p, h->p + 1, --h->n * sizeof(*h->p));
+  }
+}
+
+static int AddHpack(struct Hpack *h, const char *k, size_t kn, const char *v,
+                    size_t vn) {
+  char *p;
+  uint32_t c;
+  struct HpackField *q;
+  if (kn + vn + 32 > h->max) {
+    EvictHpack(h, 0);
+    return 0;
+  }
+  // copy first since name may reference an entry we're about to evict
+  if (!(p = malloc(kn + vn + 1)))
+    return -1;
+  memcpy(p, k, kn);
+  memcpy(p + kn, v, vn);
+  EvictHpack(h, h->max - (kn + vn + 32));
+  if (h->n == h->c) {
+    c = h->c ? h->c * 2 : 16;
+    if (!(q = realloc(h->p, c * sizeof(*h->p)))) {
+      free(p);
+      return -1;
+    }
+    h->p = q;
+    h->c = c;
+  }
+  h->p[h->n].p = p;
+  h->p[h->n].k = kn;
+  h->p[h->n].v = vn;
+  h->size += kn + vn + 32;
+  h->n++;
+  return 0;
+}
+
+static int LookupHpack(struct Hpack *h, uint32_t i, const char **k, size_t *kn,
+                       const char **v, size_t *vn) {
+  struct HpackField *f;
+  if (!i) {
+    return -1;
+  } else if (i <= ARRAYLEN(kHpackStatic)) {
+    *k = kHpackStatic[i - 1].k;
+    *kn = strlen(*k);
+    *v = kHpackStatic[i - 1].v;
+    *vn = strlen(*v);
+    return 0;
+  } else if ((i -= ARRAYLEN(kHpackStatic) + 1) < h->n) {
+    f = h->p + h->n - 1 - i;
+    *k = f->p;
+    *kn = f->k;
+    *v = f->p + f->k;
+    *vn = f->v;
+    return 0;
+  } else {
+    return -1;
+  }
+}
+
+static int DecodeInt(const unsigned char **pp, const unsigned char *e,
+                     int bits, uint32_t *out) {
+  int s;
+  uint32_t m, x;
+  const unsigned char *p = *pp;
+  if (p == e)
+    return -1;
+  m = (1u << bits) - 1;
+  if ((x = *p++ & m) == m) {
+    for (s = 0;; s += 7) {
+      if (p == e || s > 21)
+        return -1;
+      x += (uint32_t)(*p & 127) << s;
+      if (!(*p++ & 128))
+        break;
+    }
+  }
+  *pp = p;
+  *out = x;
+  return 0;
+}
+
+static ssize_t DecodeHuffman(char *d, const unsigned char *s, size_t n) {
+  size_t i;
+  char *d0 = d;
+  int len, bit, ones, code, first, count, index;
+  code = first = index = len = 0;
+  for (ones = 1, i = 0; i < n * 8; ++i) {
+    bit = s[i >> 3] >> (7 - (i & 7)) & 1;
+    code |= bit;
+    ones &= bit;
+    count = kHpackHuffmanCount[++len];
+    if (code - first < count) {
+      if ((index += code - first) == 256)
+        return -1;  // eos must not be encoded
+      *d++ = kHpackHuffmanSymbol[index];
+      code = first = index = len = 0;
+      ones = 1;
+    } else if (len == 30) {
+      return -1;
+    } else {
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+  }
+  if (len > 7 || !ones)
+    return -1;  // padding must be a short prefix of eos
+  return d - d0;
+}
+
+static int DecodeString(struct Hpack *h, const unsigned char **pp,
+                        const unsigned char *e, size_t *o, const char **s,
+                        size_t *n) {
+  bool huff;
+  ssize_t rc;
+  uint32_t len;
+  if (*pp == e)
+    return -1;
+  huff = **pp & 128;
+  if (DecodeInt(pp, e, 7, &len) == -1 || len > e - *pp)
+    return -1;
+  if (huff) {
+    if ((rc = DecodeHuffman(h->b + *o, *pp, len)) == -1)
+      return -1;
+    *s = h->b + *o;
+    *n = rc;
+    *o += rc;
+  } else {
+    *s = (const char *)*pp;
+    *n = len;
+  }
+  *pp += len;
+  return 0;
+}
+
+/**
+ * Decodes HPACK header block.
+ *
+ * The callback is invoked for each field in order. Strings are only
+ * valid for the duration of the callback and aren't nul terminated.
+ *
+ * @param f is called with name and value, returning nonzero to stop
+ * @return 0 on success, -1 on compression error, or callback result
+ */
+int DecodeHpack(struct Hpack *h, const char *block, size_t size, hpack_f *f,
+                void *arg) {
+  int rc;
+  char *b;
+  bool index;
+  uint32_t i;
+  size_t o, need, kn, vn;
+  const char *k, *v;
+  const unsigned char *p, *e;
+  // huffman output is at most 8/5 of input since codes are ≥5 bits
+  need = size + size / 4 * 3 + 8;
+  if (h->bn < need) {
+    if (!(b = realloc(h->b, need)))
+      return -1;
+    h->b = b;
+    h->bn = need;
+  }
+  p = (const unsigned char *)block;
+  e = p + size;
+  while (p < e) {
+    o = 0;
+    if (*p & 0x80) {
+      // indexed header field
+      if (DecodeInt(&p, e, 7, &i) == -1 ||
+          LookupHpack(h, i, &k, &kn, &v, &vn) == -1)
+        return -1;
+      if ((rc = f(arg, k, kn, v, vn)))
+        return rc;
+    } else if ((*p & 0xe0) == 0x20) {
+      // dynamic table size update
+      if (DecodeInt(&p, e, 5, &i) == -1 || i > h->cap)
+        return -1;
+      h->max = i;
+      EvictHpack(h, i);
+    } else {
+      // literal header field with incremental indexing (01xxxxxx),
+      // without indexing (0000xxxx), or never indexed (0001xxxx)
+      index = (*p & 0xc0) == 0x40;
+      if (DecodeInt(&p, e, index ? 6 : 4, &i) == -1)
+        return -1;
+      if (i) {
+        if (LookupHpack(h, i, &k, &kn, &v, &vn) == -1)
+          return -1;
+      } else if (DecodeString(h, &p, e, &o, &k, &kn) == -1) {
+        return -1;
+      }
+      if (DecodeString(h, &p, e, &o, &v, &vn) == -1)
+        return -1;
+      if ((rc = f(arg, k, kn, v, vn)))
+        return rc;
+      if (index && AddHpack(h, k, kn, v, vn) == -1)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+static char *EncodeInt(char *p, int flags, int bits, uint32_t x) {
+  uint32_t m = (1u << bits) - 1;
+  if (x < m) {
+    *p++ = flags | x;
+    return p;
+  }
+  *p++ = flags | m;
+  for (x -= m; x >= 128; x >>= 7)
+    *p++ = 128 | (x & 127);
+  *p++ = x;
+  return p;
+}
+
+static char *EncodeString(char *p, const char *s, size_t n) {
+  size_t i;
+  int b, c;
+  uint64_t w, bits;
+  for (bits = i = 0; i < n; ++i)
+    bits += kHpackHuffmanBits[s[i] & 255];
+  if ((bits + 7) / 8 >= n) {
+    p = EncodeInt(p, 0, 7, n);
+    return mempcpy(p, s, n);
+  }
+  p = EncodeInt(p, 128, 7, (bits + 7) / 8);
+  for (w = b = i = 0; i < n; ++i) {
+    c = s[i] & 255;
+    w = w << kHpackHuffmanBits[c] | kHpackHuffmanCode[c];
+    for (b += kHpackHuffmanBits[c]; b >= 8;)
+      *p++ = w >> (b -= 8);
+  }
+  if (b)
+    *p++ = w << (8 - b) | 0xff >> b;
+  return p;
+}
+
+/**
+ * Encodes header field without adding it to any dynamic table.
+ *
+ * Fields that exactly match the static table, e.g. `:status: 200`, are
+ * encoded as a single index. Otherwise the name is referenced from the
+ * static table if possible and the value is Huffman coded if that makes
+ * it shorter. Literal names are lowercased as HTTP/2 requires.
+ *
+ * @param p needs at least `kn + vn + 16` bytes of space
+ * @return pointer to end of output
+ */
+char *EncodeHpack(char *p, const char *k, size_t kn, const char *v,
+                  size_t vn) {
+  size_t i, j;
+  for (j = i = 0; i < ARRAYLEN(kHpackStatic); ++i) {
+    if (strlen(kHpackStatic[i].k) == kn &&
+        !strncasecmp(kHpackStatic[i].k, k, kn)) {
+      if (strlen(kHpackStatic[i].v) == vn && !memcmp(kHpackStatic[i].v, v, vn))
+        return EncodeInt(p, 0x80, 7, i + 1);
+      if (!j)
+        j = i + 1;
+    }
+  }
+  if (j) {
+    p = EncodeInt(p, 0x00, 4, j);
+  } else {
+    *p++ = 0;
+    p = EncodeInt(p, 0, 7, kn);
+    for (i = 0; i < kn; ++i)
+      *p++ = kToLower[k[i] & 255];
+  }
+  return EncodeString(p, v, vn);
+}
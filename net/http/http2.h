@@ -0,0 +1,79 @@
+#ifndef COSMOPOLITAN_NET_HTTP_HTTP2_H_
+#define COSMOPOLITAN_NET_HTTP_HTTP2_H_
+
+#define kHttp2Preface     "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define kHttp2FrameHeader 9
+
+#define kHttp2Data         0
+#define kHttp2Headers      1
+#define kHttp2Priority     2
+#define kHttp2RstStream    3
+#define kHttp2Settings     4
+#define kHttp2PushPromise  5
+#define kHttp2Ping         6
+#define kHttp2Goaway       7
+#define kHttp2WindowUpdate 8
+#define kHttp2Continuation 9
+
+#define kHttp2FlagAck        0x01
+#define kHttp2FlagEndStream  0x01
+#define kHttp2FlagEndHeaders 0x04
+#define kHttp2FlagPadded     0x08
+#define kHttp2FlagPriority   0x20
+
+#define kHttp2SettingsHeaderTableSize      1
+#define kHttp2SettingsEnablePush           2
+#define kHttp2SettingsMaxConcurrentStreams 3
+#define kHttp2SettingsInitialWindowSize    4
+#define kHttp2SettingsMaxFrameSize         5
+#define kHttp2SettingsMaxHeaderListSize    6
+
+#define kHttp2NoError            0
+#define kHttp2ProtocolError      1
+#define kHttp2InternalError      2
+#define kHttp2FlowControlError   3
+#define kHttp2SettingsTimeout    4
+#define kHttp2StreamClosed       5
+#define kHttp2FrameSizeError     6
+#define kHttp2RefusedStream      7
+#define kHttp2Cancel             8
+#define kHttp2CompressionError   9
+#define kHttp2ConnectError       10
+#define kHttp2EnhanceYourCalm    11
+#define kHttp2InadequateSecurity 12
+#define kHttp2Http11Required     13
+
+#define kHttp2DefaultWindow    65535
+#define kHttp2DefaultFrameSize 16384
+#define kHttp2MaxWindow        0x7fffffff
+
+#define kHpackTableSize 4096
+
+COSMOPOLITAN_C_START_
+
+struct HpackField {
+  char *p; /* name followed by value */
+  uint32_t k, v;
+};
+
+struct Hpack {
+  uint32_t size; /* sum of name + value + 32 for each entry */
+  uint32_t max;  /* current limit set by encoder */
+  uint32_t cap;  /* ceiling we advertised in SETTINGS */
+  uint32_t n, c;
+  struct HpackField *p; /* oldest first */
+  size_t bn;
+  char *b; /* huffman scratch */
+};
+
+typedef int hpack_f(void *, const char *, size_t, const char *, size_t);
+
+void InitHpack(struct Hpack *, uint32_t) libcesque;
+void DestroyHpack(struct Hpack *) libcesque;
+int DecodeHpack(struct Hpack *, const char *, size_t, hpack_f *,
+                void *) libcesque;
+char *EncodeHpack(char *, const char *, size_t, const char *,
+                  size_t) libcesque;
+
+COSMOPOLITAN_C_END_
+#endif /* COSMOPOLITAN_NET_HTTP_HTTP2_H_ */
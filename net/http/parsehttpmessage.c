@@ -29,6 +29,8 @@
 #include "libc/sysv/errfuns.h"
 #include "libc/x/x.h"
 #include "net/http/http.h"
+#include "third_party/aarch64/arm_neon.internal.h"
+#include "third_party/intel/emmintrin.internal.h"
 
 /**
  * Initializes HTTP message parser.
@@ -69,6 +71,85 @@ void ResetHttpMessage(struct HttpMessage *r, int type) {
   r->type = type;
 }
 
+/**
+ * Returns index of first byte at or after `i` that's either below `lo`
+ * or a C1 control code. Only whole 16-byte blocks are considered, so a
+ * result less than `n` isn't necessarily special. The state machine is
+ * still what decides the meaning of every byte this doesn't skip over.
+ */
+static inline size_t SkipHttpText(const char *p, size_t i, size_t n, int lo) {
+#if defined(__x86_64__) && !defined(__chibicc__)
+  unsigned m;
+  __m128i v, a, b;
+  a = _mm_set1_epi8(lo ^ 0x80);
+  b = _mm_set1_epi8(0x21 ^ 0x80);
+  for (; i + 16 <= n; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    m = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmplt_epi8(_mm_xor_si128(v, _mm_set1_epi8(0x80)), a),
+        _mm_cmplt_epi8(
+            _mm_xor_si128(_mm_sub_epi8(v, _mm_set1_epi8(0x7F)),
+                          _mm_set1_epi8(0x80)),
+            b)));
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  uint64_t m;
+  uint8x16_t v, x;
+  for (; i + 16 <= n; i += 16) {
+    v = vld1q_u8((const uint8_t *)(p + i));
+    x = vorrq_u8(vcltq_u8(v, vdupq_n_u8(lo)),
+                 vcltq_u8(vsubq_u8(v, vdupq_n_u8(0x7F)), vdupq_n_u8(0x21)));
+    vst1_u8((uint8_t *)&m, vshrn_n_u16(vreinterpretq_u16_u8(x), 4));
+    if (m)
+      return i + (__builtin_ctzll(m) >> 2);
+  }
+#endif
+  return i;
+}
+
+/**
+ * Returns index of first byte at or after `i` that isn't a letter, a
+ * digit, or a dash, which are what nearly all header names consist of.
+ * The rest of the token characters are validated by the state machine.
+ */
+static inline size_t SkipHttpName(const char *p, size_t i, size_t n) {
+#if defined(__x86_64__) && !defined(__chibicc__)
+  unsigned m;
+  __m128i v, l, d;
+  for (; i + 16 <= n; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    l = _mm_cmplt_epi8(_mm_xor_si128(l, _mm_set1_epi8(0x80)),
+                       _mm_set1_epi8(26 ^ 0x80));
+    d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    d = _mm_cmplt_epi8(_mm_xor_si128(d, _mm_set1_epi8(0x80)),
+                       _mm_set1_epi8(10 ^ 0x80));
+    m = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(l, d), _mm_cmpeq_epi8(v, _mm_set1_epi8('-'))));
+    if (m != 0xFFFF)
+      return i + __builtin_ctz(~m);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  uint64_t m;
+  uint8x16_t v, x;
+  for (; i + 16 <= n; i += 16) {
+    v = vld1q_u8((const uint8_t *)(p + i));
+    x = vorrq_u8(
+        vorrq_u8(vcltq_u8(vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)),
+                                   vdupq_n_u8('a')),
+                          vdupq_n_u8(26)),
+                 vcltq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(10))),
+        vceqq_u8(v, vdupq_n_u8('-')));
+    vst1_u8((uint8_t *)&m, vshrn_n_u16(vreinterpretq_u16_u8(vmvnq_u8(x)), 4));
+    if (m)
+      return i + (__builtin_ctzll(m) >> 2);
+  }
+#endif
+  return i;
+}
+
 /**
  * Parses HTTP request or response.
  *
@@ -96,7 +177,10 @@ void ResetHttpMessage(struct HttpMessage *r, int type) {
  *
  * This parser takes about 400 nanoseconds to parse a 403 byte Chrome
  * HTTP request under MODE=rel on a Core i9 which is about three cycles
- * per byte or a gigabyte per second of throughput per core.
+ * per byte or a gigabyte per second of throughput per core. The loops
+ * over uris, reason phrases, header names and header values skip ahead
+ * sixteen bytes at a time using SSE2 or NEON until something interesting
+ * turns up, at which point the byte-wise state machine takes over again.
  *
  * @param p needs to have at least `c` bytes available
  * @param n is how many bytes have been received off the network so far
@@ -141,9 +225,9 @@ int ParseHttpMessage(struct HttpMessage *r, const char *p, size_t n, size_t c) {
           ch = kToUpper[ch];
           r->method |= (uint64_t)ch << r->a;
           r->a += 8;
-          if (++r->i == n)
+          if (r->i + 1 == n)
             break;
-          ch = p[r->i] & 255;
+          ch = p[++r->i] & 255;
         }
         break;
       case kHttpStateUri:
@@ -164,8 +248,10 @@ int ParseHttpMessage(struct HttpMessage *r, const char *p, size_t n, size_t c) {
           } else if (ch < 0x20 || (0x7F <= ch && ch < 0xA0)) {
             return ebadmsg();
           }
-          if (++r->i == n)
+          if ((r->i = SkipHttpText(p, r->i + 1, n, 0x21)) == n) {
+            --r->i;  // since outer loop increments
             break;
+          }
           ch = p[r->i] & 255;
         }
         break;
@@ -205,9 +291,9 @@ int ParseHttpMessage(struct HttpMessage *r, const char *p, size_t n, size_t c) {
           } else {
             return ebadmsg();
           }
-          if (++r->i == n)
+          if (r->i + 1 == n)
             break;
-          ch = p[r->i] & 255;
+          ch = p[++r->i] & 255;
         }
         break;
       case kHttpStateMessage:
@@ -220,8 +306,10 @@ int ParseHttpMessage(struct HttpMessage *r, const char *p, size_t n, size_t c) {
           } else if (ch < 0x20 || (0x7F <= ch && ch < 0xA0)) {
             return ebadmsg();
           }
-          if (++r->i == n)
+          if ((r->i = SkipHttpText(p, r->i + 1, n, 0x20)) == n) {
+            --r->i;  // since outer loop increments
             break;
+          }
           ch = p[r->i] & 255;
         }
         break;
@@ -253,8 +341,10 @@ int ParseHttpMessage(struct HttpMessage *r, const char *p, size_t n, size_t c) {
           } else if (!kHttpToken[ch]) {
             return ebadmsg();
           }
-          if (++r->i == n)
+          if ((r->i = SkipHttpName(p, r->i + 1, n)) == n) {
+            --r->i;  // since outer loop increments
             break;
+          }
           ch = p[r->i] & 255;
         }
         break;
@@ -303,8 +393,10 @@ int ParseHttpMessage(struct HttpMessage *r, const char *p, size_t n, size_t c) {
           } else if ((ch < 0x20 && ch != '\t') || (0x7F <= ch && ch < 0xA0)) {
             return ebadmsg();
           }
-          if (++r->i == n)
+          if ((r->i = SkipHttpText(p, r->i + 1, n, 0x20)) == n) {
+            --r->i;  // since outer loop increments
             break;
+          }
           ch = p[r->i] & 255;
         }
         break;
@@ -20,6 +20,7 @@
 #include "libc/calls/calls.h"
 #include "libc/dce.h"
 #include "libc/errno.h"
+#include "libc/intrin/kprintf.h"
 #include "libc/intrin/maps.h"
 #include "libc/limits.h"
 #include "libc/literal.h"
@@ -34,6 +35,7 @@
 #include "libc/sysv/consts/prot.h"
 #include "libc/testlib/benchmark.h"
 #include "libc/testlib/testlib.h"
+#include "libc/thread/thread.h"
 #include "libc/x/xspawn.h"
 
 // this is also a good torture test for mmap
@@ -100,6 +102,43 @@ TEST(mmap, pageBeyondGone) {
   ASSERT_EQ(0, munmap(p, 1));
 }
 
+atomic_bool churning;
+
+void *ChurnMaps(void *arg) {
+  void *p;
+  while (!atomic_load(&churning))
+    pthread_yield_np();
+  while (atomic_load(&churning)) {
+    p = mmap(0, gransz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+             -1, 0);
+    if (p == MAP_FAILED || munmap(p, gransz))
+      __builtin_trap();
+  }
+  return 0;
+}
+
+TEST(kisdangerous, worksWhileOtherThreadsChangeMaps) {
+  char *p;
+  int i, n = 4;
+  pthread_t th[4];
+  p = mmap(0, gransz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1,
+           0);
+  ASSERT_NE(MAP_FAILED, p);
+  for (i = 0; i < n; ++i)
+    ASSERT_EQ(0, pthread_create(th + i, 0, ChurnMaps, 0));
+  atomic_store(&churning, true);
+  for (i = 0; i < 100000; ++i) {
+    ASSERT_FALSE(kisdangerous(p));
+    ASSERT_FALSE(kisdangerous(p + gransz - 1));
+    ASSERT_FALSE(kisdangerous(__executable_start));
+    ASSERT_TRUE(kisdangerous((char *)16));
+  }
+  atomic_store(&churning, false);
+  for (i = 0; i < n; ++i)
+    ASSERT_EQ(0, pthread_join(th[i], 0));
+  ASSERT_EQ(0, munmap(p, gransz));
+}
+
 TEST(mmap, fixedTaken) {
   char *p;
   ASSERT_NE(MAP_FAILED,
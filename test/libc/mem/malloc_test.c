@@ -17,6 +17,7 @@
 │ PERFORMANCE OF THIS SOFTWARE.                                                │
 ╚─────────────────────────────────────────────────────────────────────────────*/
 #include "libc/calls/calls.h"
+#include "libc/calls/struct/cpuset.h"
 #include "libc/calls/struct/stat.h"
 #include "libc/calls/struct/timespec.h"
 #include "libc/dce.h"
@@ -157,6 +158,70 @@ TEST(memalign, roundsUpAlignmentToTwoPower) {
   free(p);
 }
 
+#define HANDOFFS 10000
+
+void CountUsed(void *start, void *end, size_t used_bytes, void *arg) {
+  *(size_t *)arg += used_bytes;
+}
+
+size_t GetUsedBytes(void) {
+  size_t used = 0;
+  malloc_inspect_all(CountUsed, &used);
+  return used;
+}
+
+void *FreeHandoffs(void *arg) {
+  int **p = arg;
+  for (int i = 0; i < HANDOFFS; ++i) {
+    ASSERT_EQ(i, *p[i]);
+    free(p[i]);
+  }
+  return 0;
+}
+
+TEST(free, fromOtherThread_givesMemoryBackToOwner) {
+  pthread_t th;
+  size_t before;
+  int **p = gc(malloc(HANDOFFS * sizeof(int *)));
+  before = GetUsedBytes();
+  for (int i = 0; i < HANDOFFS; ++i) {
+    ASSERT_NE(NULL, (p[i] = malloc(sizeof(int) + i % 200)));
+    *p[i] = i;
+  }
+  ASSERT_EQ(0, pthread_create(&th, 0, FreeHandoffs, p));
+  ASSERT_EQ(0, pthread_join(th, 0));
+  ASSERT_LT(GetUsedBytes(), before + 65536);
+}
+
+TEST(free, twice_aborts) {
+  if (IsTiny())
+    return;  // tiny dlmalloc doesn't check
+  SPAWN(fork);
+  char *volatile p = malloc(16);
+  free(p);
+  free(p);
+  EXITS(44);
+}
+
+TEST(mallopt, hugepages_growsHeapInHugePageSegments) {
+  SPAWN(fork);
+  ASSERT_EQ(IsLinux(), mallopt(M_HUGEPAGES, 1));
+  if (IsLinux()) {
+    // mallinfo() only sees the arena of the cpu we're running on, so
+    // stay on one cpu in case we migrate between the checks below
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    ASSERT_SYS(0, 0, sched_setaffinity(0, sizeof(cpus), &cpus));
+    for (int i = 0; i < 256 && !mallinfo().hugepages; ++i)
+      for (int j = 0; j < 4096; ++j)
+        ASSERT_NE(NULL, malloc(64));
+    ASSERT_EQ(0, mallinfo().hugepages % (2 * 1024 * 1024));
+    ASSERT_NE(0, mallinfo().hugepages);
+  }
+  EXITS(0);
+}
+
 void *bulk[1024];
 
 void BulkFreeBenchSetup(void) {
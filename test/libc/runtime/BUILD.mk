@@ -70,6 +70,16 @@ o/$(MODE)/test/libc/runtime/ape_test.dbg:				\
 		$(APE_NO_MODIFY_SELF)
 	@$(APELINK)
 
+o/$(MODE)/test/libc/runtime/ftrace_ring_test.dbg:			\
+		$(TEST_LIBC_RUNTIME_DEPS)				\
+		o/$(MODE)/test/libc/runtime/ftrace_ring_test.o		\
+		o/$(MODE)/test/libc/runtime/runtime.pkg			\
+		o/$(MODE)/tool/decode/ftrace.zip.o			\
+		$(LIBC_TESTMAIN)					\
+		$(CRT)							\
+		$(APE_NO_MODIFY_SELF)
+	@$(APELINK)
+
 $(TEST_LIBC_RUNTIME_OBJS): private					\
 	DEFAULT_CCFLAGS +=						\
 		-fno-builtin
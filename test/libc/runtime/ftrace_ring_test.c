@@ -0,0 +1,208 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "ape/sections.internal.h"
+#include "libc/calls/calls.h"
+#include "libc/calls/struct/dirent.h"
+#include "libc/dce.h"
+#include "libc/errno.h"
+#include "libc/limits.h"
+#include "libc/mem/gc.h"
+#include "libc/runtime/ftrace.internal.h"
+#include "libc/runtime/runtime.h"
+#include "libc/runtime/symbols.internal.h"
+#include "libc/stdio/stdio.h"
+#include "libc/str/str.h"
+#include "libc/sysv/consts/o.h"
+#include "libc/sysv/consts/ok.h"
+#include "libc/testlib/subprocess.h"
+#include "libc/testlib/testlib.h"
+#include "libc/thread/thread.h"
+#include "libc/x/x.h"
+#include "libc/x/xasprintf.h"
+#ifdef FTRACE
+
+struct Call {
+  void (*func)(void);
+  int depth;
+};
+
+void SetUpOnce(void) {
+  testlib_enable_tmp_setup_teardown();
+}
+
+dontinline void Inner(void) {
+  __asm__ volatile("");
+}
+
+dontinline void Middle(void) {
+  Inner();
+  __asm__ volatile("");
+}
+
+dontinline void Outer(void) {
+  Middle();
+  Inner();
+  __asm__ volatile("");
+}
+
+void *OuterThread(void *arg) {
+  Outer();
+  return 0;
+}
+
+bool CanTrace(void) {
+  return !IsWindows() && GetSymbolTable();
+}
+
+void TraceOuter(void) {
+  __ftrace_ring = true;
+  ASSERT_NE(-1, ftrace_install());
+  ftrace_enabled(+1);
+  Outer();
+  ftrace_enabled(-1);
+}
+
+// returns which of our functions contains the traced address
+void (*GetFunc(uint64_t pc))(void) {
+  void (*f)(void) = 0;
+  void (*fs[])(void) = {Outer, Middle, Inner};
+  for (int i = 0; i < ARRAYLEN(fs); ++i)
+    if ((uintptr_t)fs[i] <= pc && (!f || (uintptr_t)fs[i] > (uintptr_t)f))
+      f = fs[i];
+  return f && pc - (uintptr_t)f < 64 ? f : 0;
+}
+
+// returns name of only ring file in current directory
+char *GetRingPath(void) {
+  DIR *d;
+  char *res = 0;
+  struct dirent *e;
+  ASSERT_NE(NULL, (d = opendir(".")));
+  while ((e = readdir(d))) {
+    if (endswith(e->d_name, ".ftrace")) {
+      EXPECT_EQ(NULL, res);
+      res = gc(xstrdup(e->d_name));
+    }
+  }
+  closedir(d);
+  return res;
+}
+
+char *Decode(const char *flag, const char *path) {
+  int ws, pid;
+  testlib_extract("/zip/ftrace", "decode", 0755);
+  ASSERT_NE(-1, (pid = fork()));
+  if (!pid) {
+    close(1);
+    open("decoded", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (flag) {
+      execv("decode", (char *const[]){"decode", (char *)flag, (char *)path, 0});
+    } else {
+      execv("decode", (char *const[]){"decode", (char *)path, 0});
+    }
+    _Exit(127);
+  }
+  ASSERT_NE(-1, wait(&ws));
+  ASSERT_EQ(0, ws);
+  return gc(xslurp("decoded", 0));
+}
+
+TEST(ftrace_ring, recordsCallsWithDepth) {
+  int n;
+  char *path, *s;
+  struct Call c[8];
+  const struct FtraceRing *r;
+  const struct FtraceEvent *e;
+  if (!CanTrace())
+    return;
+  SPAWN(fork);
+  TraceOuter();
+  EXITS(0);
+  ASSERT_NE(NULL, (path = GetRingPath()));
+  ASSERT_NE(NULL, (r = gc(xslurp(path, 0))));
+  ASSERT_EQ(FTRACE_RING_MAGIC, r->magic);
+  ASSERT_EQ(FTRACE_RING_ABI, r->abi);
+  ASSERT_EQ((uintptr_t)__executable_start, r->base);
+  ASSERT_LT(r->count, r->events);
+  e = (const struct FtraceEvent *)(r + 1);
+  n = 0;
+  for (uint64_t i = 0; i < r->count && n < ARRAYLEN(c); ++i) {
+    if ((c[n].func = GetFunc(r->base + e[i].addr))) {
+      c[n++].depth = e[i].depth;
+    }
+  }
+  ASSERT_EQ(4, n);
+  EXPECT_EQ(Outer, c[0].func);
+  EXPECT_EQ(Middle, c[1].func);
+  EXPECT_EQ(c[0].depth + 1, c[1].depth);
+  EXPECT_EQ(Inner, c[2].func);
+  EXPECT_EQ(c[0].depth + 2, c[2].depth);
+  EXPECT_EQ(Inner, c[3].func);
+  EXPECT_EQ(c[0].depth + 1, c[3].depth);
+  for (uint64_t i = 0; i < r->count; ++i) {
+    if (GetFunc(r->base + e[i].addr) == Inner) {
+      s = Decode(0, path);
+      EXPECT_NE(NULL, strstr(s, gc(xasprintf("%*s%#lx\n", e[i].depth * 2, "",
+                                             r->base + e[i].addr))));
+      s = Decode("-j", path);
+      EXPECT_TRUE(startswith(s, "{\"displayTimeUnit\":\"ns\""));
+      EXPECT_NE(NULL, strstr(s, gc(xasprintf("\"name\":\"%#lx\"",
+                                             r->base + e[i].addr))));
+      break;
+    }
+  }
+}
+
+TEST(ftrace_ring, existingFile_isNotOverwritten) {
+  char *s, path[PATH_MAX];
+  if (!CanTrace())
+    return;
+  SPAWN(fork);
+  snprintf(path, sizeof(path), "%s.%d.ftrace", program_invocation_short_name,
+           gettid());
+  ASSERT_NE(-1, xbarf(path, "hello", 5));
+  TraceOuter();
+  ASSERT_NE(NULL, (s = gc(xslurp(path, 0))));
+  ASSERT_STREQ("hello", s);
+  snprintf(path, sizeof(path), "%s.%d.1.ftrace", program_invocation_short_name,
+           gettid());
+  ASSERT_SYS(0, 0, access(path, F_OK));
+  EXITS(0);
+}
+
+TEST(ftrace_ring, threadExit_unmapsRing) {
+  char *s;
+  pthread_t th;
+  if (!CanTrace() || !IsLinux())
+    return;
+  SPAWN(fork);
+  __ftrace_ring = true;
+  ASSERT_NE(-1, ftrace_install());
+  ftrace_enabled(+1);
+  ASSERT_EQ(0, pthread_create(&th, 0, OuterThread, 0));
+  ASSERT_EQ(0, pthread_join(th, 0));
+  ftrace_enabled(-1);
+  // only the main thread's ring should still be mapped
+  ASSERT_NE(NULL, (s = gc(xslurp("/proc/self/maps", 0))));
+  ASSERT_NE(NULL, (s = strstr(s, ".ftrace\n")));
+  ASSERT_EQ(NULL, strstr(s + 1, ".ftrace\n"));
+  EXITS(0);
+}
+
+#endif /* FTRACE */
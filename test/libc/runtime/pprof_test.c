@@ -0,0 +1,142 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/calls/calls.h"
+#include "libc/calls/struct/timespec.h"
+#include "libc/dce.h"
+#include "libc/errno.h"
+#include "libc/mem/gc.h"
+#include "libc/runtime/runtime.h"
+#include "libc/runtime/symbols.internal.h"
+#include "libc/str/str.h"
+#include "libc/sysv/consts/clock.h"
+#include "libc/sysv/consts/o.h"
+#include "libc/testlib/subprocess.h"
+#include "libc/testlib/testlib.h"
+#include "libc/thread/thread.h"
+#include "libc/x/x.h"
+
+void SetUpOnce(void) {
+  testlib_enable_tmp_setup_teardown();
+}
+
+#define SPIN(NAME)                                                  \
+  dontinline long NAME(long x) {                                    \
+    int i;                                                          \
+    for (i = 0; i < 100000; ++i) {                                  \
+      x = x * 6364136223846793005 + 1442695040888963407;            \
+      __asm__ volatile("" : "+r"(x));                               \
+    }                                                               \
+    return x;                                                       \
+  }
+
+SPIN(SpinForProfiler)
+SPIN(SpinInParent)
+SPIN(SpinInChild)
+SPIN(SpinInLastThread)
+
+static void BurnCpuWith(long spin(long), int millis) {
+  long x = 0;
+  struct timespec t, deadline;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  deadline = timespec_add(t, timespec_frommillis(millis));
+  do {
+    x = spin(x);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  } while (timespec_cmp(t, deadline) < 0);
+}
+
+static void BurnCpu(int millis) {
+  BurnCpuWith(SpinForProfiler, millis);
+}
+
+static char *WriteFolded(void) {
+  int fd;
+  ASSERT_NE(-1, (fd = open("folded", O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+  ASSERT_SYS(0, 0, pprof_write(fd, PPROF_FOLDED));
+  ASSERT_SYS(0, 0, close(fd));
+  return xslurp("folded", 0);
+}
+
+TEST(pprof, test) {
+  char *s;
+  size_t n;
+  if (IsWindows() || IsMetal()) {
+    ASSERT_SYS(ENOTSUP, -1, pprof_start(100));
+    return;
+  }
+  ASSERT_SYS(EINVAL, -1, pprof_start(0));
+  ASSERT_SYS(0, 0, pprof_start(1000));
+  BurnCpu(300);
+  ASSERT_SYS(0, 0, pprof_stop());
+  ASSERT_SYS(0, 3, open("folded", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  ASSERT_SYS(0, 0, pprof_write(3, PPROF_FOLDED));
+  ASSERT_SYS(0, 0, close(3));
+  ASSERT_NE(NULL, (s = gc(xslurp("folded", &n))));
+  ASSERT_GT(n, 0);
+  ASSERT_EQ('\n', s[n - 1]);
+  if (GetSymbolTable()) {
+    ASSERT_NE(NULL, strstr(s, "SpinForProfiler "));
+  }
+  ASSERT_SYS(0, 3, open("pprof", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  ASSERT_SYS(0, 0, pprof_write(3, PPROF_PROTOBUF));
+  ASSERT_SYS(0, 0, close(3));
+  ASSERT_NE(NULL, (s = gc(xslurp("pprof", &n))));
+  ASSERT_GT(n, 0);
+  ASSERT_EQ(0x0a, s[0]);  // Profile.sample_type
+}
+
+void *BurnCpuThread(void *arg) {
+  BurnCpuWith(arg, 5);
+  return 0;
+}
+
+TEST(pprof, exitedThreads_giveBackTheirRings) {
+  pthread_t th;
+  if (IsWindows() || IsMetal() || !GetSymbolTable())
+    return;
+  SPAWN(fork);
+  ASSERT_SYS(0, 0, pprof_start(1000));
+  for (int i = 0; i < 150; ++i) {
+    ASSERT_EQ(0, pthread_create(&th, 0, BurnCpuThread, SpinForProfiler));
+    ASSERT_EQ(0, pthread_join(th, 0));
+  }
+  ASSERT_EQ(0, pthread_create(&th, 0, BurnCpuThread, SpinInLastThread));
+  ASSERT_EQ(0, pthread_join(th, 0));
+  ASSERT_SYS(0, 0, pprof_stop());
+  ASSERT_NE(NULL, strstr(gc(WriteFolded()), "SpinInLastThread "));
+  EXITS(0);
+}
+
+TEST(pprof, forkedChild_keepsSamplingIntoItsOwnProfile) {
+  char *s;
+  if (IsWindows() || IsMetal() || !GetSymbolTable())
+    return;
+  SPAWN(fork);
+  ASSERT_SYS(0, 0, pprof_start(1000));
+  BurnCpuWith(SpinInParent, 100);
+  SPAWN(fork);
+    BurnCpuWith(SpinInChild, 100);
+    ASSERT_SYS(0, 0, pprof_stop());
+    s = gc(WriteFolded());
+    ASSERT_NE(NULL, strstr(s, "SpinInChild "));
+    ASSERT_EQ(NULL, strstr(s, "SpinInParent "));
+  EXITS(0);
+  ASSERT_SYS(0, 0, pprof_stop());
+  EXITS(0);
+}
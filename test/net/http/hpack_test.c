@@ -0,0 +1,149 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/stdio/stdio.h"
+#include "libc/str/str.h"
+#include "libc/testlib/testlib.h"
+#include "net/http/http2.h"
+
+struct Hpack h;
+char got[1024];
+
+int Collect(void *arg, const char *k, size_t kn, const char *v, size_t vn) {
+  size_t n = strlen(got);
+  snprintf(got + n, sizeof(got) - n, "%.*s: %.*s\n", (int)kn, k, (int)vn, v);
+  return 0;
+}
+
+int Decode(const char *s, size_t n) {
+  got[0] = 0;
+  return DecodeHpack(&h, s, n, Collect, 0);
+}
+
+void SetUp(void) {
+  InitHpack(&h, kHpackTableSize);
+}
+
+void TearDown(void) {
+  DestroyHpack(&h);
+}
+
+TEST(DecodeHpack, rfc7541c3_requestsWithoutHuffman) {
+  static const char kC31[] = "\x82\x86\x84\x41\x0f\x77\x77\x77\x2e\x65\x78\x61"
+                             "\x6d\x70\x6c\x65\x2e\x63\x6f\x6d";
+  static const char kC32[] = "\x82\x86\x84\xbe\x58\x08\x6e\x6f\x2d\x63\x61\x63"
+                             "\x68\x65";
+  static const char kC33[] = "\x82\x87\x85\xbf\x40\x0a\x63\x75\x73\x74\x6f\x6d"
+                             "\x2d\x6b\x65\x79\x0c\x63\x75\x73\x74\x6f\x6d\x2d"
+                             "\x76\x61\x6c\x75\x65";
+  ASSERT_EQ(0, Decode(kC31, sizeof(kC31) - 1));
+  EXPECT_STREQ(":method: GET\n"
+               ":scheme: http\n"
+               ":path: /\n"
+               ":authority: www.example.com\n",
+               got);
+  EXPECT_EQ(57, h.size);
+  ASSERT_EQ(0, Decode(kC32, sizeof(kC32) - 1));
+  EXPECT_STREQ(":method: GET\n"
+               ":scheme: http\n"
+               ":path: /\n"
+               ":authority: www.example.com\n"
+               "cache-control: no-cache\n",
+               got);
+  EXPECT_EQ(110, h.size);
+  ASSERT_EQ(0, Decode(kC33, sizeof(kC33) - 1));
+  EXPECT_STREQ(":method: GET\n"
+               ":scheme: https\n"
+               ":path: /index.html\n"
+               ":authority: www.example.com\n"
+               "custom-key: custom-value\n",
+               got);
+  EXPECT_EQ(164, h.size);
+  EXPECT_EQ(3, h.n);
+}
+
+TEST(DecodeHpack, rfc7541c4_requestsWithHuffman) {
+  static const char kC41[] = "\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b"
+                             "\xa0\xab\x90\xf4\xff";
+  static const char kC42[] = "\x82\x86\x84\xbe\x58\x86\xa8\xeb\x10\x64\x9c\xbf";
+  static const char kC43[] = "\x82\x87\x85\xbf\x40\x88\x25\xa8\x49\xe9\x5b\xa9"
+                             "\x7d\x7f\x89\x25\xa8\x49\xe9\x5b\xb8\xe8\xb4\xbf";
+  ASSERT_EQ(0, Decode(kC41, sizeof(kC41) - 1));
+  EXPECT_STREQ(":method: GET\n"
+               ":scheme: http\n"
+               ":path: /\n"
+               ":authority: www.example.com\n",
+               got);
+  ASSERT_EQ(0, Decode(kC42, sizeof(kC42) - 1));
+  EXPECT_STREQ(":method: GET\n"
+               ":scheme: http\n"
+               ":path: /\n"
+               ":authority: www.example.com\n"
+               "cache-control: no-cache\n",
+               got);
+  ASSERT_EQ(0, Decode(kC43, sizeof(kC43) - 1));
+  EXPECT_STREQ(":method: GET\n"
+               ":scheme: https\n"
+               ":path: /index.html\n"
+               ":authority: www.example.com\n"
+               "custom-key: custom-value\n",
+               got);
+  EXPECT_EQ(164, h.size);
+}
+
+TEST(DecodeHpack, tableSizeUpdate_evictsOldestEntries) {
+  static const char kC31[] = "\x82\x86\x84\x41\x0f\x77\x77\x77\x2e\x65\x78\x61"
+                             "\x6d\x70\x6c\x65\x2e\x63\x6f\x6d";
+  ASSERT_EQ(0, Decode(kC31, sizeof(kC31) - 1));
+  EXPECT_EQ(1, h.n);
+  ASSERT_EQ(0, Decode("\x20", 1));
+  EXPECT_EQ(0, h.n);
+  EXPECT_EQ(0, h.size);
+  EXPECT_EQ(-1, Decode("\xbe", 1));
+}
+
+TEST(DecodeHpack, malformed_isCompressionError) {
+  EXPECT_EQ(-1, Decode("\x80", 1));              // index zero
+  EXPECT_EQ(-1, Decode("\xff\x80", 2));          // truncated integer
+  EXPECT_EQ(-1, Decode("\x3f\xe2\x1f", 3));      // size above settings
+  EXPECT_EQ(-1, Decode("\x04\x05/abc", 6));      // truncated string
+  EXPECT_EQ(-1, Decode("\x04\x81\x00", 3));      // padding not eos
+  EXPECT_EQ(-1, Decode("\x04\x82\x1f\xff", 4));  // padding too long
+  EXPECT_EQ(-1, Decode("\x04\x84\xff\xff\xff\xff", 6));  // eos symbol
+}
+
+TEST(EncodeHpack, staticMatch_isSingleIndex) {
+  char b[64];
+  EXPECT_EQ(1, EncodeHpack(b, ":status", 7, "200", 3) - b);
+  EXPECT_EQ(0x88, b[0] & 255);
+}
+
+TEST(EncodeHpack, roundTrip_lowercasesNames) {
+  char b[256], *p = b;
+  p = EncodeHpack(p, ":status", 7, "404", 3);
+  p = EncodeHpack(p, "Content-Type", 12, "text/html; charset=utf-8", 24);
+  p = EncodeHpack(p, "X-Powered-By", 12, "redbean", 7);
+  p = EncodeHpack(p, "Vary", 4, "", 0);
+  ASSERT_EQ(0, Decode(b, p - b));
+  EXPECT_STREQ(":status: 404\n"
+               "content-type: text/html; charset=utf-8\n"
+               "x-powered-by: redbean\n"
+               "vary: \n",
+               got);
+  EXPECT_EQ(0, h.n);
+}
@@ -22,6 +22,7 @@
 #include "libc/mem/gc.h"
 #include "libc/mem/mem.h"
 #include "libc/serialize.h"
+#include "libc/stdio/rand.h"
 #include "libc/str/str.h"
 #include "libc/testlib/ezbench.h"
 #include "libc/testlib/testlib.h"
@@ -451,6 +452,70 @@ Content-Length: 12\r\n\
   EXPECT_EQ(200, req->status);
 }
 
+TEST(ParseHttpMessage, testFragmented_resumesAtBoundary) {
+  static const char m[] = "GET /abc HTTP/1.1\r\nHost: x\r\n\r\n";
+  InitHttpMessage(req, kHttpRequest);
+  EXPECT_EQ(0, ParseHttpMessage(req, m, 8, sizeof(m) - 1));
+  EXPECT_EQ(sizeof(m) - 1,
+            ParseHttpMessage(req, m, sizeof(m) - 1, sizeof(m) - 1));
+  EXPECT_STREQ("/abc", gc(slice(m, req->uri)));
+  EXPECT_STREQ("x", gc(slice(m, req->headers[kHttpHost])));
+}
+
+static const char *const kFuzzSeeds[] = {
+    "GET /tool/net/redbean.png?a=b&cccccccccccccccc=d HTTP/1.1\r\n"
+    "Host: 10.10.10.124:8080\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36\r\n"
+    "X-Some-Rather-Long-Extension-Header:  \t1, 2,   3  \t \r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Encoding: br\r\n"
+    "\r\n",
+    "HTTP/1.1 404 Not Found Around Here Somewhere\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Set-Cookie: b=5aboacm0axrlzntx5wfec7r42; path=/; secure\n"
+    "\r\n",
+};
+
+static bool IsSameHttpMessage(const struct HttpMessage *a,
+                              const struct HttpMessage *b) {
+  struct HttpMessage x = *a, y = *b;
+  x.xheaders.p = y.xheaders.p = 0;
+  return !memcmp(&x, &y, sizeof(x)) &&
+         !memcmp(a->xheaders.p, b->xheaders.p,
+                 a->xheaders.n * sizeof(*a->xheaders.p));
+}
+
+// the vectorized loops only engage when sixteen bytes are available,
+// so feeding one byte at a time exercises the byte-wise state machine
+TEST(ParseHttpMessage, fuzz_vectorizedMatchesBytewise) {
+  int i, j, k, x, y;
+  size_t n, m;
+  char b[256];
+  struct HttpMessage r1, r2;
+  static const char kEvil[] = "\r\n\t :-_!#~(\177\200\237\240\377\1 aZ09/";
+  for (i = 0; i < 20000; ++i) {
+    k = rand() % ARRAYLEN(kFuzzSeeds);
+    n = strlen(kFuzzSeeds[k]);
+    memcpy(b, kFuzzSeeds[k], n);
+    for (j = rand() % 4; j--;) {
+      b[rand() % n] = kEvil[rand() % (sizeof(kEvil) - 1)];
+    }
+    InitHttpMessage(&r1, k ? kHttpResponse : kHttpRequest);
+    InitHttpMessage(&r2, k ? kHttpResponse : kHttpRequest);
+    x = ParseHttpMessage(&r1, b, n, sizeof(b));
+    for (m = 1; !(y = ParseHttpMessage(&r2, b, m, sizeof(b))) && m < n; ++m) {
+    }
+    if (x) {
+      ASSERT_EQ(x, y, "%`'.*s", n, b);
+      if (x > 0) {
+        ASSERT_EQ(true, IsSameHttpMessage(&r1, &r2), "%`'.*s", n, b);
+      }
+    }
+    DestroyHttpMessage(&r2);
+    DestroyHttpMessage(&r1);
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void DoTiniestHttpRequest(void) {
@@ -486,6 +551,26 @@ Accept-Language: en-US,en;q=0.9\r\n\
   CHECK_EQ(sizeof(m) - 1, ParseHttpMessage(req, m, sizeof(m) - 1, sizeof(m)));
 }
 
+void DoStandardChromeRequestBytewise(void) {
+  int rc;
+  size_t i;
+  static const char m[] = "\
+GET /tool/net/redbean.png HTTP/1.1\r\n\
+Host: 10.10.10.124:8080\r\n\
+Connection: keep-alive\r\n\
+User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/89.0.4389.90 Safari/537.36\r\n\
+DNT:  \t1   \r\n\
+Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n\
+Referer: http://10.10.10.124:8080/\r\n\
+Accept-Encoding: gzip, deflate\r\n\
+Accept-Language: en-US,en;q=0.9\r\n\
+\r\n";
+  ResetHttpMessage(req, kHttpRequest);
+  for (i = 1; !(rc = ParseHttpMessage(req, m, i, sizeof(m))); ++i) {
+  }
+  CHECK_EQ(sizeof(m) - 1, rc);
+}
+
 void DoUnstandardChromeRequest(void) {
   static const char m[] = "\
 GET /tool/net/redbean.png HTTP/1.1\r\n\
@@ -571,6 +656,7 @@ BENCH(ParseHttpMessage, bench) {
   EZBENCH2("DoTiniestHttpReque", donothing, DoTiniestHttpRequest());
   EZBENCH2("DoTinyHttpRequest", donothing, DoTinyHttpRequest());
   EZBENCH2("DoStandardChromeRe", donothing, DoStandardChromeRequest());
+  EZBENCH2("DoStandardChromeBW", donothing, DoStandardChromeRequestBytewise());
   EZBENCH2("DoUnstandardChrome", donothing, DoUnstandardChromeRequest());
   EZBENCH2("DoTiniestHttpRespo", donothing, DoTiniestHttpResponse());
   EZBENCH2("DoTinyHttpResponse", donothing, DoTinyHttpResponse());
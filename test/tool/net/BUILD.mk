@@ -45,6 +45,10 @@ TEST_TOOL_NET_DIRECTDEPS =					\
 	LIBC_THREAD						\
 	LIBC_THREAD						\
 	LIBC_X							\
+	NET_HTTP						\
+	NET_HTTPS						\
+	THIRD_PARTY_DOUBLECONVERSION				\
+	THIRD_PARTY_LUA						\
 	THIRD_PARTY_MBEDTLS					\
 	THIRD_PARTY_REGEX					\
 	THIRD_PARTY_SQLITE3
@@ -71,17 +75,45 @@ o/$(MODE)/test/tool/net/%.dbg:					\
 		$(APE_NO_MODIFY_SELF)
 	@$(APELINK)
 
+o/$(MODE)/test/tool/net/assetindex_test.dbg:			\
+		$(TEST_TOOL_NET_DEPS)				\
+		$(TEST_TOOL_NET_A)				\
+		o/$(MODE)/test/tool/net/assetindex_test.o	\
+		o/$(MODE)/tool/net/assetindex.o			\
+		$(TEST_TOOL_NET_A).pkg				\
+		$(LIBC_TESTMAIN)				\
+		$(CRT)						\
+		$(APE_NO_MODIFY_SELF)
+	@$(APELINK)
+
+o/$(MODE)/test/tool/net/ljson_test.dbg:				\
+		$(TEST_TOOL_NET_DEPS)				\
+		$(TEST_TOOL_NET_A)				\
+		o/$(MODE)/test/tool/net/ljson_test.o		\
+		o/$(MODE)/tool/net/ljson.o			\
+		$(TEST_TOOL_NET_A).pkg				\
+		$(LIBC_TESTMAIN)				\
+		$(CRT)						\
+		$(APE_NO_MODIFY_SELF)
+	@$(APELINK)
+
 .PRECIOUS: o/$(MODE)/test/tool/net/redbean-tester
 o/$(MODE)/test/tool/net/redbean-tester.dbg:			\
 		$(TOOL_NET_DEPS)				\
 		o/$(MODE)/tool/net/redbean.o			\
 		$(TOOL_NET_REDBEAN_LUA_MODULES)			\
 		o/$(MODE)/tool/net/demo/seekable.txt.zip.o	\
+		o/$(MODE)/test/tool/net/zstd.txt.zip.o		\
 		o/$(MODE)/tool/net/net.pkg			\
 		$(CRT)						\
 		$(APE_NO_MODIFY_SELF)
 	@$(APELINK)
 
+o/$(MODE)/test/tool/net/zstd.txt.zip.o: private		\
+		ZIPOBJ_FLAGS +=					\
+			-B					\
+			-z
+
 o/$(MODE)/test/tool/net/redbean_test.runs:			\
 		private .PLEDGE = stdio rpath wpath cpath fattr proc inet
 
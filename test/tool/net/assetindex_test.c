@@ -0,0 +1,176 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "tool/net/assetindex.h"
+#include "libc/macros.h"
+#include "libc/mem/gc.h"
+#include "libc/mem/mem.h"
+#include "libc/stdio/stdio.h"
+#include "libc/str/str.h"
+#include "libc/testlib/ezbench.h"
+#include "libc/testlib/testlib.h"
+#include "libc/x/x.h"
+#include "libc/x/xasprintf.h"
+
+#define N 50000
+
+char **names;
+struct AssetIndex idx;
+
+// what redbean used to do, kept around for benchmarking
+struct OldAssets {
+  uint32_t n;
+  struct OldAsset {
+    uint32_t hash;
+    const char *name;
+  } *p;
+} old;
+
+static unsigned OldHash(const void *p, unsigned long n) {
+  unsigned h, i;
+  for (h = i = 0; i < n; i++) {
+    h += ((unsigned char *)p)[i];
+    h *= 0x9e3779b1;
+  }
+  return MAX(1, h);
+}
+
+static void OldInsert(const char *s) {
+  uint32_t i, step, hash;
+  hash = OldHash(s, strlen(s));
+  step = 0;
+  do {
+    i = (hash + ((step * (step + 1)) >> 1)) & (old.n - 1);
+    ++step;
+  } while (old.p[i].hash);
+  old.p[i].hash = hash;
+  old.p[i].name = s;
+}
+
+static struct OldAsset *OldFind(const char *s, size_t n) {
+  uint32_t i, step, hash;
+  hash = OldHash(s, n);
+  for (step = 0;; ++step) {
+    i = (hash + ((step * (step + 1)) >> 1)) & (old.n - 1);
+    if (!old.p[i].hash)
+      return 0;
+    if (hash == old.p[i].hash && n == strlen(old.p[i].name) &&
+        !memcmp(s, old.p[i].name, n)) {
+      return old.p + i;
+    }
+  }
+}
+
+void SetUpOnce(void) {
+  int i;
+  names = xcalloc(N, sizeof(*names));
+  for (i = 0; i < N; ++i) {
+    switch (i % 3) {
+      case 0:
+        names[i] = xasprintf("usr/share/zoneinfo/%d", i);
+        break;
+      case 1:
+        names[i] = xasprintf("static/img/%x.png", i);
+        break;
+      default:
+        names[i] = xasprintf("%d.lua", i);
+        break;
+    }
+  }
+  InitAssetIndex(&idx, N);
+  for (i = 0; i < N; ++i) {
+    InsertAssetIndex(&idx, names[i], strlen(names[i]));
+  }
+  old.n = 262144;
+  old.p = xcalloc(old.n, sizeof(*old.p));
+  for (i = 0; i < N; ++i) {
+    OldInsert(names[i]);
+  }
+}
+
+TEST(InitAssetIndex, sizesToPowerOfTwo) {
+  struct AssetIndex x;
+  InitAssetIndex(&x, 0);
+  EXPECT_EQ(16, x.n);
+  DestroyAssetIndex(&x);
+  InitAssetIndex(&x, 100);
+  EXPECT_EQ(256, x.n);
+  DestroyAssetIndex(&x);
+}
+
+TEST(InsertAssetIndex, duplicate_firstOneWins) {
+  long i;
+  struct AssetIndex x;
+  char first[] = "idx.html", second[] = "idx.html";
+  InitAssetIndex(&x, 2);
+  EXPECT_NE(-1, (i = InsertAssetIndex(&x, first, 8)));
+  EXPECT_EQ(-1, InsertAssetIndex(&x, second, 8));
+  EXPECT_NE(-1, InsertAssetIndex(&x, "idx.htm", 7));
+  EXPECT_EQ(2, x.used);
+  EXPECT_EQ(i, FindAssetIndex(&x, second, 8));
+  EXPECT_EQ(first, x.keys[i].name);
+  DestroyAssetIndex(&x);
+}
+
+TEST(FindAssetIndex, empty) {
+  struct AssetIndex x = {0};
+  EXPECT_EQ(-1, FindAssetIndex(&x, "", 0));
+  InitAssetIndex(&x, 0);
+  EXPECT_EQ(-1, FindAssetIndex(&x, "", 0));
+  EXPECT_NE(-1, InsertAssetIndex(&x, "", 0));
+  EXPECT_NE(-1, FindAssetIndex(&x, "", 0));
+  DestroyAssetIndex(&x);
+}
+
+TEST(FindAssetIndex, present) {
+  long i, j;
+  for (i = 0; i < N; ++i) {
+    ASSERT_NE(-1, (j = FindAssetIndex(&idx, names[i], strlen(names[i]))));
+    ASSERT_EQ(names[i], idx.keys[j].name);
+  }
+  EXPECT_EQ(N, idx.used);
+}
+
+TEST(FindAssetIndex, absent) {
+  int i;
+  char buf[64];
+  for (i = 0; i < N; ++i) {
+    snprintf(buf, sizeof(buf), "usr/share/zoneinfo/%d", N + i);
+    ASSERT_EQ(-1, FindAssetIndex(&idx, buf, strlen(buf)));
+    snprintf(buf, sizeof(buf), "%d.luA", i);
+    ASSERT_EQ(-1, FindAssetIndex(&idx, buf, strlen(buf)));
+  }
+}
+
+TEST(FindAssetIndex, prefixOfLongerName_isntFound) {
+  EXPECT_EQ(-1, FindAssetIndex(&idx, "usr/share/zoneinfo/", 19));
+  EXPECT_EQ(-1, FindAssetIndex(&idx, "static/img/", 11));
+}
+
+BENCH(FindAssetIndex, bench) {
+  EZBENCH2("old hit", donothing, OldFind("static/img/1.png", 16));
+  EZBENCH2("new hit", donothing,
+           FindAssetIndex(&idx, "static/img/1.png", 16));
+  EZBENCH2("old miss", donothing, OldFind("static/img/z.png", 16));
+  EZBENCH2("new miss", donothing,
+           FindAssetIndex(&idx, "static/img/z.png", 16));
+  EZBENCH2("old zoneinfo", donothing,
+           OldFind("usr/share/zoneinfo/49998", 24));
+  EZBENCH2("new zoneinfo", donothing,
+           FindAssetIndex(&idx, "usr/share/zoneinfo/49998", 24));
+}
@@ -101,6 +101,19 @@ x.a = 'a'
 x.b = 'b'
 assert(EncodeJson(x) == '{"a":"a","b":"b","c":"c"}')
 
+-- stream is ignored outside request handling
+assert(EncodeJson(x, {stream=true}) == '{"a":"a","b":"b","c":"c"}')
+assert(EncodeJson({yo=2, bye={1, 2}}, {stream=true, pretty=true}) ==
+       EncodeJson({yo=2, bye={1, 2}}, {pretty=true}))
+x = {}
+for i = 1, 20000 do
+   x[i] = {i, tostring(i)}
+end
+assert(EncodeJson(x, {stream=true}) == EncodeJson(x))
+assert(coroutine.wrap(function()
+   return EncodeJson(x, {stream=true})
+end)() == EncodeJson(x))
+
 assert(EncodeJson(0, {maxdepth=1}))
 val, err = EncodeJson(0, {maxdepth=0})
 assert(val == nil)
@@ -0,0 +1,334 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "tool/net/ljson.h"
+#include "libc/macros.h"
+#include "libc/stdio/rand.h"
+#include "libc/stdio/stdio.h"
+#include "libc/str/str.h"
+#include "libc/testlib/ezbench.h"
+#include "libc/testlib/testlib.h"
+#include "third_party/lua/lauxlib.h"
+#include "third_party/lua/lua.h"
+
+lua_State *L;
+bool allowbad;
+size_t jsonlen;
+char json[300000];
+
+// the first kValidStrings entries are accepted by the decoder
+static const char *const kStrings[] = {
+    "hello",
+    " ",
+    "\\\"",
+    "\\\\",
+    "\\/",
+    "\\b\\f",
+    "\\n\\r\\t",
+    "\\u00e9",
+    "\\ud83d\\ude00",
+    "\\uD800",
+    "\\x41",
+    "é",
+    "𐌰",
+    "€",
+    "\x7f",
+    "{[:,]}",
+    "\\u12",
+    "\xed\xa0\xbd\xed\xb8\x80",
+    "\\e",
+    "\x01",
+    "\xc0\x80",
+    "\xed\xa0\x80",
+    "\xf4\x90\x80\x80",
+    "\xff",
+};
+#define kValidStrings 16
+
+// the first kValidNumbers entries are accepted by the decoder
+static const char *const kNumbers[] = {
+    "0",       "-0",      "123",     "-9223372036854775808",
+    "9223372036854775808", "3.14",  "1e6",     "-2.5E-3",
+    "0.5e+10", "1.",      "01",      "-",
+    "1e",      "42x",
+};
+#define kValidNumbers 9
+
+static void Put(const char *s) {
+  size_t n = strlen(s);
+  if (jsonlen + n < sizeof(json)) {
+    memcpy(json + jsonlen, s, n);
+    jsonlen += n;
+  }
+}
+
+static void PutSpace(void) {
+  switch (rand() % 8) {
+    case 0:
+      Put(" ");
+      break;
+    case 1:
+      Put("\n  ");
+      break;
+    case 2:
+      Put("\r\n\t");
+      break;
+    default:
+      break;
+  }
+}
+
+static void PutString(void) {
+  int i, n;
+  Put("\"");
+  for (n = rand() % 6, i = 0; i < n; ++i) {
+    // mostly plain text, sometimes escapes, rarely something bad
+    if (rand() % 4) {
+      Put(kStrings[rand() % 2]);
+    } else if (allowbad && !(rand() % 16)) {
+      Put(kStrings[rand() % ARRAYLEN(kStrings)]);
+    } else {
+      Put(kStrings[rand() % kValidStrings]);
+    }
+  }
+  Put("\"");
+}
+
+static void PutValue(int depth) {
+  int i, n;
+  switch (rand() % (depth ? 9 : 6)) {
+    case 0:
+    case 1:
+      PutString();
+      break;
+    case 2:
+      if (allowbad && !(rand() % 16)) {
+        Put(kNumbers[rand() % ARRAYLEN(kNumbers)]);
+      } else {
+        Put(kNumbers[rand() % kValidNumbers]);
+      }
+      break;
+    case 3:
+      Put("true");
+      break;
+    case 4:
+      Put("false");
+      break;
+    case 5:
+      Put("null");
+      break;
+    case 6:
+    case 7:
+      Put("[");
+      for (n = rand() % 7, i = 0; i < n; ++i) {
+        if (i)
+          Put(",");
+        PutSpace();
+        PutValue(depth - 1);
+        PutSpace();
+      }
+      Put("]");
+      break;
+    case 8:
+      Put("{");
+      for (n = rand() % 7, i = 0; i < n; ++i) {
+        if (i)
+          Put(",");
+        PutSpace();
+        PutString();
+        PutSpace();
+        Put(":");
+        PutSpace();
+        PutValue(depth - 1);
+      }
+      PutSpace();
+      Put("}");
+      break;
+    default:
+      __builtin_unreachable();
+  }
+}
+
+static void PutDocument(void) {
+  int i, n;
+  jsonlen = 0;
+  allowbad = !(rand() % 4);
+  PutSpace();
+  Put("[");
+  for (n = 4 + rand() % 16, i = 0; i < n; ++i) {
+    if (i)
+      Put(", ");
+    PutValue(3);
+  }
+  Put("]");
+  PutSpace();
+}
+
+static void Mutate(void) {
+  size_t i;
+  static const char kPunct[] = "{}[]:,\"\\ 0n";
+  if (!jsonlen)
+    return;
+  i = rand() % jsonlen;
+  switch (rand() % 3) {
+    case 0:
+      json[i] = kPunct[rand() % (sizeof(kPunct) - 1)];
+      break;
+    case 1:
+      memmove(json + i, json + i + 1, jsonlen - i - 1);
+      --jsonlen;
+      break;
+    case 2:
+      jsonlen = i;
+      break;
+    default:
+      __builtin_unreachable();
+  }
+}
+
+static bool IsSameLuaValue(int a, int b) {
+  bool ok;
+  int n, m;
+  a = lua_absindex(L, a);
+  b = lua_absindex(L, b);
+  if (lua_type(L, a) != lua_type(L, b))
+    return false;
+  if (lua_type(L, a) == LUA_TNUMBER &&
+      lua_isinteger(L, a) != lua_isinteger(L, b))
+    return false;
+  if (lua_type(L, a) != LUA_TTABLE)
+    return lua_rawequal(L, a, b);
+  for (ok = true, n = 0, lua_pushnil(L); lua_next(L, a);) {
+    ++n;
+    lua_pushvalue(L, -2);
+    lua_rawget(L, b);
+    ok = ok && IsSameLuaValue(-1, -2);
+    lua_pop(L, 2);
+  }
+  for (m = 0, lua_pushnil(L); lua_next(L, b);) {
+    ++m;
+    lua_pop(L, 1);
+  }
+  return ok && n == m;
+}
+
+static void CheckParity(const char *p, size_t n) {
+  int top;
+  struct DecodeJson a, b;
+  top = lua_gettop(L);
+  a = DecodeJson(L, p, n);
+  b = DecodeJsonBytewise(L, p, n);
+  ASSERT_EQ(b.rc, a.rc, "%`'.*s", n, p);
+  if (a.rc == -1) {
+    ASSERT_STREQ(b.p, a.p);
+  } else if (a.rc == 1) {
+    ASSERT_EQ(b.p - p, a.p - p, "%`'.*s", n, p);
+    ASSERT_EQ(true, IsSameLuaValue(-2, -1), "%`'.*s", n, p);
+  }
+  lua_settop(L, top);
+}
+
+void SetUp(void) {
+  L = luaL_newstate();
+}
+
+void TearDown(void) {
+  lua_close(L);
+}
+
+TEST(DecodeJson, largeDocument_usesIndexAndMatches) {
+  int top;
+  struct DecodeJson r;
+  static const char kDoc[] =
+      "  [{\"id\": 1, \"name\": \"kitten\", \"tags\": [\"a\", \"b\"]},\n"
+      "   {\"id\": 2, \"name\": \"h\\u00e9llo 𐌰\", \"tags\": []},\n"
+      "   {\"id\": 3, \"score\": 3.14, \"ok\": true, \"none\": null}] junk";
+  top = lua_gettop(L);
+  r = DecodeJson(L, kDoc, strlen(kDoc));
+  ASSERT_EQ(1, r.rc);
+  ASSERT_STREQ(" junk", r.p);
+  ASSERT_EQ(3, lua_rawlen(L, -1));
+  lua_rawgeti(L, -1, 2);
+  lua_getfield(L, -1, "name");
+  ASSERT_STREQ("héllo 𐌰", lua_tostring(L, -1));
+  lua_getfield(L, -2, "tags");
+  lua_rawgeti(L, -1, 0);
+  ASSERT_EQ(false, lua_toboolean(L, -1));
+  ASSERT_EQ(LUA_TBOOLEAN, lua_type(L, -1));
+  lua_settop(L, top);
+  CheckParity(kDoc, strlen(kDoc));
+}
+
+TEST(DecodeJson, depthLimit_matchesBytewise) {
+  int i, d;
+  for (d = 62; d <= 66; ++d) {
+    jsonlen = 0;
+    for (i = 0; i < d; ++i)
+      Put("{\"k\":");
+    Put("0");
+    for (i = 0; i < d; ++i)
+      Put("}");
+    Put("                                                                ");
+    CheckParity(json, jsonlen);
+  }
+}
+
+TEST(DecodeJson, escapesAcrossBlocks_matchesBytewise) {
+  int i, j;
+  for (i = 0; i < 140; ++i) {
+    jsonlen = 0;
+    Put("[\"");
+    for (j = 0; j < i; ++j)
+      Put(j % 7 ? "x" : "\\\\");
+    Put("\\\"\", \"}\", 1]");
+    Put("                                                                ");
+    Put("                                                                ");
+    CheckParity(json, jsonlen);
+  }
+}
+
+TEST(DecodeJson, fuzz_matchesBytewise) {
+  int i, j;
+  for (i = 0; i < 20000; ++i) {
+    PutDocument();
+    for (j = rand() % 4 ? 0 : 1 + rand() % 2; j; --j)
+      Mutate();
+    CheckParity(json, jsonlen);
+  }
+}
+
+BENCH(DecodeJson, bench) {
+  int i;
+  char s[256];
+  jsonlen = 0;
+  Put("[");
+  for (i = 0; jsonlen < 200000; ++i) {
+    snprintf(s, sizeof(s),
+             "%s{\"id\": %d, \"name\": \"user %d\", \"email\": "
+             "\"user%d@example.com\", \"score\": %d.%02d, \"active\": %s, "
+             "\"tags\": [\"alpha\", \"beta\", \"gamma\"]}\n",
+             i ? "," : "", i, i, i, i % 1000, i % 100,
+             i & 1 ? "true" : "false");
+    Put(s);
+  }
+  Put("]");
+  EZBENCH2("DecodeJson 200kb", donothing,
+           (DecodeJson(L, json, jsonlen), lua_settop(L, 0)));
+  EZBENCH2("DecodeJsonBytewise 200kb", donothing,
+           (DecodeJsonBytewise(L, json, jsonlen), lua_settop(L, 0)));
+}
@@ -48,6 +48,35 @@ p,e = re.search("notfound", "fanatics have their dreams wherewith they weave")
 assert(not p)
 assert(e:errno() == re.NOMATCH)
 
+-- posix wants the longest match at the leftmost position
+assert(re.search("a|ab|abc", "xabcd") == "abc")
+assert(re.search("x*(xy)?", "xxy") == "xxy")
+assert(re.search("(a|ab)(c|bcd)", "abcd") == "abcd")
+assert(re.search("[0-9]+", "v10.2") == "10")
+
+-- patterns without groups may be answered by the dfa
+assert(re.search("^/api/v[0-9]+/users/[0-9]+$", "/api/v2/users/123") == "/api/v2/users/123")
+assert(not re.search("^/api/v[0-9]+/users/[0-9]+$", "/api/v2/users/123/x"))
+assert(not re.search("^/api/v[0-9]+/users/[0-9]+$", "/static/api/v2/users/123"))
+assert(re.search([[\w+@\w+\.com]], "mail jart@foo.com now") == "jart@foo.com")
+assert(re.search([[[^]\]+]], [[\a]b]]) == "a")
+assert(re.search("ba+", "BAAAD", re.ICASE) == "BAAA")
+assert(re.search("^b.*$", "a\nbc\nd", re.NEWLINE) == "bc")
+assert(re.search("^b.*$", "b\nc") == "b\nc")
+assert(re.search("[^x]+", "ab\ncd", re.NEWLINE) == "ab")
+assert(not re.search("^abc", "abc", re.NOTBOL))
+assert(not re.search("abc$", "abc", re.NOTEOL))
+assert(re.search("^abc", "x\nabc", re.NEWLINE | re.NOTBOL) == "abc")
+assert(re.search("é+", "cafééé") == "ééé")
+assert(re.search("caf.", "café") == "café")
+
+-- re.search() caches what it compiles
+for i = 1,100 do
+   assert(re.search("x" .. i % 70 .. "y", "ax" .. i % 70 .. "yb") == "x" .. i % 70 .. "y")
+end
+p,e = re.search("[{", "[{")
+assert(e:errno() == re.EBRACK)
+
 ----------------------------------------------------------------------------------------------------
 -- BENCHMARKS
 
@@ -70,3 +99,33 @@ end
 --print("--", Benchmark(ReCompileSearch), "re.search()")
 --print("--", Benchmark(ReSearch), "re.Regex:search()")
 --print("--", Benchmark(Match), "string.match()")
+
+ROUTES = {
+   assert(re.compile[[^/api/v[0-9]+/users/[0-9]+$]]),
+   assert(re.compile[[^/api/v[0-9]+/orders/[0-9]+/items$]]),
+   assert(re.compile[[^/static/.*\.css$]]),
+   assert(re.compile[[^/static/.*\.js$]]),
+   assert(re.compile[[^/blog/[0-9]{4}/[0-9]{2}/[a-z0-9-]+$]]),
+}
+function Route()
+   local path = "/blog/2022/07/redbean-2-0-released"
+   for i = 1,#ROUTES do
+      if ROUTES[i]:search(path) then
+         return i
+      end
+   end
+end
+
+LOG = [[127.0.0.1 - - [10/Oct/2000:13:55:36 -0700] "GET /apache_pb.gif HTTP/1.0" 200 2326]]
+ERRORS = assert(re.compile[[" (404|500|502|503) [0-9]+$]])
+function LogErrors()
+   assert(not ERRORS:search(LOG))
+end
+
+function LogSearch()
+   assert(re.search([[HTTP/1\.[01]" [0-9]{3} ]], LOG))
+end
+
+--print("--", Benchmark(Route), "re.Regex:search() routing")
+--print("--", Benchmark(LogErrors), "re.Regex:search() log filter")
+--print("--", Benchmark(LogSearch), "re.search() log filter")
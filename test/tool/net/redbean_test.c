@@ -20,8 +20,10 @@
 #include "libc/calls/struct/sigset.h"
 #include "libc/dce.h"
 #include "libc/fmt/conv.h"
+#include "libc/macros.h"
 #include "libc/mem/gc.h"
 #include "libc/runtime/runtime.h"
+#include "libc/serialize.h"
 #include "libc/sock/goodsocket.internal.h"
 #include "libc/sock/sock.h"
 #include "libc/sock/struct/sockaddr.h"
@@ -38,6 +40,10 @@
 #include "libc/sysv/consts/tcp.h"
 #include "libc/testlib/testlib.h"
 #include "libc/x/x.h"
+#include "net/http/http2.h"
+#include "net/https/https.h"
+#include "third_party/mbedtls/ctr_drbg.h"
+#include "third_party/mbedtls/ssl.h"
 #include "third_party/regex/regex.h"
 #ifdef __x86_64__
 
@@ -194,6 +200,63 @@ TEST(redbean, testPipeline) {
   EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
 }
 
+TEST(redbean, testMultiplexPipeline) {
+  if (IsWindows())
+    return;
+  char portbuf[16];
+  int pid, pipefds[2];
+  sigset_t chldmask, savemask;
+  sigaddset(&chldmask, SIGCHLD);
+  EXPECT_NE(-1, sigprocmask(SIG_BLOCK, &chldmask, &savemask));
+  ASSERT_NE(-1, pipe(pipefds));
+  ASSERT_NE(-1, (pid = fork()));
+  if (!pid) {
+    setpgrp();
+    close(0);
+    open("/dev/null", O_RDWR);
+    close(pipefds[0]);
+    dup2(pipefds[1], 1);
+    sigprocmask(SIG_SETMASK, &savemask, NULL);
+    execv("bin/redbean-tester",
+          (char *const[]){"bin/redbean-tester", "-vvszXYp0", "-l127.0.0.1",
+                          __strace > 0 ? "--strace" : 0, 0});
+    _exit(127);
+  }
+  EXPECT_NE(-1, close(pipefds[1]));
+  EXPECT_NE(-1, read(pipefds[0], portbuf, sizeof(portbuf)));
+  port = atoi(portbuf);
+  EXPECT_TRUE(Matches("\
+HTTP/1.1 206 Partial Content\r\n\
+Content-Range: bytes 18-21/52\r\n\
+Content-Type: text/plain; charset=utf-8\r\n\
+Vary: Accept-Encoding\r\n\
+Last-Modified: .*\r\n\
+Accept-Ranges: bytes\r\n\
+X-Content-Type-Options: nosniff\r\n\
+Date: .*\r\n\
+Server: redbean/.*\r\n\
+Content-Length: 4\r\n\
+\r\n\
+J\n\
+K\n\
+HTTP/1.1 200 OK\r\n\
+Accept: \\*/\\*\r\n\
+Accept-Charset: utf-8,ISO-8859-1;q=0\\.7,\\*;q=0\\.5\r\n\
+Allow: GET, HEAD, POST, PUT, DELETE, OPTIONS\r\n\
+Date: .*\r\n\
+Server: redbean/.*\r\n\
+Content-Length: 0\r\n\
+\r\n",
+                      gc(SendHttpRequest("GET /seekable.txt HTTP/1.1\r\n"
+                                         "Range: bytes=18-21\r\n"
+                                         "\r\n"
+                                         "OPTIONS * HTTP/1.1\n\n"))));
+  EXPECT_EQ(0, close(pipefds[0]));
+  EXPECT_NE(-1, kill(pid, SIGTERM));
+  EXPECT_NE(-1, wait(0));
+  EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
+}
+
 TEST(redbean, testContentRange) {
   if (IsWindows())
     return;
@@ -293,4 +356,344 @@ Z\n",
   EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
 }
 
+// zstd.txt is linked into redbean-tester by zipobj -z, so it's stored
+// in the zip using compression method 93
+TEST(redbean, testZstdAsset) {
+  if (IsWindows())
+    return;
+  char *p, *b, want[20 * 44 + 1];
+  char portbuf[16];
+  int i, pid, pipefds[2];
+  sigset_t chldmask, savemask;
+  for (p = want, i = 0; i < 20; ++i)
+    p = stpcpy(p, "the quick brown fox jumps over the lazy dog\n");
+  sigaddset(&chldmask, SIGCHLD);
+  EXPECT_NE(-1, sigprocmask(SIG_BLOCK, &chldmask, &savemask));
+  ASSERT_NE(-1, pipe(pipefds));
+  ASSERT_NE(-1, (pid = fork()));
+  if (!pid) {
+    setpgrp();
+    close(0);
+    open("/dev/null", O_RDWR);
+    close(pipefds[0]);
+    dup2(pipefds[1], 1);
+    sigprocmask(SIG_SETMASK, &savemask, NULL);
+    execv("bin/redbean-tester",
+          (char *const[]){"bin/redbean-tester", "-vvszXp0", "-l127.0.0.1",
+                          __strace > 0 ? "--strace" : 0, 0});
+    _exit(127);
+  }
+  EXPECT_NE(-1, close(pipefds[1]));
+  EXPECT_NE(-1, read(pipefds[0], portbuf, sizeof(portbuf)));
+  port = atoi(portbuf);
+
+  // client that accepts zstd gets the frame from the zip as-is
+  p = gc(SendHttpRequest("GET /zstd.txt HTTP/1.0\r\n"
+                         "Accept-Encoding: gzip, zstd\r\n"
+                         "\r\n"));
+  EXPECT_NE(NULL, strstr(p, " 200 OK\r\n"));
+  EXPECT_NE(NULL, strstr(p, "\r\nContent-Encoding: zstd\r\n"));
+  ASSERT_NE(NULL, (b = strstr(p, "\r\n\r\n")));
+  EXPECT_EQ(0, memcmp(b + 4, "\x28\xb5\x2f\xfd", 4));  // zstd magic
+  ASSERT_NE(NULL, (b = strstr(p, "\r\nContent-Length: ")));
+  EXPECT_LT(atoi(b + 18), strlen(want));
+
+  // anyone else gets it decoded, which round trips the zipobj writer
+  p = gc(SendHttpRequest("GET /zstd.txt HTTP/1.0\r\n"
+                         "Accept-Encoding: gzip\r\n"
+                         "\r\n"));
+  EXPECT_NE(NULL, strstr(p, " 200 OK\r\n"));
+  EXPECT_EQ(NULL, strstr(p, "Content-Encoding"));
+  ASSERT_NE(NULL, (b = strstr(p, "\r\n\r\n")));
+  EXPECT_STREQ(want, b + 4);
+
+  EXPECT_EQ(0, close(pipefds[0]));
+  EXPECT_NE(-1, kill(pid, SIGTERM));
+  EXPECT_NE(-1, wait(0));
+  EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
+}
+
+struct TlsClient {
+  int fd;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config conf;
+  mbedtls_ctr_drbg_context rng;
+};
+
+struct Http2Response {
+  bool done;
+  char status[4];
+  size_t n;
+  char body[64];
+};
+
+static int TlsClientSend(void *ctx, const unsigned char *p, size_t n) {
+  return write(*(int *)ctx, p, n);
+}
+
+static int TlsClientRecv(void *ctx, unsigned char *p, size_t n) {
+  return read(*(int *)ctx, p, n);
+}
+
+// connects to redbean over tls offering alpn protocols
+static const char *ConnectTls(struct TlsClient *c, const char *alpn[]) {
+  struct sockaddr_in addr = {AF_INET, htons(port), {htonl(INADDR_LOOPBACK)}};
+  mbedtls_ssl_init(&c->ssl);
+  mbedtls_ssl_config_init(&c->conf);
+  InitializeRng(&c->rng);
+  EXPECT_EQ(0, mbedtls_ssl_config_defaults(&c->conf, MBEDTLS_SSL_IS_CLIENT,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT));
+  mbedtls_ssl_conf_authmode(&c->conf, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_rng(&c->conf, mbedtls_ctr_drbg_random, &c->rng);
+  EXPECT_EQ(0, mbedtls_ssl_conf_alpn_protocols(&c->conf, alpn));
+  EXPECT_EQ(0, mbedtls_ssl_setup(&c->ssl, &c->conf));
+  EXPECT_NE(-1, (c->fd = Socket()));
+  EXPECT_NE(-1, connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)));
+  mbedtls_ssl_set_bio(&c->ssl, &c->fd, TlsClientSend, TlsClientRecv, 0);
+  EXPECT_EQ(0, mbedtls_ssl_handshake(&c->ssl));
+  return mbedtls_ssl_get_alpn_protocol(&c->ssl);
+}
+
+static void CloseTls(struct TlsClient *c) {
+  close(c->fd);
+  mbedtls_ssl_free(&c->ssl);
+  mbedtls_ssl_config_free(&c->conf);
+  mbedtls_ctr_drbg_free(&c->rng);
+}
+
+static bool ReadTls(struct TlsClient *c, void *p, size_t n) {
+  int rc;
+  for (size_t i = 0; i < n; i += rc) {
+    if ((rc = mbedtls_ssl_read(&c->ssl, (char *)p + i, n - i)) <= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static char *AppendHttp2Frame(char *p, int type, int flags, uint32_t sid,
+                              const char *s, size_t n) {
+  *p++ = n >> 16;
+  *p++ = n >> 8;
+  *p++ = n;
+  *p++ = type;
+  *p++ = flags;
+  WRITE32BE(p, sid);
+  return mempcpy(p + 4, s, n);
+}
+
+static char *AppendHttp2Get(char *p, uint32_t sid, const char *path,
+                            const char *range) {
+  char b[256], *q = b;
+  q = EncodeHpack(q, ":method", 7, "GET", 3);
+  q = EncodeHpack(q, ":scheme", 7, "https", 5);
+  q = EncodeHpack(q, ":authority", 10, "127.0.0.1", 9);
+  q = EncodeHpack(q, ":path", 5, path, strlen(path));
+  if (range)
+    q = EncodeHpack(q, "range", 5, range, strlen(range));
+  return AppendHttp2Frame(p, kHttp2Headers,
+                          kHttp2FlagEndHeaders | kHttp2FlagEndStream, sid, b,
+                          q - b);
+}
+
+static int OnHttp2Status(void *arg, const char *k, size_t kn, const char *v,
+                         size_t vn) {
+  struct Http2Response *r = arg;
+  if (kn == 7 && !memcmp(k, ":status", 7) && vn == 3)
+    memcpy(r->status, v, 3);
+  return 0;
+}
+
+// reads frames until responses on streams 1 and 3 have both ended
+static bool ReadHttp2Responses(struct TlsClient *c, struct Http2Response r[2]) {
+  char *p;
+  size_t n;
+  uint32_t sid;
+  struct Hpack hpack;
+  struct Http2Response *s;
+  unsigned char h[kHttp2FrameHeader];
+  InitHpack(&hpack, kHpackTableSize);
+  while (!r[0].done || !r[1].done) {
+    if (!ReadTls(c, h, sizeof(h)))
+      break;
+    n = h[0] << 16 | h[1] << 8 | h[2];
+    sid = READ32BE(h + 5) & 0x7fffffff;
+    p = xmalloc(n + 1);
+    if (!ReadTls(c, p, n)) {
+      free(p);
+      break;
+    }
+    s = sid == 1 ? r + 0 : sid == 3 ? r + 1 : 0;
+    if (s && h[3] == kHttp2Headers) {
+      EXPECT_TRUE(h[4] & kHttp2FlagEndHeaders);
+      EXPECT_EQ(0, DecodeHpack(&hpack, p, n, OnHttp2Status, s));
+    } else if (s && h[3] == kHttp2Data) {
+      EXPECT_LE(s->n + n, sizeof(s->body));
+      memcpy(s->body + s->n, p, MIN(n, sizeof(s->body) - s->n));
+      s->n += n;
+    } else if (h[3] == kHttp2Goaway || h[3] == kHttp2RstStream) {
+      free(p);
+      break;
+    }
+    if (s && (h[3] == kHttp2Headers || h[3] == kHttp2Data) &&
+        (h[4] & kHttp2FlagEndStream))
+      s->done = true;
+    free(p);
+  }
+  DestroyHpack(&hpack);
+  return r[0].done && r[1].done;
+}
+
+TEST(redbean, testHttp2) {
+  if (IsWindows())
+    return;
+  char *p, buf[1024];
+  char portbuf[16];
+  int pid, pipefds[2];
+  struct TlsClient c;
+  sigset_t chldmask, savemask;
+  struct Http2Response r[2] = {0};
+  sigaddset(&chldmask, SIGCHLD);
+  EXPECT_NE(-1, sigprocmask(SIG_BLOCK, &chldmask, &savemask));
+  ASSERT_NE(-1, pipe(pipefds));
+  ASSERT_NE(-1, (pid = fork()));
+  if (!pid) {
+    setpgrp();
+    close(0);
+    open("/dev/null", O_RDWR);
+    close(pipefds[0]);
+    dup2(pipefds[1], 1);
+    sigprocmask(SIG_SETMASK, &savemask, NULL);
+    execv("bin/redbean-tester",
+          (char *const[]){"bin/redbean-tester", "-vvsz%2p0", "-l127.0.0.1",
+                          __strace > 0 ? "--strace" : 0, 0});
+    _exit(127);
+  }
+  EXPECT_NE(-1, close(pipefds[1]));
+  EXPECT_NE(-1, read(pipefds[0], portbuf, sizeof(portbuf)));
+  port = atoi(portbuf);
+  EXPECT_STREQ("h2", ConnectTls(&c, (const char *[]){"h2", "http/1.1", 0}));
+  p = stpcpy(buf, kHttp2Preface);
+  p = AppendHttp2Frame(p, kHttp2Settings, 0, 0, 0, 0);
+  p = AppendHttp2Get(p, 1, "/seekable.txt", 0);
+  p = AppendHttp2Get(p, 3, "/seekable.txt", "bytes=18-21");
+  EXPECT_EQ(p - buf, mbedtls_ssl_write(&c.ssl, buf, p - buf));
+  EXPECT_TRUE(ReadHttp2Responses(&c, r));
+  EXPECT_STREQ("200", r[0].status);
+  EXPECT_EQ(52, r[0].n);
+  EXPECT_EQ(0, memcmp(r[0].body, "A\nB\nC\n", 6));
+  EXPECT_STREQ("206", r[1].status);
+  EXPECT_EQ(4, r[1].n);
+  EXPECT_EQ(0, memcmp(r[1].body, "J\nK\n", 4));
+  CloseTls(&c);
+  EXPECT_EQ(0, close(pipefds[0]));
+  EXPECT_NE(-1, kill(pid, SIGTERM));
+  EXPECT_NE(-1, wait(0));
+  EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
+}
+
+// sends one big field into the hpack dynamic table and then references
+// it over and over, so a tiny header block decodes to a huge header list
+static char *AppendHttp2Bomb(char *p, uint32_t sid) {
+  size_t n;
+  char b[8192], *q = b;
+  q = EncodeHpack(q, ":method", 7, "GET", 3);
+  q = EncodeHpack(q, ":scheme", 7, "https", 5);
+  q = EncodeHpack(q, ":authority", 10, "127.0.0.1", 9);
+  q = EncodeHpack(q, ":path", 5, "/seekable.txt", 13);
+  *q++ = 0x40;  // literal with incremental indexing
+  *q++ = 6;
+  q = mempcpy(q, "x-bomb", 6);
+  *q++ = 0x7f;
+  for (n = 4000 - 127; n >= 128; n >>= 7)
+    *q++ = 0x80 | (n & 127);
+  *q++ = n;
+  q = (char *)memset(q, 'x', 4000) + 4000;
+  q = (char *)memset(q, 0x80 | 62, 100) + 100;  // indexed dynamic entry
+  return AppendHttp2Frame(p, kHttp2Headers,
+                          kHttp2FlagEndHeaders | kHttp2FlagEndStream, sid, b,
+                          q - b);
+}
+
+TEST(redbean, testHttp2_hpackBomb_gets431) {
+  if (IsWindows())
+    return;
+  char *p, buf[8192];
+  char portbuf[16];
+  int pid, pipefds[2];
+  struct TlsClient c;
+  sigset_t chldmask, savemask;
+  struct Http2Response r[2] = {0};
+  sigaddset(&chldmask, SIGCHLD);
+  EXPECT_NE(-1, sigprocmask(SIG_BLOCK, &chldmask, &savemask));
+  ASSERT_NE(-1, pipe(pipefds));
+  ASSERT_NE(-1, (pid = fork()));
+  if (!pid) {
+    setpgrp();
+    close(0);
+    open("/dev/null", O_RDWR);
+    close(pipefds[0]);
+    dup2(pipefds[1], 1);
+    sigprocmask(SIG_SETMASK, &savemask, NULL);
+    execv("bin/redbean-tester",
+          (char *const[]){"bin/redbean-tester", "-vvsz%2p0", "-l127.0.0.1",
+                          __strace > 0 ? "--strace" : 0, 0});
+    _exit(127);
+  }
+  EXPECT_NE(-1, close(pipefds[1]));
+  EXPECT_NE(-1, read(pipefds[0], portbuf, sizeof(portbuf)));
+  port = atoi(portbuf);
+  EXPECT_STREQ("h2", ConnectTls(&c, (const char *[]){"h2", "http/1.1", 0}));
+  p = stpcpy(buf, kHttp2Preface);
+  p = AppendHttp2Frame(p, kHttp2Settings, 0, 0, 0, 0);
+  p = AppendHttp2Bomb(p, 1);
+  p = AppendHttp2Get(p, 3, "/seekable.txt", 0);
+  EXPECT_EQ(p - buf, mbedtls_ssl_write(&c.ssl, buf, p - buf));
+  EXPECT_TRUE(ReadHttp2Responses(&c, r));
+  EXPECT_STREQ("431", r[0].status);
+  EXPECT_STREQ("200", r[1].status);
+  EXPECT_EQ(52, r[1].n);
+  CloseTls(&c);
+  EXPECT_EQ(0, close(pipefds[0]));
+  EXPECT_NE(-1, kill(pid, SIGTERM));
+  EXPECT_NE(-1, wait(0));
+  EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
+}
+
+TEST(redbean, testHttp2_isOptIn) {
+  if (IsWindows())
+    return;
+  char portbuf[16];
+  int pid, pipefds[2];
+  struct TlsClient c;
+  sigset_t chldmask, savemask;
+  sigaddset(&chldmask, SIGCHLD);
+  EXPECT_NE(-1, sigprocmask(SIG_BLOCK, &chldmask, &savemask));
+  ASSERT_NE(-1, pipe(pipefds));
+  ASSERT_NE(-1, (pid = fork()));
+  if (!pid) {
+    setpgrp();
+    close(0);
+    open("/dev/null", O_RDWR);
+    close(pipefds[0]);
+    dup2(pipefds[1], 1);
+    sigprocmask(SIG_SETMASK, &savemask, NULL);
+    execv("bin/redbean-tester",
+          (char *const[]){"bin/redbean-tester", "-vvsz%p0", "-l127.0.0.1",
+                          __strace > 0 ? "--strace" : 0, 0});
+    _exit(127);
+  }
+  EXPECT_NE(-1, close(pipefds[1]));
+  EXPECT_NE(-1, read(pipefds[0], portbuf, sizeof(portbuf)));
+  port = atoi(portbuf);
+  EXPECT_STREQ("http/1.1",
+               ConnectTls(&c, (const char *[]){"h2", "http/1.1", 0}));
+  CloseTls(&c);
+  EXPECT_EQ(0, close(pipefds[0]));
+  EXPECT_NE(-1, kill(pid, SIGTERM));
+  EXPECT_NE(-1, wait(0));
+  EXPECT_NE(-1, sigprocmask(SIG_SETMASK, &savemask, 0));
+}
+
 #endif /* __x86_64__ */
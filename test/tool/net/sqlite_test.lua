@@ -29,3 +29,46 @@ local st = assert(db:prepare("select * from foo"))
 assert(st:readonly() == true)
 st = assert(db:prepare("insert into foo (a) values (1)"))
 assert(st:readonly() == false)
+
+-- prepared statements are cached by their sql text
+db = sqlite3.open("file:/memdb2?vfs=memdb",
+  sqlite3.OPEN_URI + sqlite3.OPEN_READWRITE + sqlite3.OPEN_CREATE)
+assert(db:exec("create table bar(a)") == 0)
+local hits, misses, cached, capacity = db:cache_stats()
+assert(cached == 0 and capacity > 0)
+st = assert(db:prepare("select ?"))
+assert(st:bind_values(42) == 0)
+assert(st:step() == sqlite3.ROW)
+assert(st:get_value(0) == 42)
+assert(st:finalize() == 0)
+hits, misses, cached = db:cache_stats()
+assert(cached == 1)
+st = assert(db:prepare("select ?"))
+assert(select(1, db:cache_stats()) == hits + 1)
+assert(select(3, db:cache_stats()) == 0)  -- in use, so not shared
+assert(st:step() == sqlite3.ROW)
+assert(st:get_value(0) == nil)  -- bindings were cleared
+assert(st:finalize() == 0)
+assert(select(3, db:cache_stats()) == 1)
+
+-- schema changes invalidate the cache
+st = assert(db:prepare("select * from bar"))
+assert(st:columns() == 1)
+assert(st:finalize() == 0)
+assert(select(3, db:cache_stats()) == 2)
+assert(db:exec("alter table bar add column b") == 0)
+assert(select(3, db:cache_stats()) == 0)
+hits, misses = db:cache_stats()
+st = assert(db:prepare("select * from bar"))
+assert(select(2, db:cache_stats()) == misses + 1)
+assert(st:columns() == 2)
+assert(st:finalize() == 0)
+
+-- closing finalizes cached statements, otherwise sqlite3_close_v2()
+-- would leave a zombie connection keeping the in-memory database alive
+assert(select(3, db:cache_stats()) == 1)
+assert(db:close() == 0)
+db = sqlite3.open("file:/memdb2?vfs=memdb",
+  sqlite3.OPEN_URI + sqlite3.OPEN_READWRITE + sqlite3.OPEN_CREATE)
+assert(db:exec("create table bar(a)") == 0)
+assert(db:close() == 0)
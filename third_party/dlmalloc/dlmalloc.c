@@ -69,6 +69,7 @@
 
 #include "global.inc"
 #include "system.inc"
+#include "hugepages.inc"
 #include "hooks.inc"
 #include "debugging.inc"
 #include "indexing.inc"
@@ -100,7 +101,10 @@ static void* sys_alloc(mstate m, size_t nb) {
       return mem;
   }
 
-  asize = granularity_align(nb + SYS_ALLOC_PADDING);
+  if (mparams.hugepages)
+    asize = hugepage_align(nb + SYS_ALLOC_PADDING);
+  else
+    asize = granularity_align(nb + SYS_ALLOC_PADDING);
   if (asize <= nb)
     return 0; /* wraparound */
   if (m->footprint_limit != 0) {
@@ -109,6 +113,14 @@ static void* sys_alloc(mstate m, size_t nb) {
       return 0;
   }
 
+  if (tbase == CMFAIL && mparams.hugepages) { /* Try huge pages */
+    char* mp = hugepage_alloc(m, asize, &tsize);
+    if (mp != CMFAIL) {
+      tbase = mp;
+      mmap_flag = USE_MMAP_BIT | HUGEPAGE_BIT;
+    }
+  }
+
   if (tbase == CMFAIL) {  /* Try MMAP */
     char* mp = dlmalloc_requires_more_vespene_gas(asize);
     if (mp != CMFAIL) {
@@ -152,7 +164,7 @@ static void* sys_alloc(mstate m, size_t nb) {
         sp = (NO_SEGMENT_TRAVERSAL) ? 0 : sp->next;
       if (sp != 0 &&
           !is_extern_segment(sp) &&
-          (sp->sflags & USE_MMAP_BIT) == mmap_flag &&
+          (sp->sflags & (USE_MMAP_BIT | HUGEPAGE_BIT)) == mmap_flag &&
           segment_holds(sp, m->top)) { /* append */
         sp->size += tsize;
         init_top(m, m->top, m->topsize + tsize);
@@ -165,7 +177,7 @@ static void* sys_alloc(mstate m, size_t nb) {
           sp = (NO_SEGMENT_TRAVERSAL) ? 0 : sp->next;
         if (sp != 0 &&
             !is_extern_segment(sp) &&
-            (sp->sflags & USE_MMAP_BIT) == mmap_flag) {
+            (sp->sflags & (USE_MMAP_BIT | HUGEPAGE_BIT)) == mmap_flag) {
           char* oldbase = sp->base;
           sp->base = tbase;
           sp->size += tsize;
@@ -219,7 +231,12 @@ static size_t release_unused_segments(mstate m) {
         else {
           unlink_large_chunk(m, tp);
         }
-        if (CALL_MUNMAP(base, size) == 0) {
+        if (is_hugepage_segment(sp) && stash_hugepage_segment(m, base, size)) {
+          /* still resident, so neither released nor out of footprint */
+          sp = pred;
+          sp->next = next;
+        }
+        else if (CALL_MUNMAP(base, size) == 0) {
           released += size;
           m->footprint -= size;
           /* unlink obsoleted record */
@@ -250,10 +267,10 @@ static int sys_trim(mstate m, size_t pad) {
 
     if (m->topsize > pad) {
       /* Shrink top space in granularity-size units, keeping at least one */
-      size_t unit = mparams.granularity;
+      msegmentptr sp = segment_holding(m, (char*)m->top);
+      size_t unit = is_hugepage_segment(sp) ? HUGEPAGE_SIZE : mparams.granularity;
       size_t extra = ((m->topsize - pad + (unit - SIZE_T_ONE)) / unit -
                       SIZE_T_ONE) * unit;
-      msegmentptr sp = segment_holding(m, (char*)m->top);
 
       if (!is_extern_segment(sp)) {
         if (is_mmapped_segment(sp)) {
@@ -1318,3 +1335,9 @@ struct mallinfo (*dlmallinfo)(void) = dlmallinfo_single;
 #if MSPACES
 #include "third_party/dlmalloc/mspaces.inc"
 #endif /* MSPACES */
+
+/* ----------------------------- thread caches --------------------------- */
+
+#if ONLY_MSPACES
+#include "third_party/dlmalloc/tcache.inc"
+#endif /* ONLY_MSPACES */
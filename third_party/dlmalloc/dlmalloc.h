@@ -148,6 +148,13 @@ extern void* (*dlmemalign)(size_t, size_t);
   M_TRIM_THRESHOLD     -1   2*1024*1024   any   (-1U disables trimming)
   M_GRANULARITY        -2     page size   any power of 2 >= page size
   M_MMAP_THRESHOLD     -3      256*1024   any   (or 0 if no MMAP support)
+  M_HUGEPAGES          -4             0   0 or 1 (only supported on Linux)
+
+  Setting M_HUGEPAGES makes arenas grow by 2mb aligned segments that are
+  advised as MADV_HUGEPAGE, which are kept for reuse when they become
+  free rather than being unmapped. It may also be enabled by setting the
+  COSMOPOLITAN_HUGEPAGES=1 environment variable. Allocations above the
+  M_MMAP_THRESHOLD are still mapped directly.
 */
 int dlmallopt(int, int);
 
@@ -248,6 +255,9 @@ void dlmalloc_inspect_all(void (*handler)(void*, void*, size_t, void*),
   keepcost:  the maximum number of bytes that could ideally be released
                back to system via malloc_trim. ("ideally" means that
                it ignores page restrictions etc.)
+  hugepages: total bytes held in segments advised to use huge pages.
+               whether the kernel actually backs them with huge pages
+               depends on /sys/kernel/mm/transparent_hugepage.
 
   Because these fields are ints, but internal bookkeeping may
   be kept as longs, the reported values may wrap around zero and
@@ -529,6 +539,7 @@ void mspace_inspect_all(mspace msp,
 void dlmalloc_pre_fork(void) libcesque;
 void dlmalloc_post_fork_parent(void) libcesque;
 void dlmalloc_post_fork_child(void) libcesque;
+void dlmalloc_thread_exit(void) libcesque;
 
 void dlmalloc_abort(void) relegated wontreturn;
 
@@ -16,9 +16,11 @@
 │ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
 │ PERFORMANCE OF THIS SOFTWARE.                                                │
 ╚─────────────────────────────────────────────────────────────────────────────*/
+#include "third_party/dlmalloc/vespene.internal.h"
+#include "libc/calls/calls.h"
 #include "libc/dce.h"
 #include "libc/runtime/runtime.h"
-#include "third_party/dlmalloc/vespene.internal.h"
+#include "libc/sysv/consts/madv.h"
 
 /**
  * Acquires more system memory for dlmalloc.
@@ -27,3 +29,26 @@
 void *dlmalloc_requires_more_vespene_gas(size_t size) {
   return _mapanon(size);
 }
+
+/**
+ * Acquires more system memory for dlmalloc, aligned for huge pages.
+ *
+ * We map a little extra and unmap whatever falls outside the aligned
+ * region. The kernel is then asked to back it with transparent huge
+ * pages, which it may or may not do, depending on how it's configured.
+ *
+ * @param size must be a multiple of `align`
+ * @param align is huge page size, which must be a two power
+ * @return memory map address on success, or null w/ errno
+ */
+void *dlmalloc_requires_more_huge_vespene_gas(size_t size, size_t align) {
+  char *p, *q;
+  if (!(p = _mapanon(size + align)))
+    return 0;
+  q = (char *)(((uintptr_t)p + align - 1) & -align);
+  if (q > p)
+    munmap(p, q - p);
+  munmap(q + size, p + align - q);
+  madvise(q, size, MADV_HUGEPAGE);
+  return q;
+}
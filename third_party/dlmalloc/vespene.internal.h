@@ -3,6 +3,7 @@
 COSMOPOLITAN_C_START_
 
 void *dlmalloc_requires_more_vespene_gas(size_t);
+void *dlmalloc_requires_more_huge_vespene_gas(size_t, size_t);
 
 COSMOPOLITAN_C_END_
 #endif /* COSMOPOLITAN_THIRD_PARTY_DLMALLOC_VESPENE_INTERNAL_H_ */
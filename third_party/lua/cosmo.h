@@ -11,12 +11,14 @@ struct EncoderConfig {
   bool sorted;
   bool pretty;
   const char *indent;
+  int (*flush)(char **);  // may consume output between elements
 };
 
 struct Serializer {
   struct LuaVisited visited;
   struct EncoderConfig conf;
   const char *reason;
+  char **out;
   char *strbuf;
   size_t strbuflen;
   uintptr_t bsp;
@@ -37,6 +39,7 @@ void LuaPushUrlParams(lua_State *, struct UrlParams *);
 int SerializeObjectStart(char **, struct Serializer *, int, bool);
 int SerializeObjectEnd(char **, struct Serializer *, int, bool);
 int SerializeObjectIndent(char **, struct Serializer *, int);
+int SerializeFlush(char **, struct Serializer *);
 
 COSMOPOLITAN_C_END_
 #endif /* COSMOPOLITAN_THIRD_PARTY_LUA_COSMO_H_ */
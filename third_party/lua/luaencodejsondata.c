@@ -93,6 +93,7 @@ static int SerializeArray(lua_State *L, char **buf, struct Serializer *z,
     if (i > 1) RETURN_ON_ERROR(appendw(buf, ','));
     RETURN_ON_ERROR(Serialize(L, buf, -1, z, depth + 1));
     lua_pop(L, 1);
+    RETURN_ON_ERROR(SerializeFlush(buf, z));
   }
   RETURN_ON_ERROR(appendw(buf, ']'));
   return 0;
@@ -119,6 +120,7 @@ static int SerializeObject(lua_State *L, char **buf, struct Serializer *z,
       RETURN_ON_ERROR(appendw(buf, z->conf.pretty ? READ16LE(": ") : ':'));
       RETURN_ON_ERROR(Serialize(L, buf, -1, z, depth + 1));
       lua_pop(L, 1);
+      RETURN_ON_ERROR(SerializeFlush(buf, z));
     } else {
       z->reason = "json objects must only use string keys";
       goto OnError;
@@ -157,6 +159,7 @@ static int SerializeSorted(lua_State *L, char **buf, struct Serializer *z,
       }
     }
     RETURN_ON_ERROR(appends(buf, sl.p[i]));
+    RETURN_ON_ERROR(SerializeFlush(buf, z));
   }
   RETURN_ON_ERROR(SerializeObjectEnd(buf, z, depth, multi));
   FreeStrList(&sl);
@@ -269,6 +272,7 @@ int LuaEncodeJsonData(lua_State *L, char **buf, int idx,
     .reason = "out of memory", 
     .bsp = GetStackBottom() + 4096,
     .conf = conf,
+    .out = buf,
   };
   if (lua_checkstack(L, conf.maxdepth * 3 + LUA_MINSTACK)) {
     rc = Serialize(L, buf, idx, &z, 0);
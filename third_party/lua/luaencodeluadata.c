@@ -258,6 +258,7 @@ static int SerializeArray(lua_State *L, char **buf, struct Serializer *z,
     if (i > 1) RETURN_ON_ERROR(appendw(buf, READ16LE(", ")));
     RETURN_ON_ERROR(Serialize(L, buf, -1, z, depth + 1));
     lua_pop(L, 1);
+    RETURN_ON_ERROR(SerializeFlush(buf, z));
   }
   RETURN_ON_ERROR(appendw(buf, '}'));
   return 0;
@@ -296,6 +297,7 @@ static int SerializeObject(lua_State *L, char **buf, struct Serializer *z,
     }
     RETURN_ON_ERROR(Serialize(L, buf, -1, z, depth + 1));
     lua_pop(L, 1);
+    RETURN_ON_ERROR(SerializeFlush(buf, z));
   }
   RETURN_ON_ERROR(SerializeObjectEnd(buf, z, depth, multi));
   return 0;
@@ -338,6 +340,7 @@ static int SerializeSorted(lua_State *L, char **buf, struct Serializer *z,
       }
     }
     RETURN_ON_ERROR(appends(buf, sl.p[i]));
+    RETURN_ON_ERROR(SerializeFlush(buf, z));
   }
   RETURN_ON_ERROR(SerializeObjectEnd(buf, z, depth, multi));
   FreeStrList(&sl);
@@ -428,6 +431,7 @@ int LuaEncodeLuaData(lua_State *L, char **buf, int idx,
     .reason = "out of memory",
     .bsp = GetStackBottom() + 4096,
     .conf = conf,
+    .out = buf,
   };
   if (lua_checkstack(L, conf.maxdepth * 3 + LUA_MINSTACK)) {
     rc = Serialize(L, buf, idx, &z, 0);
@@ -66,3 +66,17 @@ int SerializeObjectEnd(char **buf, struct Serializer *z, int depth,
 OnError:
   return -1;
 }
+
+// gives the caller a chance to consume what's been encoded so far, so
+// huge values can be streamed without buffering the whole thing. it's
+// only called for the caller's buffer, and not the scratch buffers we
+// use to sort object entries.
+int SerializeFlush(char **buf, struct Serializer *z) {
+  if (!z->conf.flush || buf != z->out)
+    return 0;
+  if (z->conf.flush(buf) == -1) {
+    z->reason = "flush failed";
+    return -1;
+  }
+  return 0;
+}
@@ -58,6 +58,10 @@ o/$(MODE)/tool/decode/%.dbg:				\
 		$(APE_NO_MODIFY_SELF)
 	@$(APELINK)
 
+o/$(MODE)/tool/decode/ftrace.zip.o: private		\
+		ZIPOBJ_FLAGS +=				\
+			-B
+
 $(TOOL_DECODE_OBJS):					\
 		$(BUILD_FILES)				\
 		tool/decode/BUILD.mk
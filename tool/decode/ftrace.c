@@ -0,0 +1,254 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/calls/calls.h"
+#include "libc/calls/struct/stat.h"
+#include "libc/errno.h"
+#include "libc/macros.h"
+#include "libc/mem/alg.h"
+#include "libc/mem/mem.h"
+#include "libc/runtime/ftrace.internal.h"
+#include "libc/runtime/runtime.h"
+#include "libc/runtime/symbols.internal.h"
+#include "libc/stdio/stdio.h"
+#include "libc/str/str.h"
+#include "libc/sysv/consts/ex.h"
+#include "libc/sysv/consts/exit.h"
+#include "libc/sysv/consts/map.h"
+#include "libc/sysv/consts/o.h"
+#include "libc/sysv/consts/prot.h"
+#include "libc/x/x.h"
+#include "third_party/getopt/getopt.internal.h"
+
+/**
+ * @fileoverview Function Call Trace Decoder.
+ *
+ * Programs that were run with `--ftrace-ring` leave behind a file for
+ * each thread named `<prog>.<tid>.ftrace`. This tool merges them into
+ * the same format that `--ftrace` prints, or into the JSON format that
+ * chrome://tracing and ui.perfetto.dev are able to load, where calls
+ * are shown as spans lasting until a call is made at the same depth.
+ */
+
+struct Event {
+  uint64_t tsc;
+  uint32_t addr;
+  uint16_t depth;
+  uint16_t stack;
+  int file;
+  size_t seq;  // position in its file, oldest first
+};
+
+struct File {
+  int pid;
+  int tid;
+  uint64_t base;
+  uint64_t starttsc;
+};
+
+bool g_json;
+double g_ticks;
+size_t g_nevents;
+struct Event *g_events;
+struct File *g_files;
+struct SymbolTable *g_symtab;
+
+wontreturn void ShowUsage(int rc, FILE *f) {
+  fputs("Usage: ", f);
+  fputs(program_invocation_name, f);
+  fputs(" [-j] [-e EXE.dbg] FILE.ftrace...\n"
+        "  -j   print chrome trace json\n"
+        "  -e   elf binary with symbols\n",
+        f);
+  exit(rc);
+}
+
+void GetOpts(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "?hje:")) != -1) {
+    switch (opt) {
+      case 'j':
+        g_json = true;
+        break;
+      case 'e':
+        if (!(g_symtab = OpenSymbolTable(optarg))) {
+          perror(optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case '?':
+      case 'h':
+        ShowUsage(EXIT_SUCCESS, stdout);
+      default:
+        ShowUsage(EX_USAGE, stderr);
+    }
+  }
+  if (optind == argc) {
+    ShowUsage(EX_USAGE, stderr);
+  }
+}
+
+void LoadFile(const char *path, int file, double *span) {
+  int fd;
+  void *map;
+  struct stat st;
+  uint64_t i, n, c;
+  const struct FtraceRing *r;
+  const struct FtraceEvent *e;
+  if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  if (st.st_size < sizeof(*r) ||
+      (map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+          MAP_FAILED) {
+    fprintf(stderr, "%s: not an ftrace ring\n", path);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  r = map;
+  n = r->events;
+  if (r->magic != FTRACE_RING_MAGIC || r->abi != FTRACE_RING_ABI || !n ||
+      (n & (n - 1)) || sizeof(*r) + n * sizeof(*e) > st.st_size) {
+    fprintf(stderr, "%s: not an ftrace ring\n", path);
+    exit(EXIT_FAILURE);
+  }
+  g_files[file].pid = r->pid;
+  g_files[file].tid = r->tid;
+  g_files[file].base = r->base;
+  g_files[file].starttsc = r->starttsc;
+  if (r->nanos[1] - r->nanos[0] > *span) {
+    *span = r->nanos[1] - r->nanos[0];
+    g_ticks = (double)(r->tsc[1] - r->tsc[0]) / *span;
+  }
+  c = r->count;
+  e = (const struct FtraceEvent *)(r + 1);
+  g_events = xrealloc(g_events, (g_nevents + MIN(c, n)) * sizeof(*g_events));
+  for (i = c > n ? c - n : 0; i < c; ++i) {
+    if (!e[i & (n - 1)].tsc)
+      continue;
+    g_events[g_nevents].tsc = e[i & (n - 1)].tsc;
+    g_events[g_nevents].addr = e[i & (n - 1)].addr;
+    g_events[g_nevents].depth = e[i & (n - 1)].depth;
+    g_events[g_nevents].stack = e[i & (n - 1)].stack;
+    g_events[g_nevents].file = file;
+    g_events[g_nevents].seq = i;
+    ++g_nevents;
+  }
+  munmap(map, st.st_size);
+}
+
+int CompareEvents(const void *a, const void *b) {
+  const struct Event *x = a, *y = b;
+  if (x->file != y->file && g_json)
+    return x->file < y->file ? -1 : 1;
+  if (x->tsc != y->tsc)
+    return x->tsc < y->tsc ? -1 : 1;
+  if (g_files[x->file].tid != g_files[y->file].tid)
+    return g_files[x->file].tid < g_files[y->file].tid ? -1 : 1;
+  if (x->file != y->file)
+    return x->file < y->file ? -1 : 1;
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+const char *GetName(const struct Event *e) {
+  int i;
+  uint64_t pc;
+  static char buf[32];
+  pc = g_files[e->file].base + e->addr;
+  if (g_symtab && (i = __get_symbol(g_symtab, pc)) != -1)
+    return __get_symbol_name(g_symtab, i);
+  snprintf(buf, sizeof(buf), "%#lx", pc);
+  return buf;
+}
+
+// returns nanoseconds since program started
+uint64_t GetNanos(const struct Event *e) {
+  return (e->tsc - g_files[e->file].starttsc) / g_ticks;
+}
+
+void PrintText(void) {
+  size_t i;
+  struct Event *e;
+  for (i = 0; i < g_nevents; ++i) {
+    e = g_events + i;
+    printf("FUN %6d %6d %'18lu %'10ld %*s%s\n", g_files[e->file].pid,
+           g_files[e->file].tid, GetNanos(e), (long)e->stack * 16,
+           e->depth * 2, "", GetName(e));
+  }
+}
+
+void PrintSpan(const struct Event *e, const struct Event *end, bool *comma) {
+  const char *s;
+  printf("%s\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+         "\"name\":\"",
+         *comma ? "," : "", g_files[e->file].pid, g_files[e->file].tid,
+         GetNanos(e) / 1e3, (GetNanos(end) - GetNanos(e)) / 1e3);
+  for (s = GetName(e); *s; ++s) {
+    if (*s == '"' || *s == '\\')
+      putchar('\\');
+    putchar(*s);
+  }
+  fputs("\"}", stdout);
+  *comma = true;
+}
+
+// a call is assumed to have returned once another call at the same
+// depth or shallower is made, or when the thread's last call is made
+void PrintJson(void) {
+  size_t i, j, n;
+  bool comma = false;
+  struct Event *e, **stack;
+  stack = xcalloc(FTRACE_RING_NESTING + 1, sizeof(*stack));
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", stdout);
+  for (n = i = 0; i < g_nevents; ++i) {
+    e = g_events + i;
+    if (i && e->file != e[-1].file) {
+      for (j = n; j--;)
+        PrintSpan(stack[j], e - 1, &comma);
+      n = 0;
+    }
+    while (n && stack[n - 1]->depth >= e->depth)
+      PrintSpan(stack[--n], e, &comma);
+    if (n < FTRACE_RING_NESTING + 1)
+      stack[n++] = e;
+  }
+  for (j = n; j--;)
+    PrintSpan(stack[j], g_events + g_nevents - 1, &comma);
+  fputs("\n]}\n", stdout);
+  free(stack);
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+  double span = 0;
+  GetOpts(argc, argv);
+  g_ticks = 3;  // what kprintf("%T") assumes
+  g_files = xcalloc(argc - optind, sizeof(*g_files));
+  for (i = optind; i < argc; ++i)
+    LoadFile(argv[i], i - optind, &span);
+  if (span < 1e6)
+    g_ticks = 3;  // calibration too short to trust
+  qsort(g_events, g_nevents, sizeof(*g_events), CompareEvents);
+  if (g_json) {
+    PrintJson();
+  } else {
+    PrintText();
+  }
+  return 0;
+}
@@ -0,0 +1,197 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2024 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "tool/net/assetindex.h"
+#include "libc/macros.h"
+#include "libc/mem/mem.h"
+#include "libc/serialize.h"
+#include "libc/str/str.h"
+#include "libc/x/x.h"
+#include "third_party/aarch64/arm_neon.internal.h"
+#include "third_party/intel/emmintrin.internal.h"
+
+/**
+ * @fileoverview redbean asset index
+ *
+ * This is an open addressed hash table that maps zip asset names onto
+ * slot numbers. Slots are grouped by sixteen, and each one has a tag
+ * byte that holds seven bits of the hash, so a single vector compare
+ * tells us which slots in a group are worth looking at. The key array
+ * holds the full hash, the name length, and its first eight bytes, so
+ * most lookups never need to touch the name itself, which would cause
+ * a cache miss into the zip central directory.
+ */
+
+#if defined(__x86_64__) && !defined(__chibicc__)
+#define LANE 1
+static inline uint64_t MatchTags(const uint8_t *p, unsigned t) {
+  return _mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), _mm_set1_epi8(t)));
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define LANE 4
+static inline uint64_t MatchTags(const uint8_t *p, unsigned t) {
+  uint64_t m;
+  uint8x16_t cmp = vceqq_u8(vld1q_u8(p), vdupq_n_u8(t));
+  uint8x8_t mask = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+  vst1_u8((uint8_t *)&m, mask);
+  return m;
+}
+#else
+#define LANE 1
+static inline uint64_t MatchTags(const uint8_t *p, unsigned t) {
+  int i;
+  uint64_t m;
+  for (m = i = 0; i < 16; ++i) {
+    m |= (uint64_t)(p[i] == t) << i;
+  }
+  return m;
+}
+#endif
+
+static inline unsigned GetLane(uint64_t m) {
+  return __builtin_ctzll(m) / LANE;
+}
+
+static inline uint64_t ClearLane(uint64_t m, unsigned k) {
+  return m & ~((uint64_t)((1 << LANE) - 1) << (k * LANE));
+}
+
+static inline uint64_t GetPrefix(const char *s, size_t n) {
+  uint64_t w = 0;
+  memcpy(&w, s, MIN(n, 8));
+  return w;
+}
+
+static inline bool IsKey(const struct AssetKey *k, uint32_t h, uint64_t w,
+                         const char *s, size_t n) {
+  return k->hash == h && k->len == n && k->prefix == w &&
+         (n <= 8 || !memcmp(k->name + 8, s + 8, n - 8));
+}
+
+/**
+ * Hashes asset name.
+ */
+uint32_t HashAssetName(const void *p, size_t n) {
+  uint64_t h;
+  const char *s = p;
+  h = 0x9e3779b97f4a7c15 ^ n;
+  for (; n >= 8; s += 8, n -= 8) {
+    h = (h ^ READ64LE(s)) * 0xbf58476d1ce4e5b9;
+    h ^= h >> 29;
+  }
+  if (n) {
+    h = (h ^ GetPrefix(s, n)) * 0xbf58476d1ce4e5b9;
+    h ^= h >> 29;
+  }
+  h *= 0x94d049bb133111eb;
+  return h >> 32;
+}
+
+/**
+ * Creates empty index with enough room for `count` names.
+ */
+void InitAssetIndex(struct AssetIndex *x, uint32_t count) {
+  uint32_t n;
+  for (n = 16; n < count * 2ull; n *= 2) {
+  }
+  x->n = n;
+  x->used = 0;
+  x->tags = xcalloc(n, 1);
+  x->keys = xmalloc(n * sizeof(*x->keys));
+}
+
+/**
+ * Frees memory used by index.
+ */
+void DestroyAssetIndex(struct AssetIndex *x) {
+  free(x->tags);
+  free(x->keys);
+  x->tags = 0;
+  x->keys = 0;
+  x->n = 0;
+  x->used = 0;
+}
+
+/**
+ * Adds name to index.
+ *
+ * @param s is the name, which isn't copied and needs to outlive index
+ * @return slot number, or -1 if name is already indexed or index full
+ */
+long InsertAssetIndex(struct AssetIndex *x, const char *s, size_t n) {
+  uint64_t m, w;
+  unsigned k, t;
+  uint32_t g, h, i, step;
+  if (x->used >= x->n / 8 * 7)
+    return -1;
+  h = HashAssetName(s, n);
+  t = 0x80 | h >> 25;
+  w = GetPrefix(s, n);
+  g = x->n / 16;
+  for (step = 0; step < g; ++step) {
+    i = (h + ((step * (step + 1)) >> 1)) & (g - 1);
+    for (m = MatchTags(x->tags + i * 16, t); m; m = ClearLane(m, k)) {
+      k = GetLane(m);
+      if (IsKey(x->keys + i * 16 + k, h, w, s, n)) {
+        return -1;
+      }
+    }
+    if ((m = MatchTags(x->tags + i * 16, 0))) {
+      k = GetLane(m);
+      x->tags[i * 16 + k] = t;
+      x->keys[i * 16 + k].hash = h;
+      x->keys[i * 16 + k].len = n;
+      x->keys[i * 16 + k].prefix = w;
+      x->keys[i * 16 + k].name = s;
+      ++x->used;
+      return i * 16 + k;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Looks up name in index.
+ *
+ * @return slot number, or -1 if not found
+ */
+long FindAssetIndex(const struct AssetIndex *x, const char *s, size_t n) {
+  uint64_t m, w;
+  unsigned k, t;
+  uint32_t g, h, i, step;
+  if (!x->n)
+    return -1;
+  h = HashAssetName(s, n);
+  t = 0x80 | h >> 25;
+  w = GetPrefix(s, n);
+  g = x->n / 16;
+  for (step = 0; step < g; ++step) {
+    i = (h + ((step * (step + 1)) >> 1)) & (g - 1);
+    for (m = MatchTags(x->tags + i * 16, t); m; m = ClearLane(m, k)) {
+      k = GetLane(m);
+      if (IsKey(x->keys + i * 16 + k, h, w, s, n)) {
+        return i * 16 + k;
+      }
+    }
+    if (MatchTags(x->tags + i * 16, 0)) {
+      break;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,24 @@
+#ifndef COSMOPOLITAN_TOOL_NET_ASSETINDEX_H_
+#define COSMOPOLITAN_TOOL_NET_ASSETINDEX_H_
+COSMOPOLITAN_C_START_
+
+struct AssetIndex {
+  uint32_t n;     // number of slots, a power of two that's at least 16
+  uint32_t used;  // number of slots that are occupied
+  uint8_t *tags;  // zero if slot is empty, otherwise 0x80 | hash >> 25
+  struct AssetKey {
+    uint32_t hash;
+    uint32_t len;
+    uint64_t prefix;   // first eight bytes of name, zero padded
+    const char *name;  // needs to outlive index
+  } *keys;
+};
+
+uint32_t HashAssetName(const void *, size_t);
+void InitAssetIndex(struct AssetIndex *, uint32_t);
+void DestroyAssetIndex(struct AssetIndex *);
+long InsertAssetIndex(struct AssetIndex *, const char *, size_t);
+long FindAssetIndex(const struct AssetIndex *, const char *, size_t);
+
+COSMOPOLITAN_C_END_
+#endif /* COSMOPOLITAN_TOOL_NET_ASSETINDEX_H_ */
@@ -56,6 +56,7 @@ FLAGS
   -Z        log worker system calls
   -f        log worker function calls
   -B        only use stronger cryptography
+  -2        offer http/2 to ssl clients
   -X        disable ssl server and client support
   -*        permit self-modification of executable
   -J        disable non-ssl server and client support
@@ -665,6 +666,7 @@ function OnWorkerStop() end
 
 ---@class EncoderOptions
 ---@field useoutput boolean? defaults to `false`. Encodes the result directly to the output buffer and returns `nil` value. This option is ignored if used outside of request handling code.
+---@field stream boolean? defaults to `false`. Implies `useoutput` and sends the encoded output to the client in chunks as it's produced, by yielding the request handler coroutine.
 ---@field sorted boolean? defaults to `true`. Lua uses hash tables so the order of object keys is lost in a Lua table. So, by default, we use strcmp to impose a deterministic output order. If you don't care about ordering then setting sorted=false should yield a performance boost in serialization.
 ---@field pretty boolean? defaults to `false`. Setting this option to true will cause tables with more than one entry to be formatted across multiple lines for readability.
 ---@field indent string? defaults to " ". This option controls the indentation of pretty formatting. This field is ignored if pretty isn't true.
@@ -879,6 +881,13 @@ function DecodeJson(input) end
 --- - `useoutput`: `(bool=false)` encodes the result directly to the output buffer
 ---   and returns nil value. This option is ignored if used outside of request
 ---   handling code.
+--- - `stream`: `(bool=false)` implies `useoutput` and additionally sends the
+---   encoded output to the client in 64kb chunks as it's produced, using chunked
+---   transfer encoding, so large tables don't need to be held in memory as a
+---   whole. This works by yielding the request handler coroutine, which means the
+---   status and headers are committed when it's called. If an error happens after
+---   output was sent, the response will be truncated. This option is the same as
+---   `useoutput` if the caller can't yield.
 --- - `sorted`: `(bool=true)` Lua uses hash tables so the order of object keys is
 ---   lost in a Lua table. So, by default, we use strcmp to impose a deterministic
 ---   output order. If you don't care about ordering then setting `sorted=false`
@@ -916,10 +925,10 @@ function DecodeJson(input) end
 --- NaNs are serialized as `null` and Infinities are `null` which is consistent
 --- with the v8 behavior.
 ---@param value JsonValue
----@param options { useoutput: false?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }?
+---@param options { useoutput: false?, stream: false?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }?
 ---@return string
 ---@nodiscard
----@overload fun(value: JsonValue, options: { useoutput: true, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }): true
+---@overload fun(value: JsonValue, options: { useoutput: true, stream: boolean?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }): true
 ---@overload fun(value: JsonValue, options: { useoutput: boolean?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }? ): nil, error: string
 function EncodeJson(value, options) end
 
@@ -951,6 +960,13 @@ function EncodeJson(value, options) end
 --- - `useoutput`: `(bool=false)` encodes the result directly to the output buffer
 ---   and returns nil value. This option is ignored if used outside of request
 ---   handling code.
+--- - `stream`: `(bool=false)` implies `useoutput` and additionally sends the
+---   encoded output to the client in 64kb chunks as it's produced, using chunked
+---   transfer encoding, so large tables don't need to be held in memory as a
+---   whole. This works by yielding the request handler coroutine, which means the
+---   status and headers are committed when it's called. If an error happens after
+---   output was sent, the response will be truncated. This option is the same as
+---   `useoutput` if the caller can't yield.
 --- - `sorted`: `(bool=true)` Lua uses hash tables so the order of object keys is
 ---   lost in a Lua table. So, by default, we use strcmp to impose a deterministic
 ---   output order. If you don't care about ordering then setting `sorted=false`
@@ -1002,10 +1018,10 @@ function EncodeJson(value, options) end
 ---     -9223372036854775807 - 1
 ---
 --- The only failure return condition currently implemented is when C runs out of heap memory.
----@param options { useoutput: false?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }?
+---@param options { useoutput: false?, stream: false?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }?
 ---@return string
 ---@nodiscard
----@overload fun(value, options: { useoutput: true, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }): true
+---@overload fun(value, options: { useoutput: true, stream: boolean?, sorted: boolean?, pretty: boolean?, indent: string?, maxdepth: integer? }): true
 ---@overload fun(value, options: EncoderOptions? ): nil, error: string
 function EncodeLua(value, options) end
 
@@ -1384,7 +1400,7 @@ function IsLoopbackClient() end
 function IsLoopbackIp(uint32) end
 
 ---@param path string
----@return boolean # `true` if ZIP artifact at path is stored on disk using DEFLATE compression.
+---@return boolean # `true` if ZIP artifact at path is stored on disk using DEFLATE or Zstandard compression.
 ---@nodiscard
 function IsAssetCompressed(path) end
 
@@ -1709,6 +1725,14 @@ function ProgramRedirect(code, src, location) end
 ---@param seconds integer
 function ProgramSslTicketLifetime(seconds) end
 
+--- Defaults to `1024`. Sets how many SSL sessions are remembered in memory that's
+--- shared by all workers, so clients which resume a session by id rather than by
+--- ticket can skip the expensive key exchange. The least recently used session
+--- is evicted when the cache is full. This may be set to zero to disable the
+--- cache. This function is not available in unsecure mode.
+---@param entries integer
+function ProgramSslSessionCache(entries) end
+
 --- This function can be used to enable the PSK ciphersuites which simplify SSL
 --- and enhance its performance in controlled environments. key may contain 1..32
 --- bytes of random binary data and identity is usually a short plaintext string.
@@ -1746,6 +1770,16 @@ function ProgramSslClientVerify(enabled) end
 ---@param mandatory string
 function ProgramSslRequired(mandatory) end
 
+--- Controls whether or not redbean offers HTTP/2 to TLS clients via ALPN, which
+--- is disabled by default. Passing `true` has the same effect as the `-2` flag.
+--- Each HTTP/2 connection is served by a single process, which answers its
+--- streams one at a time in the order their requests finished arriving, as
+--- though they'd been pipelined HTTP/1.1 messages. That means a slow handler
+--- delays every other stream on its connection. This function can only be
+--- called from `.init.lua`. This function is not available in unsecure mode.
+---@param enabled boolean
+function ProgramHttp2(enabled) end
+
 --- This function may be called multiple times to specify the subset of available
 --- ciphersuites you want to use in both the HTTPS server and the `Fetch()` client.
 --- The default list, ordered by preference, is as follows:
@@ -1852,12 +1886,53 @@ function ProgramLogPath(str) end
 ---@param str string
 function ProgramPidPath(str) end
 
+--- Same as the `-Q` flag if called from `.init.lua` for setting the size of the
+--- queue of fully established connections that have yet to be accepted. The
+--- default is `SOMAXCONN`. When the queue is full, the kernel drops handshakes
+--- and clients retransmit after a second or more.
+---@param backlog integer
+function ProgramListenBacklog(backlog) end
+
+--- Same as the `-O` flag if called from `.init.lua` for setting the
+--- `TCP_FASTOPEN` queue length on listening sockets. Zero disables it. The
+--- default is 100.
+---@param qlen integer
+function ProgramTcpFastOpen(qlen) end
+
+--- Same as the `-x` flag if called from `.init.lua` for setting the
+--- `TCP_DEFER_ACCEPT` option on listening sockets, so connections aren't
+--- accepted until the client sends data, or the timeout elapses. Zero (the
+--- default) disables it. Linux only.
+---@param seconds integer
+function ProgramTcpDeferAccept(seconds) end
+
 --- Same as the `-u` flag if called from `.init.lua`. Can be used to configure the
 --- uniprocess mode. The current value is returned.
 ---@param bool boolean?
 ---@return boolean
 function ProgramUniprocess(bool) end
 
+--- Same as the `-Y` flag if called from `.init.lua`. Configures the main process
+--- to own accepted connections in its event loop, rather than forking a process
+--- for each one. Static assets are served without forking, and the connection
+--- is handed off to a forked worker once a request needs Lua or has a body, or
+--- its response is streamed or bigger than 256kb, or if the client speaks TLS.
+--- The current value is returned.
+---@param bool boolean?
+---@return boolean
+function ProgramMultiplex(bool) end
+
+--- Same as the `-N` flag if called from `.init.lua`. Configures redbean to
+--- prefork a fixed pool of long-lived workers that each accept and serve
+--- connections, rather than forking a process for each connection. The main
+--- process supervises the pool and respawns workers that die. On Linux, each
+--- worker gets its own listening socket bound with `SO_REUSEPORT` so the kernel
+--- balances incoming connections between them. Zero (the default) disables the
+--- pool. The current value is returned.
+---@param count integer?
+---@return integer
+function ProgramWorkerPool(count) end
+
 --- Reads all data from file the easy way.
 ---
 --- This function reads file data from local file system. Zip file assets can be
@@ -2850,6 +2925,20 @@ function Database:changes() end
 ---@return integer
 function Database:close() end
 
+--- Sets how many idle prepared statements are kept for reuse by later
+--- calls with identical SQL text. Zero disables the statement cache.
+---@param capacity? integer
+---@return integer previous
+function Database:cache_size(capacity) end
+
+--- Returns statistics for the prepared statement cache.
+---@return integer hits
+---@return integer misses
+---@return integer cached
+---@return integer capacity
+---@nodiscard
+function Database:cache_stats() end
+
 --- Finalizes all statements that have not been explicitly finalized. If
 --- `temponly` is `true`, only internal, temporary statements are finalized.
 ---@param temponly? boolean
@@ -3720,7 +3809,7 @@ function re.Regex:search(str, flags) end
 --- - `re.NOTBOL`
 --- - `re.NOTEOL`
 ---
---- This has exponential complexity. Please use `re.compile()` to compile your regular expressions once from `/.init.lua`. This API exists for convenience. This isn't recommended for prod.
+--- Compiling has exponential complexity. This function keeps the last 64 patterns it compiled in a cache, so calling it over and over with the same few patterns is cheap, but it's still a good idea to use `re.compile()` from `/.init.lua` for prod.
 ---
 --- This uses POSIX extended syntax by default.
 ---@return string match, string ... the match, followed by any captured groups
@@ -3745,6 +3834,13 @@ function re.search(regex, text, flags) end
 --- used to impose cpu and memory quotas for security.
 ---
 --- This uses POSIX extended syntax by default.
+---
+--- Extended expressions are also compiled for the PCRE2 DFA matcher, which
+--- is used to quickly reject text that can't match and to find the match
+--- itself when the pattern doesn't have any parenthesized groups. Results
+--- are always the same as POSIX, i.e. the leftmost longest match. Searches
+--- of non-ASCII text, and patterns using `re.BASIC` or extensions like `\b`
+--- or `\<`, are handled by the POSIX matcher alone.
 ---@return re.Regex
 ---@nodiscard
 ---@overload fun(regex: string, flags?: integer): nil, error: re.Errno
@@ -31,7 +31,9 @@
 #include "libc/str/utf16.h"
 #include "libc/sysv/consts/auxv.h"
 #include "libc/thread/thread.h"
+#include "third_party/aarch64/arm_neon.internal.h"
 #include "third_party/double-conversion/wrapper.h"
+#include "third_party/intel/emmintrin.internal.h"
 #include "third_party/lua/cosmo.h"
 #include "third_party/lua/lauxlib.h"
 #include "third_party/lua/ltests.h"
@@ -44,6 +46,8 @@
 #define OBJECT 16
 #define DEPTH  64
 
+#define INDEXMIN 128  // smaller inputs aren't worth indexing
+
 #define ASCII     0
 #define C0        1
 #define DQUOTE    2
@@ -575,6 +579,365 @@ static struct DecodeJson Parse(struct lua_State *L, const char *p,
   }
 }
 
+// Sets bits for each double quote, backslash, and structural character
+// in the 64 bytes at `p`. Brackets and braces differ only by 0x20.
+static inline void ClassifyJson(const char *p, uint64_t *quote,
+                                uint64_t *bslash, uint64_t *op) {
+#if defined(__x86_64__) && !defined(__chibicc__)
+  int i;
+  __m128i v, t;
+  uint64_t q, b, s;
+  for (q = b = s = i = 0; i < 64; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(p + i));
+    t = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    q |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')))
+         << i;
+    b |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')))
+         << i;
+    s |= (uint64_t)_mm_movemask_epi8(
+             _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(t, _mm_set1_epi8('{')),
+                                       _mm_cmpeq_epi8(t, _mm_set1_epi8('}'))),
+                          _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8(',')))))
+         << i;
+  }
+  *quote = q;
+  *bslash = b;
+  *op = s;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  int i;
+  uint8x16_t v, t, x[3][4];
+  const uint8x16_t w = {1, 2, 4, 8, 16, 32, 64, 128,
+                        1, 2, 4, 8, 16, 32, 64, 128};
+  for (i = 0; i < 4; ++i) {
+    v = vld1q_u8((const uint8_t *)(p + i * 16));
+    t = vorrq_u8(v, vdupq_n_u8(0x20));
+    x[0][i] = vandq_u8(vceqq_u8(v, vdupq_n_u8('"')), w);
+    x[1][i] = vandq_u8(vceqq_u8(v, vdupq_n_u8('\\')), w);
+    x[2][i] = vandq_u8(vorrq_u8(vorrq_u8(vceqq_u8(t, vdupq_n_u8('{')),
+                                         vceqq_u8(t, vdupq_n_u8('}'))),
+                                vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')),
+                                         vceqq_u8(v, vdupq_n_u8(',')))),
+                       w);
+  }
+  for (i = 0; i < 3; ++i) {
+    v = vpaddq_u8(vpaddq_u8(x[i][0], x[i][1]), vpaddq_u8(x[i][2], x[i][3]));
+    v = vpaddq_u8(v, v);
+    x[i][0] = v;
+  }
+  *quote = vgetq_lane_u64(vreinterpretq_u64_u8(x[0][0]), 0);
+  *bslash = vgetq_lane_u64(vreinterpretq_u64_u8(x[1][0]), 0);
+  *op = vgetq_lane_u64(vreinterpretq_u64_u8(x[2][0]), 0);
+#else
+  int i, c;
+  uint64_t q, b, s;
+  for (q = b = s = i = 0; i < 64; ++i) {
+    c = p[i] & 255;
+    q |= (uint64_t)(c == '"') << i;
+    b |= (uint64_t)(c == '\\') << i;
+    s |= (uint64_t)((c | 0x20) == '{' || (c | 0x20) == '}' || c == ':' ||
+                    c == ',')
+         << i;
+  }
+  *quote = q;
+  *bslash = b;
+  *op = s;
+#endif
+}
+
+// Returns mask of characters escaped by odd-length backslash runs.
+// The `carry` bit says if the first character of block is escaped.
+static inline uint64_t FindEscaped(uint64_t bslash, uint64_t *carry) {
+  uint64_t even, escape, follows, odds, evens, escaped;
+  if (!bslash) {
+    escaped = *carry;
+    *carry = 0;
+    return escaped;
+  }
+  even = 0x5555555555555555;
+  escape = bslash & ~*carry;
+  follows = escape << 1 | *carry;
+  odds = escape & ~even & ~follows;
+  evens = odds + escape;
+  *carry = evens < odds;
+  return (even ^ (evens << 1)) & follows;
+}
+
+// Finds offsets of quotes and structural characters outside strings.
+// Opening and closing quotes are both included. Returns the count.
+static size_t IndexJson(const char *p, size_t n, uint32_t *idx) {
+  size_t i, k;
+  char buf[64];
+  uint64_t q, b, s, m, x, esc, str;
+  for (esc = str = k = i = 0; i < n; i += 64) {
+    if (i + 64 <= n) {
+      ClassifyJson(p + i, &q, &b, &s);
+    } else {
+      memset(buf, ' ', 64);
+      memcpy(buf, p + i, n - i);
+      ClassifyJson(buf, &q, &b, &s);
+    }
+    q &= ~FindEscaped(b, &esc);
+    x = q;  // prefix xor turns quote bits into string bits
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    x ^= str;
+    str = -(x >> 63);
+    for (m = (s & ~x) | q; m; m &= m - 1) {
+      idx[k++] = i + __builtin_ctzll(m);
+    }
+  }
+  return k;
+}
+
+static inline const char *SkipJsonSpace(const char *p, const char *e) {
+  while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+    ++p;
+  return p;
+}
+
+// Counts elements of each array and object, in order of appearance, so
+// their tables can be created at the right size. Returns false if it's
+// nested too deeply. Everything else is left for the parser to check.
+static bool CountJson(const char *p, const uint32_t *idx, size_t k,
+                      uint32_t *cnt) {
+  int d;
+  size_t i, o;
+  uint32_t stk[DEPTH];
+  for (d = o = i = 0; i < k; ++i) {
+    switch (p[idx[i]]) {
+      case '[':
+      case '{':
+        if (d == DEPTH)
+          return false;
+        stk[d++] = o;
+        cnt[o++] = !(i + 1 < k &&
+                     SkipJsonSpace(p + idx[i] + 1, p + idx[i + 1]) ==
+                         p + idx[i + 1] &&
+                     (p[idx[i + 1]] == ']' || p[idx[i + 1]] == '}'));
+        break;
+      case ',':
+        if (d)
+          ++cnt[stk[d - 1]];
+        break;
+      case ']':
+      case '}':
+        if (d)
+          --d;
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+// Returns pointer to first byte in whole 16-byte blocks at `p` that's
+// not printable ascii or is a backslash.
+static inline const char *SkipJsonText(const char *p, const char *e) {
+#if defined(__x86_64__) && !defined(__chibicc__)
+  unsigned m;
+  __m128i v;
+  for (; e - p >= 16; p += 16) {
+    v = _mm_loadu_si128((const __m128i *)p);
+    m = _mm_movemask_epi8(
+        _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')),
+                         _mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f))));
+    if (m != 0xffff)
+      return p + __builtin_ctz(~m);
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  uint64_t m;
+  uint8x16_t v, x;
+  for (; e - p >= 16; p += 16) {
+    v = vld1q_u8((const uint8_t *)p);
+    x = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\\')),
+                 vcleq_s8(vreinterpretq_s8_u8(v), vdupq_n_s8(0x1f)));
+    vst1_u8((uint8_t *)&m, vshrn_n_u16(vreinterpretq_u16_u8(x), 4));
+    if (m)
+      return p + (__builtin_ctzll(m) >> 2);
+  }
+#endif
+  return p;
+}
+
+// Returns true if string content needs no decoding, i.e. it's only
+// printable ascii and well-formed utf-8, which Parse() would re-encode
+// byte for byte.
+static bool IsPlainJson(const char *p, const char *e) {
+  int c, i, n, lo, hi;
+  while ((p = SkipJsonText(p, e)) < e) {
+    c = *p & 255;
+    if (0x20 <= c && c < 0x80 && c != '\\') {
+      ++p;
+      continue;
+    }
+    if (c < 0xc2 || c > 0xf4)
+      return false;
+    n = c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+    if (e - p <= n)
+      return false;
+    lo = c == 0xe0 ? 0xa0 : c == 0xf0 ? 0x90 : 0x80;
+    hi = c == 0xed ? 0x9f : c == 0xf4 ? 0x8f : 0xbf;
+    if ((p[1] & 255) < lo || (p[1] & 255) > hi)
+      return false;
+    for (i = 2; i <= n; ++i) {
+      if ((p[i] & 0300) != 0200) {
+        return false;
+      }
+    }
+    p += n + 1;
+  }
+  return true;
+}
+
+struct JsonIndex {
+  const char *p, *e;
+  const uint32_t *idx, *cnt;
+  size_t i, k, o;
+  uintptr_t bsp;
+};
+
+static inline bool ExpectJson(struct JsonIndex *j, const char *p, int c) {
+  if (j->i < j->k && p == j->p + j->idx[j->i] && *p == c) {
+    ++j->i;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+// Pushes value at `p` using structural index and returns its end. NULL
+// is returned for anything unusual, so Parse() can have the final say.
+static const char *DecodeJsonValue(struct lua_State *L, struct JsonIndex *j,
+                                   const char *p, int depth) {
+  uint32_t i, n;
+  const char *q;
+  struct DecodeJson r;
+  if (!depth || p == j->e)
+    return 0;
+  if (ExpectJson(j, p, '"')) {
+    if (j->i == j->k)
+      return 0;
+    q = j->p + j->idx[j->i++];
+    if (IsPlainJson(p + 1, q)) {
+      lua_pushlstring(L, p + 1, q - (p + 1));
+      return q + 1;
+    }
+    r = Parse(L, p, j->e, 0, depth, j->bsp);
+    return r.rc == 1 && r.p == q + 1 ? r.p : 0;
+  } else if (ExpectJson(j, p, '[')) {
+    n = j->cnt[j->o++];
+    lua_createtable(L, n, 0);
+    if (!n) {
+      p = SkipJsonSpace(p + 1, j->e);
+      if (!ExpectJson(j, p, ']'))
+        return 0;
+      // we need this kludge so `[]` won't round-trip as `{}`
+      lua_pushboolean(L, false);
+      lua_rawseti(L, -2, 0);
+      return p + 1;
+    }
+    for (i = 1;; ++i) {
+      p = SkipJsonSpace(p + 1, j->e);
+      if (!(p = DecodeJsonValue(L, j, p, depth - 1)))
+        return 0;
+      lua_rawseti(L, -2, i);
+      p = SkipJsonSpace(p, j->e);
+      if (ExpectJson(j, p, ']'))
+        return p + 1;
+      if (!ExpectJson(j, p, ','))
+        return 0;
+    }
+  } else if (ExpectJson(j, p, '{')) {
+    n = j->cnt[j->o++];
+    lua_createtable(L, 0, n);
+    if (!n) {
+      p = SkipJsonSpace(p + 1, j->e);
+      return ExpectJson(j, p, '}') ? p + 1 : 0;
+    }
+    for (;;) {
+      p = SkipJsonSpace(p + 1, j->e);
+      if (p == j->e || *p != '"')
+        return 0;
+      if (!(p = DecodeJsonValue(L, j, p, depth - 1)))
+        return 0;
+      p = SkipJsonSpace(p, j->e);
+      if (!ExpectJson(j, p, ':'))
+        return 0;
+      p = SkipJsonSpace(p + 1, j->e);
+      if (!(p = DecodeJsonValue(L, j, p, depth - 1)))
+        return 0;
+      lua_settable(L, -3);
+      p = SkipJsonSpace(p, j->e);
+      if (ExpectJson(j, p, '}'))
+        return p + 1;
+      if (!ExpectJson(j, p, ','))
+        return 0;
+    }
+  } else if (*p == '-' || isdigit(*p) || *p == 't' || *p == 'f' ||
+             *p == 'n') {
+    r = Parse(L, p, j->e, 0, depth, j->bsp);
+    return r.rc == 1 ? r.p : 0;
+  } else {
+    return 0;
+  }
+}
+
+// Decodes JSON in two passes. The first uses simd to find where all the
+// strings and punctuation are. The second walks that index to build the
+// Lua tables, which can be allocated with their final size.
+static struct DecodeJson DecodeJsonIndexed(struct lua_State *L, const char *p,
+                                           size_t n, uintptr_t bsp) {
+  int top;
+  size_t i, k, o;
+  const char *q;
+  uint32_t *idx, *cnt;
+  struct JsonIndex j;
+  top = lua_gettop(L);
+  idx = lua_newuserdatauv(L, n * sizeof(uint32_t), 0);
+  k = IndexJson(p, n, idx);
+  for (o = i = 0; i < k; ++i)
+    o += p[idx[i]] == '[' || p[idx[i]] == '{';
+  cnt = lua_newuserdatauv(L, o * sizeof(uint32_t), 0);
+  if (CountJson(p, idx, k, cnt)) {
+    j = (struct JsonIndex){p, p + n, idx, cnt, 0, k, 0, bsp};
+    if ((q = DecodeJsonValue(L, &j, SkipJsonSpace(p, p + n), DEPTH))) {
+      lua_replace(L, top + 1);
+      lua_settop(L, top + 1);
+      return (struct DecodeJson){1, q};
+    }
+  }
+  lua_settop(L, top);
+  return Parse(L, p, p + n, 0, DEPTH, bsp);
+}
+
+/**
+ * Parses JSON data structure one byte at a time.
+ *
+ * This is the reference implementation. It's what DecodeJson() uses
+ * for small inputs and what it defers to whenever its indexed decoder
+ * finds something that isn't plain well-formed JSON, which is how the
+ * two always agree on results and error messages.
+ *
+ * @see DecodeJson()
+ */
+struct DecodeJson DecodeJsonBytewise(struct lua_State *L, const char *p,
+                                     size_t n) {
+  if (n == -1)
+    n = p ? strlen(p) : 0;
+  uintptr_t bsp = GetStackBottom() + 4096;
+  if (lua_checkstack(L, DEPTH * 3 + LUA_MINSTACK)) {
+    return Parse(L, p, p + n, 0, DEPTH, bsp);
+  } else {
+    return (struct DecodeJson){-1, "can't set stack depth"};
+  }
+}
+
 /**
  * Parses JSON data structure string into Lua data structure.
  *
@@ -601,9 +964,11 @@ static struct DecodeJson Parse(struct lua_State *L, const char *p,
 struct DecodeJson DecodeJson(struct lua_State *L, const char *p, size_t n) {
   if (n == -1)
     n = p ? strlen(p) : 0;
+  if (n < INDEXMIN || n > UINT32_MAX)
+    return DecodeJsonBytewise(L, p, n);
   uintptr_t bsp = GetStackBottom() + 4096;
-  if (lua_checkstack(L, DEPTH * 3 + LUA_MINSTACK)) {
-    return Parse(L, p, p + n, 0, DEPTH, bsp);
+  if (lua_checkstack(L, DEPTH * 3 + LUA_MINSTACK + 2)) {
+    return DecodeJsonIndexed(L, p, n, bsp);
   } else {
     return (struct DecodeJson){-1, "can't set stack depth"};
   }
@@ -16,16 +16,53 @@
 │ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
 │ PERFORMANCE OF THIS SOFTWARE.                                                │
 ╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/ctype.h"
 #include "libc/macros.h"
+#include "libc/mem/mem.h"
 #include "libc/str/str.h"
 #include "third_party/lua/lauxlib.h"
+#include "third_party/pcre/pcre2.h"
 #include "third_party/regex/regex.h"
 
+// The re module uses TRE for POSIX semantics. Since TRE is a backtrack
+// free tagged nfa it gets slow on longer patterns, so we also compile
+// extended expressions as pcre2 and use its dfa matcher to quickly say
+// whether or not a subject matches. The dfa matcher finds the longest
+// match at the leftmost position, which is what POSIX wants, so we can
+// return its answer directly when no capture groups are needed. Anything
+// else (submatches, non-ascii subjects, syntax pcre2 would interpret
+// differently) is given to TRE which remains the source of truth.
+
+#define RE_CACHE_SIZE 64
+
+struct Regex {
+  regex_t tre;
+  int flags;
+  bool anchored;
+  unsigned char prefixlen;
+  unsigned char useless;
+  unsigned char skips;
+  char prefix[32];
+  pcre2_code *dfa;
+  pcre2_match_data *md;
+};
+
 struct ReErrno {
   int err;
   char doc[64];
 };
 
+static struct ReCache {
+  unsigned tick;
+  struct ReCacheEntry {
+    unsigned tick;
+    unsigned hash;
+    int flags;
+    char *pattern;
+    struct Regex *re;
+  } e[RE_CACHE_SIZE];
+} recache;
+
 static void LuaSetIntField(lua_State *L, const char *k, lua_Integer v) {
   lua_pushinteger(L, v);
   lua_setfield(L, -2, k);
@@ -41,36 +78,302 @@ static int LuaReReturnError(lua_State *L, regex_t *r, int rc) {
   return 2;
 }
 
-static regex_t *LuaReCompileImpl(lua_State *L, const char *p, int f) {
-  int rc;
-  regex_t *r;
-  r = lua_newuserdatauv(L, sizeof(regex_t), 0);
-  luaL_setmetatable(L, "re.Regex");
+// Translates POSIX extended regular expression to pcre2 syntax.
+// Returns NULL if pattern uses anything whose meaning could differ.
+static char *ReTranslate(const char *p, int f) {
+  int c;
+  bool quant, neg;
+  char *b, *q, *e;
+  if (!(b = q = malloc(strlen(p) * 16 + 1))) return 0;
+  for (quant = false; (c = *p++ & 255);) {
+    if (c >= 0200) goto Unsupported;
+    switch (c) {
+      case '\\':
+        c = *p++ & 255;
+        if (!c || c >= 0200) goto Unsupported;
+        if (ispunct(c) && c != '<' && c != '>' && c != '`' && c != '\'') {
+          *q++ = '\\';  // escaped punctuation is always a literal
+          *q++ = c;
+        } else if (strchr("tnrfae", c)) {
+          *q++ = '\\';
+          *q++ = c;
+        } else if (c == 'w') {
+          q = stpcpy(q, "[[:alnum:]_]");
+        } else if (c == 's') {
+          q = stpcpy(q, "[[:space:]]");
+        } else if (c == 'd') {
+          q = stpcpy(q, "[[:digit:]]");
+        } else if (c == 'W') {
+          q = stpcpy(q, f & REG_NEWLINE ? "[^[:alnum:]_\\n]" : "[^[:alnum:]_]");
+        } else if (c == 'S') {
+          q = stpcpy(q, f & REG_NEWLINE ? "[^[:space:]\\n]" : "[^[:space:]]");
+        } else if (c == 'D') {
+          q = stpcpy(q, f & REG_NEWLINE ? "[^[:digit:]\\n]" : "[^[:digit:]]");
+        } else {
+          goto Unsupported;  // \b, \<, \x, etc.
+        }
+        quant = false;
+        break;
+      case '[':
+        *q++ = '[';
+        if ((neg = *p == '^')) *q++ = *p++;
+        if (*p == ']') {
+          *q++ = '\\';
+          *q++ = *p++;
+        }
+        for (;;) {
+          c = *p++ & 255;
+          if (!c || c >= 0200) goto Unsupported;
+          if (c == ']') break;
+          if (c == '[' && *p == ':') {
+            if (!(e = strstr(p, ":]"))) goto Unsupported;
+            if ((f & REG_ICASE) && (!strncmp(p, ":upper:]", 8) ||
+                                    !strncmp(p, ":lower:]", 8))) {
+              goto Unsupported;
+            }
+            q = mempcpy(q, p - 1, e + 2 - (p - 1));
+            p = e + 2;
+          } else if (c == '[') {
+            if (*p == '.' || *p == '=') goto Unsupported;
+            *q++ = '\\';
+            *q++ = c;
+          } else if (c == '\\') {
+            *q++ = '\\';  // backslash isn't special in posix brackets
+            *q++ = c;
+          } else if (c == '-' && *p == '-') {
+            goto Unsupported;
+          } else {
+            *q++ = c;
+          }
+        }
+        if (neg && (f & REG_NEWLINE)) {
+          *q++ = '\\';
+          *q++ = 'n';
+        }
+        *q++ = ']';
+        quant = false;
+        break;
+      case '*':
+      case '+':
+      case '?':
+        if (quant) goto Unsupported;  // possessive and lazy in pcre
+        *q++ = c;
+        quant = true;
+        break;
+      case '{':
+        if (quant || *p == ',') goto Unsupported;
+        *q++ = c;
+        while ((c = *p++ & 255) != '}') {
+          if (!isdigit(c) && c != ',') goto Unsupported;
+          *q++ = c;
+        }
+        *q++ = c;
+        quant = true;
+        break;
+      case '(':
+        if (*p == '?' || *p == '*') goto Unsupported;
+        // fallthrough
+      default:
+        *q++ = c;
+        quant = false;
+        break;
+    }
+  }
+  *q = 0;
+  return b;
+Unsupported:
+  free(b);
+  return 0;
+}
+
+// Finds literal text every match of extended pattern must contain.
+static void ReFindPrefix(struct Regex *r, const char *p) {
+  int c, n;
+  if (strchr(p, '|')) return;
+  if (*p == '^') {
+    r->anchored = !(r->flags & REG_NEWLINE);
+    ++p;
+  }
+  for (n = 0; n + 1 < sizeof(r->prefix); ++p) {
+    c = *p & 255;
+    if (c == '\\' && ispunct(p[1] & 255) && p[1] != '<' && p[1] != '>' &&
+        p[1] != '`' && p[1] != '\'') {
+      c = *++p & 255;
+    } else if (!c || c >= 0200 || iscntrl(c) || strchr(".[]()*+?{}|^$\\", c)) {
+      break;
+    }
+    r->prefix[n++] = c;
+  }
+  if (n && (*p == '*' || *p == '?' || *p == '{')) --n;
+  r->prefix[n] = 0;
+  r->prefixlen = n;
+}
+
+static void ReFree(struct Regex *r) {
+  pcre2_match_data_free(r->md);
+  pcre2_code_free(r->dfa);
+  regfree(&r->tre);
+}
+
+static int ReCompile(struct Regex *r, const char *p, int f) {
+  int rc, e;
+  char *pcre;
+  PCRE2_SIZE off;
+  uint32_t opts, minlen;
+  bzero(r, sizeof(*r));
   f &= REG_EXTENDED | REG_ICASE | REG_NEWLINE | REG_NOSUB;
   f ^= REG_EXTENDED;
-  if ((rc = regcomp(r, p, f)) == REG_OK) {
+  if ((rc = regcomp(&r->tre, p, f)) != REG_OK) return rc;
+  r->flags = f;
+  if (!(f & REG_EXTENDED)) return REG_OK;
+  ReFindPrefix(r, p);
+  if ((pcre = ReTranslate(p, f))) {
+    opts = PCRE2_NO_AUTO_CAPTURE | PCRE2_NEVER_UTF | PCRE2_NEVER_UCP;
+    if (f & REG_NEWLINE) {
+      opts |= PCRE2_MULTILINE | PCRE2_ALT_CIRCUMFLEX;
+    } else {
+      opts |= PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY;  // dfa honors it anyway
+    }
+    if (f & REG_ICASE) opts |= PCRE2_CASELESS;
+    // tre gets confused by empty matches, e.g. `$|x*`, so leave those
+    if ((r->dfa = pcre2_compile((PCRE2_SPTR)pcre, PCRE2_ZERO_TERMINATED, opts,
+                                &e, &off, 0)) &&
+        (pcre2_pattern_info(r->dfa, PCRE2_INFO_MINLENGTH, &minlen) ||
+         !minlen || !(r->md = pcre2_match_data_create(1, 0)))) {
+      pcre2_code_free(r->dfa);
+      r->dfa = 0;
+    }
+    free(pcre);
+  }
+  return REG_OK;
+}
+
+// Returns REG_NOMATCH if subject can't match, REG_OK if dfa matched
+// and `m` holds the answer, or -1 if TRE needs to be consulted.
+static int ReQuickSearch(struct Regex *r, const char *s, regmatch_t *m,
+                         int f) {
+  int rc;
+  size_t n;
+  bool ascii;
+  PCRE2_SIZE *ov;
+  int ws[128];
+  if (r->prefixlen) {
+    if (r->anchored && !(f & REG_NOTBOL)) {
+      if ((r->flags & REG_ICASE)
+              ? strncasecmp(s, r->prefix, r->prefixlen)
+              : strncmp(s, r->prefix, r->prefixlen)) {
+        return REG_NOMATCH;
+      }
+    } else if (!((r->flags & REG_ICASE) ? strcasestr(s, r->prefix)
+                                        : strstr(s, r->prefix))) {
+      return REG_NOMATCH;
+    }
+  }
+  if (!r->dfa) return -1;
+  // dfa can only reject when tre must compute the submatches, so stop
+  // asking it if it keeps saying yes, but check back now and then
+  if (r->useless == 255 && (++r->skips & 63)) return -1;
+  for (ascii = true, n = 0; s[n]; ++n) {
+    ascii &= !(s[n] & 0200);
+  }
+  if (!ascii) return -1;  // tre matches utf-8 code points
+  rc = pcre2_dfa_match(r->dfa, (PCRE2_SPTR)s, n, 0,
+                       ((f & REG_NOTBOL) ? PCRE2_NOTBOL : 0) |
+                           ((f & REG_NOTEOL) ? PCRE2_NOTEOL : 0),
+                       r->md, 0, ws, ARRAYLEN(ws));
+  if (rc == PCRE2_ERROR_NOMATCH) {
+    r->useless = 0;
+    return REG_NOMATCH;
+  }
+  if (rc < 0 || r->tre.re_nsub || (r->flags & REG_NOSUB)) {
+    r->useless = MIN(r->useless + 16, 255);
+    return -1;
+  }
+  ov = pcre2_get_ovector_pointer(r->md);
+  m->rm_so = ov[0];
+  m->rm_eo = ov[1];
+  return REG_OK;
+}
+
+static struct Regex *LuaReCompileImpl(lua_State *L, const char *p, int f) {
+  int rc;
+  struct Regex *r;
+  r = lua_newuserdatauv(L, sizeof(struct Regex), 0);
+  if ((rc = ReCompile(r, p, f)) == REG_OK) {
+    luaL_setmetatable(L, "re.Regex");
     return r;
   } else {
-    LuaReReturnError(L, r, rc);
+    LuaReReturnError(L, &r->tre, rc);
     return NULL;
   }
 }
 
-static int LuaReSearchImpl(lua_State *L, regex_t *r, const char *s, int f) {
+// Returns compiled regex from cache, compiling it on miss.
+static struct Regex *LuaReCompileCached(lua_State *L, const char *p, int f) {
+  int i, j, rc;
+  char *q;
+  unsigned h;
+  const char *s;
+  struct Regex *r;
+  struct ReCacheEntry *e;
+  f &= REG_EXTENDED | REG_ICASE | REG_NEWLINE | REG_NOSUB;
+  for (h = 2166136261u, s = p; *s; ++s) {
+    h = (h ^ (*s & 255)) * 16777619u;
+  }
+  for (j = i = 0; i < RE_CACHE_SIZE; ++i) {
+    e = recache.e + i;
+    if (e->re && e->hash == h && e->flags == f && !strcmp(e->pattern, p)) {
+      e->tick = ++recache.tick;
+      return e->re;
+    }
+    if (!e->re || (recache.e[j].re && e->tick < recache.e[j].tick)) {
+      j = i;
+    }
+  }
+  if (!(r = malloc(sizeof(*r))) || !(q = strdup(p))) {
+    free(r);
+    luaL_error(L, "out of memory");
+    __builtin_unreachable();
+  }
+  if ((rc = ReCompile(r, p, f)) != REG_OK) {
+    LuaReReturnError(L, &r->tre, rc);
+    free(q);
+    free(r);
+    return NULL;
+  }
+  e = recache.e + j;
+  if (e->re) {
+    ReFree(e->re);
+    free(e->re);
+    free(e->pattern);
+  }
+  e->re = r;
+  e->hash = h;
+  e->flags = f;
+  e->pattern = q;
+  e->tick = ++recache.tick;
+  return r;
+}
+
+static int LuaReSearchImpl(lua_State *L, struct Regex *r, const char *s,
+                           int f) {
   int rc, i, n;
   regmatch_t *m;
   luaL_Buffer tmp;
-  n = 1 + r->re_nsub;
+  n = 1 + r->tre.re_nsub;
   m = (regmatch_t *)luaL_buffinitsize(L, &tmp, n * sizeof(regmatch_t));
   m->rm_so = 0;
   m->rm_eo = 0;
-  if ((rc = regexec(r, s, n, m, f >> 8)) == REG_OK) {
+  if ((rc = ReQuickSearch(r, s, m, f >> 8)) == -1) {
+    rc = regexec(&r->tre, s, n, m, f >> 8);
+  }
+  if (rc == REG_OK) {
     for (i = 0; i < n; ++i) {
       lua_pushlstring(L, s + m[i].rm_so, m[i].rm_eo - m[i].rm_so);
     }
     return n;
   } else {
-    return LuaReReturnError(L, r, rc);
+    return LuaReReturnError(L, &r->tre, rc);
   }
 }
 
@@ -79,7 +382,7 @@ static int LuaReSearchImpl(lua_State *L, regex_t *r, const char *s, int f) {
 
 static int LuaReSearch(lua_State *L) {
   int f;
-  regex_t *r;
+  struct Regex *r;
   const char *p, *s;
   p = luaL_checkstring(L, 1);
   s = luaL_checkstring(L, 2);
@@ -89,7 +392,7 @@ static int LuaReSearch(lua_State *L) {
     luaL_argerror(L, 3, "invalid flags");
     __builtin_unreachable();
   }
-  if ((r = LuaReCompileImpl(L, p, f))) {
+  if ((r = LuaReCompileCached(L, p, f))) {
     return LuaReSearchImpl(L, r, s, f);
   } else {
     return 2;
@@ -98,7 +401,7 @@ static int LuaReSearch(lua_State *L) {
 
 static int LuaReCompile(lua_State *L) {
   int f;
-  regex_t *r;
+  struct Regex *r;
   const char *p;
   p = luaL_checkstring(L, 1);
   f = luaL_optinteger(L, 2, 0);
@@ -118,7 +421,7 @@ static int LuaReCompile(lua_State *L) {
 
 static int LuaReRegexSearch(lua_State *L) {
   int f;
-  regex_t *r;
+  struct Regex *r;
   const char *s;
   r = luaL_checkudata(L, 1, "re.Regex");
   s = luaL_checkstring(L, 2);
@@ -131,9 +434,9 @@ static int LuaReRegexSearch(lua_State *L) {
 }
 
 static int LuaReRegexGc(lua_State *L) {
-  regex_t *r;
+  struct Regex *r;
   r = luaL_checkudata(L, 1, "re.Regex");
-  regfree(r);
+  ReFree(r);
   return 0;
 }
 
@@ -27,15 +27,22 @@
 │ TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE            │
 │ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                       │
 ╚─────────────────────────────────────────────────────────────────────────────*/
+#include "libc/calls/calls.h"
 #include "libc/calls/weirdtypes.h"
+#include "libc/ctype.h"
+#include "libc/errno.h"
 #include "libc/mem/gc.h"
 #include "libc/mem/mem.h"
+#include "libc/runtime/runtime.h"
 #include "libc/str/str.h"
+#include "libc/sysv/consts/map.h"
+#include "libc/sysv/consts/prot.h"
 #include "third_party/lua/lauxlib.h"
 #include "third_party/lua/lua.h"
 #include "third_party/lua/luaconf.h"
 #include "third_party/sqlite3/extensions.h"
 #include "third_party/sqlite3/sqlite3.h"
+#include "tool/net/lfuncs.h"
 // clang-format off
 
 __notice(lsqlite3_notice, "\
@@ -50,6 +57,8 @@ Copyright 2002-2016 Tiago Dionizio, Doug Currie");
 //   - Removed extension loading code
 //   - Relocate static .data to .rodata
 //   - Changed lua_strlen() to lua_rawlen()
+//   - Open /zip/ databases in place using a read-only vfs
+//   - Reuse prepared statements with identical sql text
 //
 #define LSQLITE_VERSION "0.9.5"
 
@@ -77,6 +86,7 @@ typedef struct sdb sdb;
 typedef struct sdb_vm sdb_vm;
 typedef struct sdb_bu sdb_bu;
 typedef struct sdb_func sdb_func;
+typedef struct sdb_stmt sdb_stmt;
 
 /* to use as C user data so i know what function sqlite is calling */
 struct sdb_func {
@@ -116,8 +126,27 @@ struct sdb {
 
     int rollback_hook_cb; /* rollback_hook callback */
     int rollback_hook_udata;
+
+    /* idle prepared statements, most recently used first */
+    sdb_stmt *cache;
+    int cache_count;
+    int cache_capacity;
+    lua_Integer cache_hits;
+    lua_Integer cache_misses;
 };
 
+/* prepared statement that can be reused for identical sql text */
+struct sdb_stmt {
+    sdb_stmt *prev, *next;  /* circular lru list when idle */
+    sqlite3_stmt *vm;
+    size_t tail;            /* offset of text after first statement */
+    size_t len;
+    char ddl;               /* running this changes the schema */
+    char sql[];
+};
+
+#define LSQLITE_CACHE_CAPACITY 16
+
 static const char *const sqlite_meta      = ":sqlite3";
 static const char *const sqlite_vm_meta   = ":sqlite3:vm";
 static const char *const sqlite_ctx_meta  = ":sqlite3:ctx";
@@ -169,6 +198,7 @@ static void vm_push_column(lua_State *L, sqlite3_stmt *vm, int idx) {
 struct sdb_vm {
     sdb *db;                /* associated database handle */
     sqlite3_stmt *vm;       /* virtual machine */
+    sdb_stmt *stmt;         /* goes back in cache when vm is finalized */
 
     /* sqlite3_step info */
     int columns;            /* number of columns in result */
@@ -177,6 +207,119 @@ struct sdb_vm {
     char temp;              /* temporary vm used in db:rows */
 };
 
+/*
+** Statement cache:
+** Statements are taken out of the cache while a vm is using them and
+** are put back, reset with bindings cleared, once the vm is finalized.
+** Statements which change the schema aren't cached and they flush the
+** whole cache. Other connections changing the schema is handled, like
+** always, by sqlite3_prepare_v2() re-preparing on SQLITE_SCHEMA.
+*/
+static int stmt_isddl(const char *sql, size_t len) {
+    static const char *const kDdl[] = {"ALTER", "ANALYZE", "ATTACH", "CREATE",
+                                       "DETACH", "DROP", "REINDEX", "VACUUM"};
+    size_t i, n;
+    while (len && isspace(*sql & 255)) ++sql, --len;
+    for (i = 0; i < sizeof(kDdl) / sizeof(*kDdl); ++i) {
+        n = strlen(kDdl[i]);
+        if (len >= n && !strncasecmp(sql, kDdl[i], n)) return 1;
+    }
+    return 0;
+}
+
+static void stmt_unlink(sdb *db, sdb_stmt *st) {
+    if (st->next == st) {
+        db->cache = NULL;
+    } else {
+        st->prev->next = st->next;
+        st->next->prev = st->prev;
+        if (db->cache == st) db->cache = st->next;
+    }
+    --db->cache_count;
+}
+
+static void stmt_free(sdb_stmt *st) {
+    sqlite3_finalize(st->vm);
+    free(st);
+}
+
+static void stmt_flush(sdb *db) {
+    sdb_stmt *st;
+    while ((st = db->cache)) {
+        stmt_unlink(db, st);
+        stmt_free(st);
+    }
+}
+
+static void stmt_trim(sdb *db) {
+    sdb_stmt *st;
+    while (db->cache_count > db->cache_capacity) {
+        st = db->cache->prev;
+        stmt_unlink(db, st);
+        stmt_free(st);
+    }
+}
+
+/* returns statement for first sql statement in text, or NULL w/ *rc */
+static sdb_stmt *stmt_acquire(sdb *db, const char *sql, size_t len, int *rc) {
+    sdb_stmt *st;
+    const char *tail;
+    if ((st = db->cache)) {
+        do {
+            if (st->len == len && !memcmp(st->sql, sql, len)) {
+                stmt_unlink(db, st);
+                ++db->cache_hits;
+                *rc = SQLITE_OK;
+                return st;
+            }
+        } while ((st = st->next) != db->cache);
+    }
+    ++db->cache_misses;
+    if (!(st = malloc(sizeof(sdb_stmt) + len + 1))) {
+        *rc = SQLITE_NOMEM;
+        return NULL;
+    }
+    memcpy(st->sql, sql, len);
+    st->sql[len] = 0;
+    st->len = len;
+    st->ddl = stmt_isddl(sql, len);
+    if ((*rc = sqlite3_prepare_v2(db->db, st->sql, len, &st->vm, &tail)) !=
+        SQLITE_OK) {
+        free(st);
+        return NULL;
+    }
+    st->tail = tail - st->sql;
+    return st;
+}
+
+/* puts statement back in cache and returns sqlite3_reset() result */
+static int stmt_release(sdb *db, sdb_stmt *st) {
+    int rc, ddl;
+    if (!st->vm) {
+        free(st);
+        return SQLITE_OK;
+    }
+    rc = sqlite3_reset(st->vm);
+    if ((ddl = st->ddl) || !db->cache_capacity) {
+        stmt_free(st);
+        if (ddl) stmt_flush(db);
+        return rc;
+    }
+    sqlite3_clear_bindings(st->vm);
+    if (db->cache) {
+        st->next = db->cache;
+        st->prev = db->cache->prev;
+        st->prev->next = st;
+        st->next->prev = st;
+    } else {
+        st->next = st->prev = st;
+    }
+    db->cache = st;
+    ++db->cache_count;
+    stmt_trim(db);
+    return rc;
+}
+
 /* called with db,sql text on the lua stack */
 static sdb_vm *newvm(lua_State *L, sdb *db) {
     sdb_vm *svm = (sdb_vm*)lua_newuserdata(L, sizeof(sdb_vm)); /* db sql svm_ud -- */
@@ -188,6 +331,7 @@ static sdb_vm *newvm(lua_State *L, sdb *db) {
     svm->columns = 0;
     svm->has_values = 0;
     svm->vm = NULL;
+    svm->stmt = NULL;
     svm->temp = 0;
 
     /* add an entry on the database table: svm -> db to keep db live while svm is live */
@@ -206,8 +350,9 @@ static int cleanupvm(lua_State *L, sdb_vm *svm) {
     svm->has_values = 0;
 
     if (!svm->vm) return 0;
-    lua_pushinteger(L, sqlite3_finalize(svm->vm));
+    lua_pushinteger(L, stmt_release(svm->db, svm->stmt));
     svm->vm = NULL;
+    svm->stmt = NULL;
     return 1;
 }
 
@@ -611,6 +756,12 @@ static sdb *newdb (lua_State *L) {
     db->rollback_hook_udata =
         LUA_NOREF;
 
+    db->cache = NULL;
+    db->cache_count = 0;
+    db->cache_capacity = LSQLITE_CACHE_CAPACITY;
+    db->cache_hits = 0;
+    db->cache_misses = 0;
+
     luaL_getmetatable(L, sqlite_meta);
     lua_setmetatable(L, -2);        /* set metatable */
 
@@ -650,6 +801,7 @@ static int cleanupdb(lua_State *L, sdb *db) {
     if (!db->db) return SQLITE_MISUSE;
 
     closevms(L, db, 0);
+    stmt_flush(db);
 
     /* remove entry in lua registry table */
     lua_pushlightuserdata(L, db);
@@ -1562,6 +1714,27 @@ static int db_exec_callback(void* user, int columns, char **data, char **names)
     return result;
 }
 
+static int db_exec_cached(sdb *db, const char *sql, size_t len) {
+    int rc, rc2;
+    size_t tail;
+    sdb_stmt *st;
+    while (len) {
+        if (!(st = stmt_acquire(db, sql, len, &rc))) return rc;
+        if (st->vm) {
+            while ((rc = sqlite3_step(st->vm)) == SQLITE_ROW) {
+            }
+            if (rc == SQLITE_DONE) rc = SQLITE_OK;
+        }
+        tail = st->tail;
+        rc2 = stmt_release(db, st);
+        if (rc != SQLITE_OK) return rc2 != SQLITE_OK ? rc2 : rc;
+        if (!tail) break;
+        sql += tail;
+        len -= tail;
+    }
+    return SQLITE_OK;
+}
+
 static int db_exec(lua_State *L) {
     sdb *db = lsqlite_checkdb(L, 1);
     const char *sql = luaL_checkstring(L, 2);
@@ -1582,8 +1755,8 @@ static int db_exec(lua_State *L) {
         result = sqlite3_exec(db->db, sql, db_exec_callback, L, NULL);
     }
     else {
-        /* no callbacks */
-        result = sqlite3_exec(db->db, sql, NULL, NULL, NULL);
+        /* no callbacks, so run each statement through the cache */
+        result = db_exec_cached(db, sql, lua_rawlen(L, 2));
     }
 
     lua_pushinteger(L, result);
@@ -1598,21 +1771,20 @@ static int db_prepare(lua_State *L) {
     sdb *db = lsqlite_checkdb(L, 1);
     const char *sql = luaL_checkstring(L, 2);
     int sql_len = lua_rawlen(L, 2);
-    const char *sqltail;
     sdb_vm *svm;
+    int rc;
     lua_settop(L,2); /* db,sql is on top of stack for call to newvm */
     svm = newvm(L, db);
 
-    if (sqlite3_prepare_v2(db->db, sql, sql_len, &svm->vm, &sqltail) != SQLITE_OK) {
+    if (!(svm->stmt = stmt_acquire(db, sql, sql_len, &rc))) {
         lua_pushnil(L);
-        lua_pushinteger(L, sqlite3_errcode(db->db));
-        if (cleanupvm(L, svm) == 1)
-            lua_pop(L, 1); /* this should not happen since sqlite3_prepare_v2 will not set ->vm on error */
+        lua_pushinteger(L, rc);
         return 2;
     }
+    svm->vm = svm->stmt->vm;
 
     /* vm already in the stack */
-    lua_pushstring(L, sqltail);
+    lua_pushstring(L, sql + svm->stmt->tail);
     return 2;
 }
 
@@ -1657,8 +1829,9 @@ static int db_do_next_row(lua_State *L, int packed) {
 
     if (svm->temp) {
         /* finalize and check for errors */
-        result = sqlite3_finalize(vm);
+        result = stmt_release(svm->db, svm->stmt);
         svm->vm = NULL;
+        svm->stmt = NULL;
         cleanupvm(L, svm);
     }
     else if (result == SQLITE_DONE) {
@@ -1709,16 +1882,16 @@ static int db_do_rows(lua_State *L, int(*f)(lua_State *)) {
     sdb *db = lsqlite_checkdb(L, 1);
     const char *sql = luaL_checkstring(L, 2);
     sdb_vm *svm;
+    int rc;
     lua_settop(L,2); /* db,sql is on top of stack for call to newvm */
     svm = newvm(L, db);
     svm->temp = 1;
 
-    if (sqlite3_prepare_v2(db->db, sql, -1, &svm->vm, NULL) != SQLITE_OK) {
+    if (!(svm->stmt = stmt_acquire(db, sql, lua_rawlen(L, 2), &rc))) {
         lua_pushstring(L, sqlite3_errmsg(svm->db->db));
-        if (cleanupvm(L, svm) == 1)
-            lua_pop(L, 1); /* this should not happen since sqlite3_prepare_v2 will not set ->vm on error */
         lua_error(L);
     }
+    svm->vm = svm->stmt->vm;
 
     lua_pushcfunction(L, f);
     lua_insert(L, -2);
@@ -1755,6 +1928,34 @@ static int db_close(lua_State *L) {
     return 1;
 }
 
+/*
+** Params: db [, capacity]
+** Returns: previous capacity of the prepared statement cache
+*/
+static int db_cache_size(lua_State *L) {
+    sdb *db = lsqlite_checkdb(L, 1);
+    lua_pushinteger(L, db->cache_capacity);
+    if (!lua_isnoneornil(L, 2)) {
+        db->cache_capacity = luaL_checkinteger(L, 2);
+        if (db->cache_capacity < 0) db->cache_capacity = 0;
+        stmt_trim(db);
+    }
+    return 1;
+}
+
+/*
+** Params: db
+** Returns: hits, misses, cached statements, capacity
+*/
+static int db_cache_stats(lua_State *L) {
+    sdb *db = lsqlite_checkdb(L, 1);
+    lua_pushinteger(L, db->cache_hits);
+    lua_pushinteger(L, db->cache_misses);
+    lua_pushinteger(L, db->cache_count);
+    lua_pushinteger(L, db->cache_capacity);
+    return 4;
+}
+
 static int db_close_vm(lua_State *L) {
     sdb *db = lsqlite_checkdb(L, 1);
     closevms(L, db, lua_toboolean(L, 2));
@@ -2404,11 +2605,271 @@ static int lsqlite_version(lua_State *L) {
     return 1;
 }
 
+/*
+** Read-only VFS for databases stored inside the executable's zip:
+** the host supplies a function that resolves a /zip/ path to a byte
+** range of an open file, which is then mapped so that reads are plain
+** memcpy()s and pages get shared by every process that forks from us.
+** Anything which isn't a /zip/ main database goes to the default vfs.
+*/
+#define ZIPVFS_NAME "zip"
+
+typedef struct zipvfs_file zipvfs_file;
+struct zipvfs_file {
+    sqlite3_file base;
+    char *map;              /* page aligned mapping */
+    size_t mapsize;
+    const char *data;       /* database content within map */
+    sqlite3_int64 size;
+    sqlite3_int64 mmapmax;  /* limit set by PRAGMA mmap_size */
+};
+
+static int (*zipvfs_find)(const char *, int *, int64_t *, int64_t *);
+static sqlite3_vfs *zipvfs_orig;
+static int zipvfs_errno;
+
+void lsqlite3_zipvfs(int find(const char *, int *, int64_t *, int64_t *)) {
+    zipvfs_find = find;
+}
+
+static int zipvfs_iszip(const char *name) {
+    return name && !strncmp(name, "/zip/", 5);
+}
+
+static int zipvfs_close(sqlite3_file *f) {
+    zipvfs_file *z = (zipvfs_file *)f;
+    if (z->map) munmap(z->map, z->mapsize);
+    z->map = 0;
+    return SQLITE_OK;
+}
+
+static int zipvfs_read(sqlite3_file *f, void *buf, int amt, sqlite3_int64 off) {
+    zipvfs_file *z = (zipvfs_file *)f;
+    sqlite3_int64 got;
+    got = off < z->size ? z->size - off : 0;
+    if (got > amt) got = amt;
+    if (got > 0) memcpy(buf, z->data + off, got);
+    if (got < amt) {
+        memset((char *)buf + got, 0, amt - got);
+        return SQLITE_IOERR_SHORT_READ;
+    }
+    return SQLITE_OK;
+}
+
+static int zipvfs_write(sqlite3_file *f, const void *buf, int amt,
+                        sqlite3_int64 off) {
+    return SQLITE_READONLY;
+}
+
+static int zipvfs_truncate(sqlite3_file *f, sqlite3_int64 size) {
+    return SQLITE_READONLY;
+}
+
+static int zipvfs_sync(sqlite3_file *f, int flags) {
+    return SQLITE_OK;
+}
+
+static int zipvfs_file_size(sqlite3_file *f, sqlite3_int64 *size) {
+    *size = ((zipvfs_file *)f)->size;
+    return SQLITE_OK;
+}
+
+static int zipvfs_lock(sqlite3_file *f, int lock) {
+    return SQLITE_OK;
+}
+
+static int zipvfs_check_reserved_lock(sqlite3_file *f, int *res) {
+    *res = 0;
+    return SQLITE_OK;
+}
+
+static int zipvfs_file_control(sqlite3_file *f, int op, void *arg) {
+    zipvfs_file *z = (zipvfs_file *)f;
+    sqlite3_int64 limit;
+    switch (op) {
+        case SQLITE_FCNTL_MMAP_SIZE:
+            limit = *(sqlite3_int64 *)arg;
+            *(sqlite3_int64 *)arg = z->mmapmax;
+            if (limit >= 0) z->mmapmax = limit;
+            return SQLITE_OK;
+        case SQLITE_FCNTL_VFSNAME:
+            *(char **)arg = sqlite3_mprintf("%s", ZIPVFS_NAME);
+            return SQLITE_OK;
+        default:
+            return SQLITE_NOTFOUND;
+    }
+}
+
+static int zipvfs_sector_size(sqlite3_file *f) {
+    return 512;
+}
+
+static int zipvfs_device_characteristics(sqlite3_file *f) {
+    /* nothing can change the content so don't bother with journals */
+    return SQLITE_IOCAP_IMMUTABLE;
+}
+
+static int zipvfs_fetch(sqlite3_file *f, sqlite3_int64 off, int amt, void **pp) {
+    zipvfs_file *z = (zipvfs_file *)f;
+    if (off + amt <= z->mmapmax && off + amt <= z->size) {
+        *pp = (void *)(z->data + off);
+    } else {
+        *pp = 0;
+    }
+    return SQLITE_OK;
+}
+
+static int zipvfs_unfetch(sqlite3_file *f, sqlite3_int64 off, void *p) {
+    return SQLITE_OK;
+}
+
+static const sqlite3_io_methods zipvfs_io_methods = {
+    3,                               /* iVersion */
+    zipvfs_close,                    /* xClose */
+    zipvfs_read,                     /* xRead */
+    zipvfs_write,                    /* xWrite */
+    zipvfs_truncate,                 /* xTruncate */
+    zipvfs_sync,                     /* xSync */
+    zipvfs_file_size,                /* xFileSize */
+    zipvfs_lock,                     /* xLock */
+    zipvfs_lock,                     /* xUnlock */
+    zipvfs_check_reserved_lock,      /* xCheckReservedLock */
+    zipvfs_file_control,             /* xFileControl */
+    zipvfs_sector_size,              /* xSectorSize */
+    zipvfs_device_characteristics,   /* xDeviceCharacteristics */
+    0,                               /* xShmMap */
+    0,                               /* xShmLock */
+    0,                               /* xShmBarrier */
+    0,                               /* xShmUnmap */
+    zipvfs_fetch,                    /* xFetch */
+    zipvfs_unfetch,                  /* xUnfetch */
+};
+
+static int zipvfs_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *f,
+                       int flags, int *outflags) {
+    int fd;
+    int64_t off, size, skew;
+    zipvfs_file *z = (zipvfs_file *)f;
+    if (!zipvfs_iszip(name) || !(flags & SQLITE_OPEN_MAIN_DB))
+        return zipvfs_orig->xOpen(zipvfs_orig, name, f, flags, outflags);
+    memset(z, 0, sizeof(*z));
+    if (zipvfs_find(name, &fd, &off, &size) == -1) {
+        zipvfs_errno = errno;
+        return SQLITE_CANTOPEN;
+    }
+    skew = off & (getgransize() - 1);
+    if (size) {
+        z->mapsize = skew + size;
+        z->map = mmap(0, z->mapsize, PROT_READ, MAP_PRIVATE, fd, off - skew);
+        if (z->map == MAP_FAILED) {
+            z->map = 0;
+            zipvfs_errno = errno;
+            return SQLITE_CANTOPEN;
+        }
+        z->data = z->map + skew;
+    }
+    z->size = size;
+    z->base.pMethods = &zipvfs_io_methods;
+    if (outflags) {
+        *outflags = (flags & ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)) |
+                    SQLITE_OPEN_READONLY;
+    }
+    return SQLITE_OK;
+}
+
+static int zipvfs_delete(sqlite3_vfs *vfs, const char *name, int syncdir) {
+    if (zipvfs_iszip(name)) return SQLITE_READONLY;
+    return zipvfs_orig->xDelete(zipvfs_orig, name, syncdir);
+}
+
+static int zipvfs_access(sqlite3_vfs *vfs, const char *name, int flags,
+                         int *res) {
+    int fd;
+    int64_t off, size;
+    if (!zipvfs_iszip(name))
+        return zipvfs_orig->xAccess(zipvfs_orig, name, flags, res);
+    *res = flags != SQLITE_ACCESS_READWRITE &&
+           zipvfs_find(name, &fd, &off, &size) != -1;
+    return SQLITE_OK;
+}
+
+static int zipvfs_full_pathname(sqlite3_vfs *vfs, const char *name, int n,
+                                char *out) {
+    if (!zipvfs_iszip(name))
+        return zipvfs_orig->xFullPathname(zipvfs_orig, name, n, out);
+    sqlite3_snprintf(n, out, "%s", name);
+    return SQLITE_OK;
+}
+
+static int zipvfs_randomness(sqlite3_vfs *vfs, int n, char *out) {
+    return zipvfs_orig->xRandomness(zipvfs_orig, n, out);
+}
+
+static int zipvfs_sleep(sqlite3_vfs *vfs, int micros) {
+    return zipvfs_orig->xSleep(zipvfs_orig, micros);
+}
+
+static int zipvfs_current_time(sqlite3_vfs *vfs, double *t) {
+    return zipvfs_orig->xCurrentTime(zipvfs_orig, t);
+}
+
+static int zipvfs_get_last_error(sqlite3_vfs *vfs, int n, char *out) {
+    return zipvfs_orig->xGetLastError(zipvfs_orig, n, out);
+}
+
+static int zipvfs_current_time_int64(sqlite3_vfs *vfs, sqlite3_int64 *t) {
+    return zipvfs_orig->xCurrentTimeInt64(zipvfs_orig, t);
+}
+
+static sqlite3_vfs zipvfs = {
+    2,                               /* iVersion */
+    0,                               /* szOsFile */
+    0,                               /* mxPathname */
+    0,                               /* pNext */
+    ZIPVFS_NAME,                     /* zName */
+    0,                               /* pAppData */
+    zipvfs_open,                     /* xOpen */
+    zipvfs_delete,                   /* xDelete */
+    zipvfs_access,                   /* xAccess */
+    zipvfs_full_pathname,            /* xFullPathname */
+    0,                               /* xDlOpen */
+    0,                               /* xDlError */
+    0,                               /* xDlSym */
+    0,                               /* xDlClose */
+    zipvfs_randomness,               /* xRandomness */
+    zipvfs_sleep,                    /* xSleep */
+    zipvfs_current_time,             /* xCurrentTime */
+    zipvfs_get_last_error,           /* xGetLastError */
+    zipvfs_current_time_int64,       /* xCurrentTimeInt64 */
+};
+
+static const char *zipvfs_register(void) {
+    if (!zipvfs_find) return 0;
+    if (!zipvfs_orig) {
+        if (!(zipvfs_orig = sqlite3_vfs_find(0))) return 0;
+        zipvfs.szOsFile = zipvfs_orig->szOsFile;
+        if (zipvfs.szOsFile < (int)sizeof(zipvfs_file))
+            zipvfs.szOsFile = sizeof(zipvfs_file);
+        zipvfs.mxPathname = zipvfs_orig->mxPathname;
+        if (sqlite3_vfs_register(&zipvfs, 0) != SQLITE_OK) {
+            zipvfs_orig = 0;
+            return 0;
+        }
+    }
+    return ZIPVFS_NAME;
+}
+
 static int lsqlite_do_open(lua_State *L, const char *filename, int flags) {
+    const char *vfs = 0;
     sqlite3_initialize(); /* initialize the engine if hasn't been done yet */
     sdb *db = newdb(L); /* create and leave in stack */
 
-    if (sqlite3_open_v2(filename, &db->db, flags, 0) == SQLITE_OK) {
+    if (zipvfs_iszip(filename)) {
+        vfs = zipvfs_register();
+        zipvfs_errno = 0;
+    }
+
+    if (sqlite3_open_v2(filename, &db->db, flags, vfs) == SQLITE_OK) {
         /* database handle already in the stack - return it */
         sqlite3_zipfile_init(db->db, 0, 0);
         return 1;
@@ -2417,7 +2878,15 @@ static int lsqlite_do_open(lua_State *L, const char *filename, int flags) {
     /* failed to open database */
     lua_pushnil(L);                             /* push nil */
     lua_pushinteger(L, sqlite3_errcode(db->db));
-    lua_pushstring(L, sqlite3_errmsg(db->db));  /* push error message */
+    if (vfs && zipvfs_errno == ENOTSUP) {
+        lua_pushfstring(L, "%s is compressed; store it in the zip "
+                        "uncompressed (e.g. zip -0) to open it in place",
+                        filename);
+    } else if (vfs && zipvfs_errno) {
+        lua_pushfstring(L, "%s: %s", filename, strerror(zipvfs_errno));
+    } else {
+        lua_pushstring(L, sqlite3_errmsg(db->db));  /* push error message */
+    }
 
     /* clean things up */
     cleanupdb(L, db);
@@ -2652,6 +3121,8 @@ static const luaL_Reg dblib[] = {
     {"execute",             db_exec                 },
     {"close",               db_close                },
     {"close_vm",            db_close_vm             },
+    {"cache_size",          db_cache_size           },
+    {"cache_stats",         db_cache_stats          },
 
 #ifdef SQLITE_ENABLE_SESSION
     {"create_session",      db_create_session       },
@@ -87,8 +87,10 @@
 #include "libc/sysv/consts/hwcap.h"
 #include "libc/sysv/consts/inaddr.h"
 #include "libc/sysv/consts/ipproto.h"
+#include "libc/sysv/consts/limits.h"
 #include "libc/sysv/consts/madv.h"
 #include "libc/sysv/consts/map.h"
+#include "libc/sysv/consts/msg.h"
 #include "libc/sysv/consts/o.h"
 #include "libc/sysv/consts/poll.h"
 #include "libc/sysv/consts/pr.h"
@@ -97,7 +99,10 @@
 #include "libc/sysv/consts/s.h"
 #include "libc/sysv/consts/sa.h"
 #include "libc/sysv/consts/sig.h"
+#include "libc/sysv/consts/so.h"
 #include "libc/sysv/consts/sock.h"
+#include "libc/sysv/consts/sol.h"
+#include "libc/sysv/consts/tcp.h"
 #include "libc/sysv/consts/termios.h"
 #include "libc/sysv/consts/timer.h"
 #include "libc/sysv/consts/w.h"
@@ -109,6 +114,7 @@
 #include "libc/zip.h"
 #include "net/http/escape.h"
 #include "net/http/http.h"
+#include "net/http/http2.h"
 #include "net/http/ip.h"
 #include "net/http/tokenbucket.h"
 #include "net/http/url.h"
@@ -131,7 +137,9 @@
 #include "third_party/mbedtls/x509_crt.h"
 #include "third_party/musl/netdb.h"
 #include "third_party/zlib/zlib.h"
+#include "third_party/zstd/zstd.h"
 #include "tool/build/lib/case.h"
+#include "tool/net/assetindex.h"
 #include "tool/net/lfinger.h"
 #include "tool/net/lfuncs.h"
 #include "tool/net/ljson.h"
@@ -172,7 +180,24 @@ __static_yoink("blink_xnu_aarch64");    // is apple silicon
 
 //                         XXYYZZ
 #define VERSION          0x030000
-#define HASH_LOAD_FACTOR /* 1. / */ 4
+#define DEFLATE_CACHE_SIZE (16 * 1024 * 1024) /* per arena */
+#define DEFLATE_CACHE_SLOTS 1024
+#define INFLATE_INDEX_SPAN  (1024 * 1024) /* min uncompressed bytes per point */
+#define INFLATE_INDEX_MAX   64 /* points per asset */
+#define INFLATE_INDEX_SLOTS 256
+#define INFLATE_INDEX_POINTS 512 /* per arena */
+#define SENDFILE_THRESHOLD  65536
+#define STREAM_CHUNK_SIZE   65536
+#define PIPELINE_DEPTH      16
+#define MULTIPLEX_OUTPUT    (256 * 1024) /* max body event loop queues */
+#define ACCEPT_SAMPLE_RATE  64 /* accepts per tcp_info reading */
+#define HTTP2_MAX_STREAMS   100
+#define HTTP2_WINDOW        (1024 * 1024) /* receive window we grant */
+#define HTTP2_BUFFER        65536
+#define HTTP2_HEADER_LIST   65536 /* decoded header bytes we accept */
+#define STAT_CACHE_SLOTS    1024
+#define SSL_CACHE_DATA      1024
+#define STAT_CACHE_TTL      1000 /* ms */
 #define READ(F, P, N)    readv(F, &(struct iovec){P, N}, 1)
 #define WRITE(F, P, N)   writev(F, &(struct iovec){P, N}, 1)
 #define AppendCrlf(P)    mempcpy(P, "\r\n", 2)
@@ -208,11 +233,11 @@ __static_yoink("blink_xnu_aarch64");    // is apple silicon
     }                       \
   } while (0)
 
-// letters not used: INOQYnoqwxy
-// digits not used:  0123456789
+// letters not used: Inoqwy
+// digits not used:  013456789
 // puncts not used:  !"#$&'()+,-./;<=>@[\]^_`{|}~
 #define GETOPTS \
-  "*%BEJSVXZabdfghijkmsuvzA:C:D:F:G:H:K:L:M:P:R:T:U:W:c:e:l:p:r:t:w:"
+  "*%2BEJSVXYZabdfghijkmsuvzA:C:D:F:G:H:K:L:M:N:O:P:Q:R:T:U:W:c:e:l:p:r:t:w:x:"
 
 static const uint8_t kGzipHeader[] = {
     0x1F,        // MAGNUM
@@ -239,6 +264,12 @@ static const char *const kAlpn[] = {
     NULL,
 };
 
+static const char *const kAlpnHttp2[] = {
+    "h2",
+    "http/1.1",
+    NULL,
+};
+
 struct Buffer {
   size_t n, c;
   char *p;
@@ -263,6 +294,7 @@ struct DeflateGenerator {
   int t;
   void *b;
   size_t i;
+  size_t k;
   uint32_t c;
   uint32_t z;
   z_stream s;
@@ -287,6 +319,37 @@ static struct Servers {
   } *p;
 } servers;
 
+static struct WorkerPool {
+  int n;
+  bool reuseport;
+  int *fds;  // [n][servers.n] listeners, where slot zero is servers.p
+  struct Worker {
+    int pid;
+    struct timespec born;
+  } *p;
+} workerpool;
+
+static struct Conns {
+  size_t n, c;
+  struct Conn {
+    int fd;
+    bool sniffed;
+    bool closing;
+    int messages;
+    char *buf;   // unconsumed input, or null
+    char *out;   // queued output, or null
+    size_t outi;
+    size_t amtread;
+    struct HttpMessage *msg;  // incomplete parse, or null
+    struct sockaddr_in *server;
+    struct sockaddr_in addr;
+    struct timespec start;
+    struct timespec last;
+  } *p;
+} conns;
+
+static struct Conn *activeconn;
+
 static struct Freelist {
   size_t n, c;
   void **p;
@@ -333,9 +396,9 @@ static struct Redirects {
 
 static struct Assets {
   uint32_t n;
+  struct AssetIndex index;
   struct Asset {
     bool istext;
-    uint32_t hash;
     uint64_t cf;
     uint64_t lf;
     int64_t lastmodified;
@@ -390,6 +453,84 @@ static struct Shared {
   pthread_mutex_t lastmeltdown_mu;
 } *shared;
 
+// compressed variants of stored zip assets, which are shared between
+// processes. it's double buffered so that a zip reload only overwrites
+// the arena that was retired by the reload before it. workers copy the
+// variant out while holding the lock, since a send can outlast reloads,
+// which also means the least recently used variants may be evicted
+static struct DeflateCache {
+  pthread_mutex_t mu;
+  unsigned gen;
+  unsigned tick;  // bumped whenever a variant is used
+  int64_t ino;  // zip whose assets are being cached
+  int64_t zsize;
+  struct DeflateArena {
+    size_t used;  // bytes held by live variants
+    unsigned count;
+    struct DeflateVariant {
+      uint64_t cf;
+      uint32_t crc;
+      uint32_t len;  // compressed size, or zero if slot is empty
+      size_t size;   // uncompressed size
+      size_t off;
+      unsigned tick;  // when it was last used
+    } p[DEFLATE_CACHE_SLOTS];
+  } arena[2];
+  char data[2][DEFLATE_CACHE_SIZE];
+} *deflatecache;
+
+// access point from which a deflate stream can be inflated, which needs
+// the last 32kb of output as a dictionary, and may start mid-byte
+struct InflatePoint {
+  size_t out;  // uncompressed offset
+  size_t in;   // compressed offset of first whole byte
+  int bits;    // number of bits that came from the byte before `in`
+  unsigned char window[32768];
+};
+
+// zran-style access points for large compressed zip assets, so a range
+// request can be served by inflating from the nearest point instead of
+// from the beginning. points are at least INFLATE_INDEX_SPAN bytes apart
+// and spread out further for big assets, so that no asset needs more
+// than INFLATE_INDEX_MAX of them. it's built on the first range request
+// for an asset, and shared between processes. it's double buffered for
+// the same reason as deflatecache
+static struct InflateIndex {
+  pthread_mutex_t mu;
+  unsigned gen;
+  int64_t ino;  // zip whose assets are being indexed
+  int64_t zsize;
+  struct InflateArena {
+    unsigned used;
+    unsigned count;
+    struct InflateEntry {
+      uint64_t cf;
+      uint32_t crc;
+      uint32_t points;  // number of points, or zero if slot is empty
+      unsigned off;
+    } p[INFLATE_INDEX_SLOTS];
+  } arena[2];
+  struct InflatePoint data[2][INFLATE_INDEX_POINTS];
+} *inflateindex;
+
+// metadata of files in -D staging directories, which is shared between
+// processes so that existing files resolve without a system call, and
+// requests for zip assets don't need to stat() each directory. entries
+// expire after STAT_CACHE_TTL milliseconds and are all purged on reload
+static struct StatCache {
+  pthread_mutex_t mu;
+  unsigned gen;
+  struct StatEntry {
+    unsigned gen;
+    uint32_t hash;
+    int dir;          // index of stagedir, or -1 if file doesn't exist
+    int len;          // length of request path
+    int64_t expires;  // monotonic milliseconds
+    struct stat st;
+    char path[192];
+  } p[STAT_CACHE_SLOTS];
+} *statcache;
+
 static const char kCounterNames[] =
 #define C(x) #x "\0"
 #include "tool/net/counters.inc"
@@ -405,12 +546,15 @@ struct ClearedPerMessage {
   bool hascontenttype;
   bool gotcachecontrol;
   bool gotxcontenttypeoptions;
+  bool encoderyielded;
   int frags;
   int statuscode;
   int isyielding;
+  size_t hdrpending;
   char *outbuf;
   char *content;
   size_t gzipped;
+  size_t zstded;
   size_t contentlength;
   char *luaheaderp;
   const char *referrerpolicy;
@@ -420,6 +564,46 @@ struct ClearedPerMessage {
   struct HttpMessage msg;
 } cpm;
 
+struct Http2Stream {
+  uint32_t id;
+  uint32_t seq;    // order in which request finished arriving
+  bool ended;      // client sent END_STREAM
+  bool reset;      // client sent RST_STREAM
+  bool huge;       // payload won't fit in inbuf
+  bool bad;        // malformed header block
+  bool toobig;     // decoded header list exceeds HTTP2_HEADER_LIST
+  bool getlike;    // may omit Content-Length when bodyless
+  int64_t window;  // how many bytes we may send
+  char *head;      // synthesized http/1.1 request line and headers
+  char *body;
+};
+
+// http/2 connection state, where each stream gets served as though it
+// were an http/1.1 message, one at a time, by the same worker process
+static struct Http2 {
+  bool dead;       // can't write to client anymore
+  bool closing;    // can't read from client anymore
+  bool goaway;     // client won't open any more streams
+  bool endstream;  // flag of header block being continued
+  bool responded;  // current stream got a headers frame
+  uint32_t sid;    // stream whose response we're sending
+  uint32_t seq;
+  uint32_t hdrsid;  // stream whose header block is being continued
+  uint32_t lastsid;
+  uint32_t maxframe;
+  int64_t window;      // connection send window
+  int64_t initwindow;  // initial send window of new streams
+  const char *why;
+  size_t n;
+  char *p;      // frames read from client
+  char *block;  // header block fragments
+  struct Hpack hpack;
+  struct {
+    size_t n;
+    struct Http2Stream p[HTTP2_MAX_STREAMS];
+  } streams;
+} h2;
+
 static bool suiteb;
 static bool killed;
 static bool zombied;
@@ -438,11 +622,13 @@ static bool sslcliused;
 static bool loglatency;
 static bool terminated;
 static bool uniprocess;
+static bool multiplex;
 static bool invalidated;
 static bool logmessages;
 static bool isinitialized;
 static bool sslinitialized;
 static bool sslfetchverify;
+static bool http2;
 static bool selfmodifiable;
 static bool interpretermode;
 static bool sslclientverify;
@@ -455,6 +641,9 @@ static bool leakcrashreports;
 static bool hasonhttprequest;
 static bool hasonerror;
 static bool ishandlingrequest;
+static bool ismultiplexing;
+static bool ispipelining;
+static bool multiplexdefer;
 static bool listeningonport443;
 static bool hasonprocesscreate;
 static bool hasonprocessdestroy;
@@ -463,6 +652,7 @@ static bool hasonclientconnection;
 static bool evadedragnetsurveillance;
 
 static int zfd;
+static int zmapfd = -1;
 static int gmtoff;
 static int client;
 static int mainpid;
@@ -475,6 +665,7 @@ static int sslpskindex;
 static int oldloglevel;
 static int messageshandled;
 static int sslticketlifetime;
+static int sslcachesize;
 static uint32_t clientaddrsize;
 
 static char *brand;
@@ -508,7 +699,22 @@ static struct Buffer inbuf_actual;
 static struct Buffer inbuf;
 static struct Buffer oldin;
 static struct Buffer hdrbuf;
+
+// responses to pipelined requests that haven't been sent yet, which go
+// out together in a single writev() before we read from client again.
+// each queued response owns a header buffer in the ring, which is then
+// swapped with hdrbuf, so no allocations happen once the ring is warm
+static struct Pipeline {
+  int n;
+  int iovlen;
+  struct Buffer ring[PIPELINE_DEPTH];
+  char footers[PIPELINE_DEPTH][8];
+  struct iovec iov[PIPELINE_DEPTH * 4];
+} pipeline;
 static struct timeval timeout;
+static int listenbacklog;  // zero means SOMAXCONN
+static int tcpfastopen = 100;
+static int tcpdeferaccept;
 static struct Buffer effectivepath;
 static struct timespec heartbeatinterval;
 
@@ -529,6 +735,31 @@ static mbedtls_ssl_context ssl;
 static mbedtls_ctr_drbg_context rng;
 static mbedtls_ssl_ticket_context ssltick;
 
+// tls sessions negotiated by any worker, so clients that can't present
+// a ticket are still able to resume using their session id. they're
+// serialized by mbedtls_ssl_session_save() into slots threaded on both
+// a hash chain and a least recently used list, which evicts the tail
+static struct SslCache {
+  pthread_mutex_t mu;
+  int n;       // number of slots
+  int m;       // number of buckets, which is a power of two
+  int used;    // number of slots that have ever been used
+  int head;    // most recently used slot, or -1
+  int tail;    // least recently used slot, or -1
+  int *buckets;
+  struct SslCacheEntry {
+    int prev, next;  // lru list
+    int chain;       // next slot in hash bucket, or -1
+    int len;         // size of serialized session
+    int ciphersuite;
+    int compression;
+    int64_t expires;
+    size_t idlen;
+    unsigned char id[32];
+    unsigned char data[SSL_CACHE_DATA];
+  } *p;
+} *sslcache;
+
 static mbedtls_ssl_config confcli;
 static mbedtls_ssl_context sslcli;
 static mbedtls_ctr_drbg_context rngcli;
@@ -536,6 +767,7 @@ static mbedtls_ctr_drbg_context rngcli;
 static struct TlsBio g_bio;
 static char slashpath[PATH_MAX];
 static struct DeflateGenerator dg;
+static ZSTD_DCtx *zdctx;
 
 static char *Route(const char *, size_t, const char *, size_t);
 static char *RouteHost(const char *, size_t, const char *, size_t);
@@ -830,6 +1062,41 @@ static void ProgramSslTicketLifetime(long x) {
   sslticketlifetime = x;
 }
 
+static void ProgramSslSessionCache(long x) {
+  if (!(0 <= x && x <= 1048576)) {
+    FATALF("(cfg) error: bad ssl session cache size: %ld", x);
+  }
+  sslcachesize = x;
+}
+
+static void ProgramListenBacklog(long x) {
+  if (!(0 <= x && x <= 65535)) {
+    FATALF("(cfg) error: bad listen backlog: %ld", x);
+  }
+  listenbacklog = x;
+}
+
+static void ProgramTcpFastOpen(long x) {
+  if (!(0 <= x && x <= 65535)) {
+    FATALF("(cfg) error: bad tcp fast open queue length: %ld", x);
+  }
+  tcpfastopen = x;
+}
+
+static void ProgramTcpDeferAccept(long x) {
+  if (!(0 <= x && x <= 3600)) {
+    FATALF("(cfg) error: bad tcp defer accept seconds: %ld", x);
+  }
+  tcpdeferaccept = x;
+}
+
+static void ProgramWorkerPool(long x) {
+  if (!(0 <= x && x <= 4096)) {
+    FATALF("(cfg) error: bad worker pool size: %ld", x);
+  }
+  workerpool.n = x;
+}
+
 static void ProgramAddr(const char *addr) {
   ssize_t rc;
   int64_t ip;
@@ -1058,6 +1325,7 @@ static void SetDefaults(void) {
   ProgramCache(-1, "must-revalidate");
   ProgramTimeout(60 * 1000);
   ProgramSslTicketLifetime(24 * 60 * 60);
+  ProgramSslSessionCache(1024);
   sslfetchverify = true;
 }
 
@@ -1379,8 +1647,22 @@ static void ReportWorkerResources(int pid, struct rusage *ru) {
   }
 }
 
+static void VacateWorker(int pid) {
+  int i;
+  for (i = 0; i < workerpool.n; ++i) {
+    if (workerpool.p[i].pid == pid) {
+      workerpool.p[i].pid = 0;
+      break;
+    }
+  }
+}
+
 static void HandleWorkerExit(int pid, int ws, struct rusage *ru) {
-  LockInc(&shared->c.connectionshandled);
+  if (workerpool.n) {
+    VacateWorker(pid);
+  } else {
+    LockInc(&shared->c.connectionshandled);
+  }
   unassert(!pthread_mutex_lock(&shared->children_mu));
   rusage_add(&shared->children, ru);
   unassert(!pthread_mutex_unlock(&shared->children_mu));
@@ -1720,7 +2002,7 @@ static void CertsDestroy(void) {
 }
 
 static void WipeServingKeys(void) {
-  if (uniprocess)
+  if (uniprocess || workerpool.n)
     return;
   mbedtls_ssl_ticket_free(&ssltick);
   mbedtls_ssl_key_cert_free(conf.key_cert), conf.key_cert = 0;
@@ -1809,6 +2091,11 @@ static int TlsRoutePsk(void *ctx, mbedtls_ssl_context *ssl,
   return -1;
 }
 
+static bool IsHttp2Negotiated(void) {
+  const char *s;
+  return (s = mbedtls_ssl_get_alpn_protocol(&ssl)) && !strcmp(s, "h2");
+}
+
 static bool TlsSetup(void) {
   int r;
   oldin.p = inbuf.p;
@@ -2118,6 +2405,11 @@ static bool ClientAcceptsGzip(void) {
          HeaderHas(&cpm.msg, inbuf.p, kHttpAcceptEncoding, "gzip", 4);
 }
 
+static bool ClientAcceptsZstd(void) {
+  return cpm.msg.version >= 11 && /* RFC8878 § 7.2 */
+         HeaderHas(&cpm.msg, inbuf.p, kHttpAcceptEncoding, "zstd", 4);
+}
+
 char *FormatUnixHttpDateTime(char *s, int64_t t) {
   struct tm tm;
   gmtime_r(&t, &tm);
@@ -2144,7 +2436,12 @@ static int64_t GetGmtOffset(int64_t t) {
 
 forceinline bool IsCompressed(struct Asset *a) {
   return !a->file &&
-         ZIP_LFILE_COMPRESSIONMETHOD(zmap + a->lf) == kZipCompressionDeflate;
+         ZIP_LFILE_COMPRESSIONMETHOD(zmap + a->lf) != kZipCompressionNone;
+}
+
+forceinline bool IsZstd(struct Asset *a) {
+  return !a->file &&
+         ZIP_LFILE_COMPRESSIONMETHOD(zmap + a->lf) == kZipCompressionZstd;
 }
 
 forceinline int GetMode(struct Asset *a) {
@@ -2152,16 +2449,8 @@ forceinline int GetMode(struct Asset *a) {
 }
 
 forceinline bool IsCompressionMethodSupported(int method) {
-  return method == kZipCompressionNone || method == kZipCompressionDeflate;
-}
-
-static inline unsigned Hash(const void *p, unsigned long n) {
-  unsigned h, i;
-  for (h = i = 0; i < n; i++) {
-    h += ((unsigned char *)p)[i];
-    h *= 0x9e3779b1;
-  }
-  return MAX(1, h);
+  return method == kZipCompressionNone || method == kZipCompressionDeflate ||
+         method == kZipCompressionZstd;
 }
 
 static void FreeAssets(void) {
@@ -2170,6 +2459,7 @@ static void FreeAssets(void) {
     Free(&assets.p[i].lastmodifiedstr);
   }
   Free(&assets.p);
+  DestroyAssetIndex(&assets.index);
   assets.n = 0;
 }
 
@@ -2182,23 +2472,53 @@ static void FreeStrings(struct Strings *l) {
   l->n = 0;
 }
 
-static unsigned long roundup2pow(unsigned long x) {
-  return x > 1 ? 2ul << bsrl(x - 1) : x ? 1 : 0;
+static void InvalidateDeflateCache(void) {
+  struct DeflateArena *a;
+  if (!deflatecache)
+    return;
+  unassert(!pthread_mutex_lock(&deflatecache->mu));
+  if (deflatecache->ino != zst.st_ino || deflatecache->zsize != zst.st_size) {
+    DEBUGF("(zip) invalidating compressed variants cache");
+    deflatecache->ino = zst.st_ino;
+    deflatecache->zsize = zst.st_size;
+    a = deflatecache->arena + (++deflatecache->gen & 1);
+    a->used = 0;
+    a->count = 0;
+    bzero(a->p, sizeof(a->p));
+  }
+  unassert(!pthread_mutex_unlock(&deflatecache->mu));
+}
+
+static void InvalidateInflateIndex(void) {
+  struct InflateArena *a;
+  if (!inflateindex)
+    return;
+  unassert(!pthread_mutex_lock(&inflateindex->mu));
+  if (inflateindex->ino != zst.st_ino || inflateindex->zsize != zst.st_size) {
+    DEBUGF("(zip) invalidating inflate index");
+    inflateindex->ino = zst.st_ino;
+    inflateindex->zsize = zst.st_size;
+    a = inflateindex->arena + (++inflateindex->gen & 1);
+    a->used = 0;
+    a->count = 0;
+    bzero(a->p, sizeof(a->p));
+  }
+  unassert(!pthread_mutex_unlock(&inflateindex->mu));
 }
 
 static void IndexAssets(void) {
+  long i;
   uint64_t cf;
+  uint32_t n;
   struct Asset *p;
   struct timespec lm;
-  uint32_t i, n, m, step, hash;
   DEBUGF("(zip) indexing assets (inode %#lx)", zst.st_ino);
   FreeAssets();
-  CHECK_GE(HASH_LOAD_FACTOR, 2);
   CHECK(READ32LE(zcdir) == kZipCdir64HdrMagic ||
         READ32LE(zcdir) == kZipCdirHdrMagic);
   n = GetZipCdirRecords(zcdir);
-  m = roundup2pow(MAX(1, n) * HASH_LOAD_FACTOR);
-  p = xcalloc(m, sizeof(struct Asset));
+  InitAssetIndex(&assets.index, n);
+  p = xcalloc(assets.index.n, sizeof(struct Asset));
   for (cf = GetZipCdirOffset(zcdir); n--; cf += ZIP_CFILE_HDRSIZE(zmap + cf)) {
     CHECK_EQ(kZipCfileHdrMagic, ZIP_CFILE_MAGIC(zmap + cf));
     if (!IsCompressionMethodSupported(ZIP_CFILE_COMPRESSIONMETHOD(zmap + cf))) {
@@ -2207,14 +2527,11 @@ static void IndexAssets(void) {
             ZIP_CFILE_NAMESIZE(zmap + cf), ZIP_CFILE_NAME(zmap + cf));
       continue;
     }
-    hash = Hash(ZIP_CFILE_NAME(zmap + cf), ZIP_CFILE_NAMESIZE(zmap + cf));
-    step = 0;
-    do {
-      i = (hash + ((step * (step + 1)) >> 1)) & (m - 1);
-      ++step;
-    } while (p[i].hash);
+    if ((i = InsertAssetIndex(&assets.index, ZIP_CFILE_NAME(zmap + cf),
+                              ZIP_CFILE_NAMESIZE(zmap + cf))) == -1) {
+      continue;  // first entry with a given name wins
+    }
     GetZipCfileTimestamps(zmap + cf, &lm, 0, 0, gmtoff);
-    p[i].hash = hash;
     p[i].cf = cf;
     p[i].lf = GetZipCfileOffset(zmap + cf);
     p[i].istext = !!(ZIP_CFILE_INTERNALATTRIBUTES(zmap + cf) & kZipIattrText);
@@ -2222,7 +2539,9 @@ static void IndexAssets(void) {
     p[i].lastmodifiedstr = FormatUnixHttpDateTime(xmalloc(30), lm.tv_sec);
   }
   assets.p = p;
-  assets.n = m;
+  assets.n = assets.index.n;
+  InvalidateDeflateCache();
+  InvalidateInflateIndex();
 }
 
 static bool OpenZip(bool force) {
@@ -2248,6 +2567,7 @@ static bool OpenZip(bool force) {
           zmap = m;
           zsize = n;
           zcdir = d;
+          zmapfd = fd;
           DCHECK(IsZipEocd32(zmap, zsize, zcdir - zmap) == kZipOk ||
                  IsZipEocd64(zmap, zsize, zcdir - zmap) == kZipOk);
           memcpy(&zst, &st, sizeof(st));
@@ -2272,43 +2592,117 @@ static bool OpenZip(bool force) {
 }
 
 static struct Asset *GetAssetZip(const char *path, size_t pathlen) {
-  uint32_t i, step, hash;
+  long i;
   if (pathlen > 1 && path[0] == '/')
     ++path, --pathlen;
-  hash = Hash(path, pathlen);
-  for (step = 0;; ++step) {
-    i = (hash + ((step * (step + 1)) >> 1)) & (assets.n - 1);
-    if (i >= assets.n || !assets.p || !assets.p[i].hash)
-      return NULL;
-    if (hash == assets.p[i].hash &&
-        pathlen == ZIP_CFILE_NAMESIZE(zmap + assets.p[i].cf) &&
-        memcmp(path, ZIP_CFILE_NAME(zmap + assets.p[i].cf), pathlen) == 0) {
-      return &assets.p[i];
-    }
-  }
+  if ((i = FindAssetIndex(&assets.index, path, pathlen)) == -1)
+    return NULL;
+  return &assets.p[i];
+}
+
+// resolves /zip/ database for lsqlite3 to a range of the executable
+static int FindZipDatabase(const char *path, int *fd, int64_t *off,
+                           int64_t *size) {
+  struct Asset *a;
+  if (!startswith(path, "/zip/"))
+    return enoent();
+  path += 4;  // keep the leading slash
+  if (!(a = GetAssetZip(path, strlen(path))))
+    return enoent();
+  if (ZIP_LFILE_COMPRESSIONMETHOD(zmap + a->lf) != kZipCompressionNone)
+    return enotsup();
+  *fd = zmapfd;
+  *off = ZIP_LFILE_CONTENT(zmap + a->lf) - zmap;
+  *size = GetZipLfileUncompressedSize(zmap + a->lf);
+  return 0;
+}
+
+static void InvalidateStatCache(void) {
+  if (!statcache)
+    return;
+  unassert(!pthread_mutex_lock(&statcache->mu));
+  ++statcache->gen;
+  unassert(!pthread_mutex_unlock(&statcache->mu));
+}
+
+static bool GetStatCache(const char *path, size_t pathlen, int *dir,
+                         struct stat *st) {
+  bool ok;
+  uint32_t hash;
+  struct StatEntry *e;
+  if (!statcache || pathlen > sizeof(e->path))
+    return false;
+  hash = HashAssetName(path, pathlen);
+  e = statcache->p + (hash & (STAT_CACHE_SLOTS - 1));
+  unassert(!pthread_mutex_lock(&statcache->mu));
+  if ((ok = e->gen == statcache->gen && e->hash == hash &&
+            e->len == pathlen && !memcmp(e->path, path, pathlen) &&
+            e->dir < (long)stagedirs.n &&
+            timespec_tomillis(timespec_mono()) < e->expires)) {
+    *dir = e->dir;
+    *st = e->st;
+  }
+  unassert(!pthread_mutex_unlock(&statcache->mu));
+  LockInc(ok ? &shared->c.statcachehits : &shared->c.statcachemisses);
+  return ok;
+}
+
+static void PutStatCache(const char *path, size_t pathlen, int dir,
+                         const struct stat *st) {
+  uint32_t hash;
+  struct StatEntry *e;
+  if (!statcache || pathlen > sizeof(e->path))
+    return;
+  hash = HashAssetName(path, pathlen);
+  e = statcache->p + (hash & (STAT_CACHE_SLOTS - 1));
+  unassert(!pthread_mutex_lock(&statcache->mu));
+  e->gen = statcache->gen;
+  e->hash = hash;
+  e->dir = dir;
+  e->len = pathlen;
+  e->expires = timespec_tomillis(timespec_mono()) + STAT_CACHE_TTL;
+  e->st = *st;
+  memcpy(e->path, path, pathlen);
+  unassert(!pthread_mutex_unlock(&statcache->mu));
 }
 
 static struct Asset *GetAssetFile(const char *path, size_t pathlen) {
-  size_t i;
+  int i;
+  char *s;
+  size_t n;
+  struct stat st;
   struct Asset *a;
-  if (stagedirs.n) {
-    a = FreeLater(xcalloc(1, sizeof(struct Asset)));
-    a->file = FreeLater(xmalloc(sizeof(struct File)));
+  if (!stagedirs.n)
+    return NULL;
+  s = 0;
+  if (!GetStatCache(path, pathlen, &i, &st)) {
     for (i = 0; i < stagedirs.n; ++i) {
       LockInc(&shared->c.stats);
-      a->file->path.s = FreeLater(MergePaths(stagedirs.p[i].s, stagedirs.p[i].n,
-                                             path, pathlen, &a->file->path.n));
-      if (stat(a->file->path.s, &a->file->st) != -1) {
-        a->lastmodifiedstr = FormatUnixHttpDateTime(
-            FreeLater(xmalloc(30)),
-            (a->lastmodified = a->file->st.st_mtim.tv_sec));
-        return a;
-      } else {
-        LockInc(&shared->c.statfails);
-      }
+      s = FreeLater(
+          MergePaths(stagedirs.p[i].s, stagedirs.p[i].n, path, pathlen, &n));
+      if (stat(s, &st) != -1)
+        break;
+      LockInc(&shared->c.statfails);
+    }
+    if (i == stagedirs.n) {
+      i = -1;
+      bzero(&st, sizeof(st));
     }
+    PutStatCache(path, pathlen, i, &st);
+  } else if (i != -1) {
+    s = FreeLater(
+        MergePaths(stagedirs.p[i].s, stagedirs.p[i].n, path, pathlen, &n));
   }
-  return NULL;
+  if (i == -1)
+    return NULL;
+  a = FreeLater(xcalloc(1, sizeof(struct Asset) + sizeof(struct File) + 30));
+  a->file = (struct File *)(a + 1);
+  a->file->path.s = s;
+  a->file->path.n = n;
+  a->file->st = st;
+  a->lastmodifiedstr = FormatUnixHttpDateTime(
+      (char *)(a->file + 1), (a->lastmodified = st.st_mtim.tv_sec));
+  return a;
 }
 
 static struct Asset *GetAsset(const char *path, size_t pathlen) {
@@ -2397,6 +2791,29 @@ static bool Inflate(void *dp, size_t dn, const void *sp, size_t sn) {
   return !__inflate(dp, dn, sp, sn);
 }
 
+static ZSTD_DCtx *GetZstdContext(void) {
+  if (!zdctx)
+    zdctx = ZSTD_createDCtx();
+  return zdctx;
+}
+
+static bool Unzstd(void *dp, size_t dn, const void *sp, size_t sn) {
+  ZSTD_DCtx *z;
+  LockInc(&shared->c.zstddecodes);
+  if (!(z = GetZstdContext()))
+    return false;
+  return ZSTD_decompressDCtx(z, dp, dn, sp, sn) == dn;
+}
+
+static bool Decompress(struct Asset *a, void *dp, size_t dn, const void *sp,
+                       size_t sn) {
+  if (IsZstd(a)) {
+    return Unzstd(dp, dn, sp, sn);
+  } else {
+    return Inflate(dp, dn, sp, sn);
+  }
+}
+
 static bool Verify(void *data, size_t size, uint32_t crc) {
   uint32_t got;
   LockInc(&shared->c.verifies);
@@ -2438,8 +2855,8 @@ static void *LoadAsset(struct Asset *a, size_t *out_size) {
     if (size == SIZE_MAX || !(data = malloc(size + 1)))
       return NULL;
     if (IsCompressed(a)) {
-      if (!Inflate(data, size, ZIP_LFILE_CONTENT(zmap + a->lf),
-                   GetZipCfileCompressedSize(zmap + a->cf))) {
+      if (!Decompress(a, data, size, ZIP_LFILE_CONTENT(zmap + a->lf),
+                      GetZipCfileCompressedSize(zmap + a->cf))) {
         free(data);
         return NULL;
       }
@@ -2491,172 +2908,859 @@ static void AppendLogo(void) {
   }
 }
 
-static ssize_t Send(struct iovec *iov, int iovlen) {
-  ssize_t rc;
-  if ((rc = writer(client, iov, iovlen)) == -1) {
-    if (errno == ECONNRESET) {
-      LockInc(&shared->c.writeresets);
-      DEBUGF("(rsp) %s write reset", DescribeClient());
-    } else if (errno == EAGAIN) {
-      LockInc(&shared->c.writetimeouts);
-      WARNF("(rsp) %s write timeout", DescribeClient());
-      errno = 0;
+static void HandleSendError(void) {
+  if (errno == ECONNRESET) {
+    LockInc(&shared->c.writeresets);
+    DEBUGF("(rsp) %s write reset", DescribeClient());
+  } else if (errno == EAGAIN) {
+    LockInc(&shared->c.writetimeouts);
+    WARNF("(rsp) %s write timeout", DescribeClient());
+    errno = 0;
+  } else {
+    LockInc(&shared->c.writeerrors);
+    if (errno == EBADF) {  // don't warn on close/bad fd
+      DEBUGF("(rsp) %s write badf", DescribeClient());
     } else {
-      LockInc(&shared->c.writeerrors);
-      if (errno == EBADF) {  // don't warn on close/bad fd
-        DEBUGF("(rsp) %s write badf", DescribeClient());
-      } else {
-        WARNF("(rsp) %s write error: %m", DescribeClient());
-      }
+      WARNF("(rsp) %s write error: %m", DescribeClient());
     }
-    connectionclose = true;
   }
-  return rc;
-}
-
-static bool IsSslCompressed(void) {
-  return usingssl && ssl.session->compression;
+  connectionclose = true;
 }
 
-static char *CommitOutput(char *p) {
-  uint32_t crc;
-  size_t outbuflen;
-  if (!cpm.contentlength) {
-    outbuflen = appendz(cpm.outbuf).i;
-    if (cpm.istext && !cpm.isyielding && outbuflen >= 100) {
-      if (!IsTiny() && !IsSslCompressed()) {
-        p = stpcpy(p, "Vary: Accept-Encoding\r\n");
-      }
-      if (!IsTiny() &&            //
-          !IsSslCompressed() &&   //
-          ClientAcceptsGzip() &&  //
-          !ShouldAvoidGzip()) {
-        cpm.gzipped = outbuflen;
-        crc = crc32_z(0, cpm.outbuf, outbuflen);
-        WRITE32LE(gzip_footer + 0, crc);
-        WRITE32LE(gzip_footer + 4, outbuflen);
-        cpm.content =
-            FreeLater(Deflate(cpm.outbuf, outbuflen, &cpm.contentlength));
-        DropOutput();
-      } else {
-        UseOutput();
-      }
-    } else {
-      UseOutput();
-    }
-  } else {
-    DropOutput();
+static void FlushPipeline(void) {
+  int iovlen;
+  if (!pipeline.n)
+    return;
+  DEBUGF("(rsp) %s sending %d pipelined responses", DescribeClient(),
+         pipeline.n);
+  iovlen = pipeline.iovlen;
+  pipeline.n = 0;
+  pipeline.iovlen = 0;
+  LockInc(&shared->c.pipelineflushes);
+  if (writer(client, pipeline.iov, iovlen) == -1) {
+    HandleSendError();
   }
-  return p;
 }
 
-static char *ServeDefaultErrorPage(char *p, unsigned code, const char *reason,
-                                   const char *details) {
-  p = AppendContentType(p, "text/html; charset=UTF-8");
-  reason = FreeLater(EscapeHtml(reason, -1, 0));
-  appends(&cpm.outbuf, "\
-<!doctype html>\r\n\
-<title>");
-  appendf(&cpm.outbuf, "%d %s", code, reason);
-  appends(&cpm.outbuf, "\
-</title>\r\n\
-<style>\r\n\
-html { color: #111; font-family: sans-serif; }\r\n\
-img { vertical-align: middle; }\r\n\
-</style>\r\n\
-<h1>\r\n");
-  AppendLogo();
-  appendf(&cpm.outbuf, "%d %s\r\n", code, reason);
-  appends(&cpm.outbuf, "</h1>\r\n");
-  if (details) {
-    appendf(&cpm.outbuf, "<pre>%s</pre>\r\n",
-            FreeLater(EscapeHtml(details, -1, 0)));
+static ssize_t Send(struct iovec *iov, int iovlen) {
+  ssize_t rc;
+  FlushPipeline();
+  if ((rc = writer(client, iov, iovlen)) == -1) {
+    HandleSendError();
   }
-  UseOutput();
-  return p;
+  return rc;
 }
 
-static char *ServeErrorImplDefault(unsigned code, const char *reason,
-                                   const char *details) {
+// sends http/2 frame whose payload is iov[1..iovlen), where iov[0] is
+// reserved for the frame header
+static bool SendHttp2Frame(int type, int flags, uint32_t sid,
+                           struct iovec *iov, int iovlen) {
+  int i;
   size_t n;
-  char *p, *s;
-  struct Asset *a;
-  LockInc(&shared->c.errors);
-  DropOutput();
-  p = SetStatus(code, reason);
-  s = xasprintf("/%d.html", code);
-  a = GetAsset(s, strlen(s));
-  free(s);
-  if (!a) {
-    return ServeDefaultErrorPage(p, code, reason, details);
-  } else if (a->file) {
-    LockInc(&shared->c.slurps);
-    cpm.content = FreeLater(xslurp(a->file->path.s, &cpm.contentlength));
-    return AppendContentType(p, "text/html; charset=utf-8");
-  } else {
-    cpm.content = (char *)ZIP_LFILE_CONTENT(zmap + a->lf);
-    cpm.contentlength = GetZipCfileCompressedSize(zmap + a->cf);
-    if (IsCompressed(a)) {
-      n = GetZipLfileUncompressedSize(zmap + a->lf);
-      if ((s = FreeLater(malloc(n))) &&
-          Inflate(s, n, cpm.content, cpm.contentlength)) {
-        cpm.content = s;
-        cpm.contentlength = n;
-      } else {
-        return ServeDefaultErrorPage(p, code, reason, details);
-      }
-    }
-    if (Verify(cpm.content, cpm.contentlength, ZIP_LFILE_CRC32(zmap + a->lf))) {
-      return AppendContentType(p, "text/html; charset=utf-8");
-    } else {
-      return ServeDefaultErrorPage(p, code, reason, details);
-    }
+  unsigned char hdr[kHttp2FrameHeader];
+  if (h2.dead)
+    return false;
+  for (n = 0, i = 1; i < iovlen; ++i) {
+    n += iov[i].iov_len;
+  }
+  hdr[0] = n >> 16;
+  hdr[1] = n >> 8;
+  hdr[2] = n;
+  hdr[3] = type;
+  hdr[4] = flags;
+  WRITE32BE(hdr + 5, sid);
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  if (writer(client, iov, iovlen) == -1) {
+    HandleSendError();
+    h2.dead = true;
+    return false;
   }
+  return true;
 }
 
-static char *GetLuaResponse(void) {
-  return cpm.luaheaderp ? cpm.luaheaderp : SetStatus(200, "OK");
+static bool SendHttp2Small(int type, int flags, uint32_t sid, const void *p,
+                           size_t n) {
+  struct iovec iov[2];
+  iov[1].iov_base = (void *)p;
+  iov[1].iov_len = n;
+  return SendHttp2Frame(type, flags, sid, iov, 2);
 }
 
-static char *ServeErrorImpl(unsigned code, const char *reason,
-                            const char *details) {
-  lua_State *L = GL;
-  if (hasonerror) {
-    lua_getglobal(L, "OnError");
-    lua_pushinteger(L, code);
-    lua_pushstring(L, reason);
-    lua_pushstring(L, details);
-    if (LuaCallWithTrace(L, 3, 0, NULL) == LUA_OK) {
-      return CommitOutput(GetLuaResponse());
-    } else {
-      return ServeErrorImplDefault(code, reason, details);
-    }
-  } else {
-    return ServeErrorImplDefault(code, reason, details);
-  }
+static void SendHttp2RstStream(uint32_t sid, uint32_t code) {
+  unsigned char b[4];
+  WRITE32BE(b, code);
+  SendHttp2Small(kHttp2RstStream, 0, sid, b, sizeof(b));
 }
 
-static char *ServeErrorWithPath(unsigned code, const char *reason,
-                                const char *path, size_t pathlen) {
-  ERRORF("(srvr) server error: %d %s %`'.*s", code, reason, pathlen, path);
-  return ServeErrorImpl(code, reason, NULL);
+static void SendHttp2WindowUpdate(uint32_t sid, uint32_t n) {
+  unsigned char b[4];
+  WRITE32BE(b, n);
+  SendHttp2Small(kHttp2WindowUpdate, 0, sid, b, sizeof(b));
 }
 
-static char *ServeErrorWithDetail(unsigned code, const char *reason,
-                                  const char *details) {
-  ERRORF("(srvr) server error: %d %s", code, reason);
-  return ServeErrorImpl(code, reason, details);
+// tears down http/2 connection due to client breaking the protocol
+static void Http2Error(uint32_t code, const char *reason) {
+  unsigned char b[8];
+  if (h2.dead)
+    return;
+  LockInc(&shared->c.badmessages);
+  INFOF("(clnt) %s http/2 %s", DescribeClient(), reason);
+  WRITE32BE(b, h2.lastsid);
+  WRITE32BE(b + 4, code);
+  SendHttp2Small(kHttp2Goaway, 0, 0, b, sizeof(b));
+  h2.dead = true;
+  h2.closing = true;
+  h2.why = "protocol error";
 }
 
-static char *ServeError(unsigned code, const char *reason) {
-  return ServeErrorWithDetail(code, reason, NULL);
+static struct Http2Stream *GetHttp2Stream(uint32_t id) {
+  size_t i;
+  for (i = 0; i < h2.streams.n; ++i) {
+    if (h2.streams.p[i].id == id) {
+      return h2.streams.p + i;
+    }
+  }
+  return 0;
 }
 
-static char *ServeFailure(unsigned code, const char *reason) {
-  char method[9] = {0};
-  WRITE64LE(method, cpm.msg.method);
-  ERRORF("(srvr) failure: %d %s %s HTTP%02d %s %`'.*s %`'.*s %`'.*s %`'.*s",
-         code, reason, DescribeClient(), cpm.msg.version, method,
+static void DropHttp2Stream(uint32_t id) {
+  struct Http2Stream *s;
+  if ((s = GetHttp2Stream(id))) {
+    free(s->head);
+    free(s->body);
+    *s = h2.streams.p[--h2.streams.n];
+  }
+}
+
+// returns true if header is specific to an http/1.1 connection
+static bool IsHttp2Hop(const char *k, size_t n) {
+  int i;
+  static const char *const kHop[] = {
+      "connection",        "keep-alive", "proxy-connection",
+      "transfer-encoding", "upgrade",    "te",
+  };
+  for (i = 0; i < ARRAYLEN(kHop); ++i) {
+    if (strlen(kHop[i]) == n && !strncasecmp(kHop[i], k, n)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct Http2Request {
+  struct Http2Stream *s;
+  bool regular;
+  size_t listsize;  // name + value + 32 per field, as rfc7541 §4.1 counts
+  char *method, *path, *scheme, *authority, *cookie, *fields;
+};
+
+static bool IsHttp2Name(const char *k, size_t n, const char *s) {
+  return strlen(s) == n && !memcmp(k, s, n);
+}
+
+static int OnHttp2Header(void *arg, const char *k, size_t kn, const char *v,
+                         size_t vn) {
+  size_t i;
+  char **pseudo;
+  struct Http2Request *r = arg;
+  if (!r->s || r->s->bad || r->s->toobig)
+    return 0;  // keep decoding so hpack table stays in sync
+  if ((r->listsize += kn + vn + 32) > HTTP2_HEADER_LIST) {
+    r->s->toobig = true;  // stop buffering and answer 431 later
+    return 0;
+  }
+  for (i = 0; i < vn; ++i) {
+    if (!v[i] || v[i] == '\r' || v[i] == '\n') {
+      goto Malformed;
+    }
+  }
+  if (kn && k[0] == ':') {
+    if (r->regular)
+      goto Malformed;
+    if (IsHttp2Name(k, kn, ":method")) {
+      pseudo = &r->method;
+    } else if (IsHttp2Name(k, kn, ":path")) {
+      pseudo = &r->path;
+    } else if (IsHttp2Name(k, kn, ":scheme")) {
+      pseudo = &r->scheme;
+    } else if (IsHttp2Name(k, kn, ":authority")) {
+      pseudo = &r->authority;
+    } else {
+      goto Malformed;
+    }
+    if (*pseudo || !vn)
+      goto Malformed;
+    appendd(pseudo, v, vn);
+    return 0;
+  }
+  r->regular = true;
+  if (!kn)
+    goto Malformed;
+  for (i = 0; i < kn; ++i) {
+    if (!kHttpToken[k[i] & 255] || ('A' <= k[i] && k[i] <= 'Z')) {
+      goto Malformed;
+    }
+  }
+  if (IsHttp2Hop(k, kn) ||                    //
+      IsHttp2Name(k, kn, "content-length") ||  // we compute it
+      IsHttp2Name(k, kn, "expect") ||          // body already arrived
+      (IsHttp2Name(k, kn, "host") && r->authority)) {
+    return 0;
+  }
+  if (IsHttp2Name(k, kn, "cookie")) {
+    if (r->cookie)
+      appends(&r->cookie, "; ");
+    appendd(&r->cookie, v, vn);
+    return 0;
+  }
+  appendd(&r->fields, k, kn);
+  appends(&r->fields, ": ");
+  appendd(&r->fields, v, vn);
+  appends(&r->fields, "\r\n");
+  return 0;
+Malformed:
+  r->s->bad = true;
+  return 0;
+}
+
+static bool IsValidHttp2Request(struct Http2Request *r) {
+  size_t i, n;
+  if (!r->method || !r->path)
+    return false;
+  for (n = appendz(r->method).i, i = 0; i < n; ++i) {
+    if (!kHttpToken[r->method[i] & 255]) {
+      return false;
+    }
+  }
+  for (n = appendz(r->path).i, i = 0; i < n; ++i) {
+    if ((r->path[i] & 255) <= ' ' || r->path[i] == 127) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// turns decoded header block into http/1.1 request head
+static void FinishHttp2Request(struct Http2Request *r) {
+  struct Http2Stream *s = r->s;
+  if (s->toobig)
+    return;
+  if (!s->bad && !IsValidHttp2Request(r))
+    s->bad = true;
+  if (s->bad) {
+    LockInc(&shared->c.badmessages);
+    SendHttp2RstStream(s->id, kHttp2ProtocolError);
+    DropHttp2Stream(s->id);
+    return;
+  }
+  s->getlike = !strcmp(r->method, "GET") || !strcmp(r->method, "HEAD");
+  appends(&s->head, r->method);
+  appends(&s->head, " ");
+  appends(&s->head, r->path);
+  appends(&s->head, " HTTP/1.1\r\n");
+  if (r->authority) {
+    appends(&s->head, "Host: ");
+    appends(&s->head, r->authority);
+    appends(&s->head, "\r\n");
+  }
+  if (r->fields)
+    appends(&s->head, r->fields);
+  if (r->cookie) {
+    appends(&s->head, "Cookie: ");
+    appends(&s->head, r->cookie);
+    appends(&s->head, "\r\n");
+  }
+}
+
+static void DecodeHttp2Headers(void) {
+  int rc;
+  bool end, refused;
+  uint32_t sid;
+  struct Http2Stream *s;
+  struct Http2Request r = {0};
+  sid = h2.hdrsid;
+  end = h2.endstream;
+  h2.hdrsid = 0;
+  refused = false;
+  if ((s = GetHttp2Stream(sid))) {
+    if (s->ended || !end) {  // trailers must end stream
+      Http2Error(kHttp2ProtocolError, "sent bad trailers");
+      return;
+    }
+  } else if (sid > h2.lastsid) {
+    h2.lastsid = sid;
+    if (h2.streams.n < HTTP2_MAX_STREAMS && !h2.goaway) {
+      LockInc(&shared->c.http2streams);
+      r.s = s = h2.streams.p + h2.streams.n++;
+      bzero(s, sizeof(*s));
+      s->id = sid;
+      s->window = h2.initwindow;
+    } else {
+      refused = true;
+    }
+  } else {
+    Http2Error(kHttp2StreamClosed, "sent headers on closed stream");
+    return;
+  }
+  rc = DecodeHpack(&h2.hpack, h2.block, appendz(h2.block).i, OnHttp2Header,
+                   &r);
+  appendr(&h2.block, 0);
+  if (rc) {
+    Http2Error(kHttp2CompressionError, "sent bad hpack");
+  } else if (refused) {
+    SendHttp2RstStream(sid, kHttp2RefusedStream);
+  } else if (r.s) {
+    FinishHttp2Request(&r);
+  }
+  if (!h2.dead && (s = GetHttp2Stream(sid)) && end) {
+    s->ended = true;
+    s->seq = ++h2.seq;
+  }
+  free(r.method);
+  free(r.path);
+  free(r.scheme);
+  free(r.authority);
+  free(r.cookie);
+  free(r.fields);
+}
+
+static void OnHttp2HeaderBlock(uint32_t sid, int flags, const char *p,
+                               size_t n) {
+  if (appendz(h2.block).i + n > inbuf.n) {
+    Http2Error(kHttp2EnhanceYourCalm, "sent too many headers");
+    return;
+  }
+  appendd(&h2.block, p, n);
+  h2.hdrsid = sid;
+  if (flags & kHttp2FlagEndHeaders)
+    DecodeHttp2Headers();
+}
+
+static void OnHttp2Data(uint32_t sid, int flags, const char *p, size_t n,
+                        size_t len) {
+  struct Http2Stream *s;
+  if (sid > h2.lastsid) {
+    Http2Error(kHttp2ProtocolError, "sent data on idle stream");
+    return;
+  }
+  if (len)
+    SendHttp2WindowUpdate(0, len);
+  if (!(s = GetHttp2Stream(sid)))
+    return;  // stream was refused or reset
+  if (s->ended) {
+    SendHttp2RstStream(sid, kHttp2StreamClosed);
+    s->reset = true;
+    if (sid != h2.sid)
+      DropHttp2Stream(sid);
+    return;
+  }
+  if (!s->huge && !s->toobig) {
+    if (appendz(s->body).i + n <= inbuf.n) {
+      appendd(&s->body, p, n);
+    } else {
+      s->huge = true;
+      Free(&s->body);
+    }
+  }
+  if (flags & kHttp2FlagEndStream) {
+    s->ended = true;
+    s->seq = ++h2.seq;
+  } else if (len) {
+    SendHttp2WindowUpdate(sid, len);
+  }
+}
+
+static void OnHttp2Settings(int flags, const char *p, size_t n) {
+  size_t i;
+  uint32_t x;
+  if (flags & kHttp2FlagAck)
+    return;
+  if (n % 6) {
+    Http2Error(kHttp2FrameSizeError, "sent bad settings");
+    return;
+  }
+  for (i = 0; i < n; i += 6) {
+    x = READ32BE(p + i + 2);
+    switch (READ16BE(p + i)) {
+      case kHttp2SettingsInitialWindowSize:
+        if (x > kHttp2MaxWindow) {
+          Http2Error(kHttp2FlowControlError, "sent bad window size");
+          return;
+        }
+        for (size_t j = 0; j < h2.streams.n; ++j) {
+          if (h2.streams.p[j].window + ((int64_t)x - h2.initwindow) >
+              kHttp2MaxWindow) {
+            Http2Error(kHttp2FlowControlError, "overflowed window");
+            return;
+          }
+        }
+        for (size_t j = 0; j < h2.streams.n; ++j) {
+          h2.streams.p[j].window += (int64_t)x - h2.initwindow;
+        }
+        h2.initwindow = x;
+        break;
+      case kHttp2SettingsMaxFrameSize:
+        if (x < kHttp2DefaultFrameSize || x > 0xffffff) {
+          Http2Error(kHttp2ProtocolError, "sent bad frame size");
+          return;
+        }
+        h2.maxframe = x;
+        break;
+      default:
+        break;  // we never index or push so nothing else matters
+    }
+  }
+  SendHttp2Small(kHttp2Settings, kHttp2FlagAck, 0, 0, 0);
+}
+
+static void OnHttp2WindowUpdate(uint32_t sid, uint32_t x) {
+  struct Http2Stream *s;
+  if (!x) {
+    Http2Error(kHttp2ProtocolError, "sent zero window update");
+  } else if (!sid) {
+    if ((h2.window += x) > kHttp2MaxWindow) {
+      Http2Error(kHttp2FlowControlError, "overflowed window");
+    }
+  } else if ((s = GetHttp2Stream(sid))) {
+    if ((s->window += x) > kHttp2MaxWindow) {
+      SendHttp2RstStream(sid, kHttp2FlowControlError);
+      s->reset = true;
+      if (sid != h2.sid)
+        DropHttp2Stream(sid);
+    }
+  }
+}
+
+static void OnHttp2Frame(int type, int flags, uint32_t sid, const char *p,
+                         size_t n) {
+  size_t len;
+  struct Http2Stream *s;
+  if (h2.hdrsid && (type != kHttp2Continuation || sid != h2.hdrsid)) {
+    Http2Error(kHttp2ProtocolError, "interrupted header block");
+    return;
+  }
+  len = n;
+  if ((flags & kHttp2FlagPadded) &&
+      (type == kHttp2Data || type == kHttp2Headers)) {
+    if (!n || (p[0] & 255) >= n) {
+      Http2Error(kHttp2ProtocolError, "sent bad padding");
+      return;
+    }
+    n -= 1 + (p[0] & 255);
+    ++p;
+  }
+  switch (type) {
+    case kHttp2Data:
+      if (!sid)
+        goto MissingStream;
+      OnHttp2Data(sid, flags, p, n, len);
+      break;
+    case kHttp2Headers:
+      if (!sid || !(sid & 1))
+        goto MissingStream;
+      if (flags & kHttp2FlagPriority) {
+        if (n < 5)
+          goto BadSize;
+        p += 5;
+        n -= 5;
+      }
+      h2.endstream = !!(flags & kHttp2FlagEndStream);
+      OnHttp2HeaderBlock(sid, flags, p, n);
+      break;
+    case kHttp2Continuation:
+      if (!h2.hdrsid) {
+        Http2Error(kHttp2ProtocolError, "sent stray continuation");
+        return;
+      }
+      OnHttp2HeaderBlock(sid, flags, p, n);
+      break;
+    case kHttp2Priority:
+      if (!sid)
+        goto MissingStream;
+      if (n != 5)
+        goto BadSize;
+      break;
+    case kHttp2RstStream:
+      if (!sid)
+        goto MissingStream;
+      if (n != 4)
+        goto BadSize;
+      if ((s = GetHttp2Stream(sid))) {
+        s->reset = true;
+        if (sid != h2.sid)
+          DropHttp2Stream(sid);
+      }
+      break;
+    case kHttp2Settings:
+      if (sid)
+        goto MissingStream;
+      OnHttp2Settings(flags, p, n);
+      break;
+    case kHttp2PushPromise:
+      Http2Error(kHttp2ProtocolError, "sent push promise");
+      break;
+    case kHttp2Ping:
+      if (sid)
+        goto MissingStream;
+      if (n != 8)
+        goto BadSize;
+      if (!(flags & kHttp2FlagAck))
+        SendHttp2Small(kHttp2Ping, kHttp2FlagAck, 0, p, n);
+      break;
+    case kHttp2Goaway:
+      if (sid)
+        goto MissingStream;
+      h2.goaway = true;
+      h2.why = "goaway";
+      break;
+    case kHttp2WindowUpdate:
+      if (n != 4)
+        goto BadSize;
+      OnHttp2WindowUpdate(sid, READ32BE(p) & 0x7fffffff);
+      break;
+    default:
+      break;  // extension frames must be ignored
+  }
+  return;
+MissingStream:
+  Http2Error(kHttp2ProtocolError, "sent frame on wrong stream");
+  return;
+BadSize:
+  Http2Error(kHttp2FrameSizeError, "sent frame of wrong size");
+}
+
+// handles complete frames that have been read from client
+static void ProcessHttp2(void) {
+  size_t i, n;
+  const char *p;
+  for (i = 0; !h2.dead && h2.n - i >= kHttp2FrameHeader;
+       i += kHttp2FrameHeader + n) {
+    p = h2.p + i;
+    n = (p[0] & 255) << 16 | (p[1] & 255) << 8 | (p[2] & 255);
+    if (n > kHttp2DefaultFrameSize) {
+      Http2Error(kHttp2FrameSizeError, "sent frame that's too large");
+      break;
+    }
+    if (h2.n - i < kHttp2FrameHeader + n)
+      break;
+    OnHttp2Frame(p[3] & 255, p[4] & 255, READ32BE(p + 5) & 0x7fffffff,
+                 p + kHttp2FrameHeader, n);
+  }
+  if (h2.dead) {
+    h2.n = 0;
+  } else {
+    memmove(h2.p, h2.p + i, h2.n - i);
+    h2.n -= i;
+  }
+}
+
+// reads more frames from client, returning false if we should hang up
+static bool ReadHttp2(void) {
+  ssize_t rc;
+  for (;;) {
+    if ((rc = reader(client, h2.p + h2.n, HTTP2_BUFFER - h2.n)) > 0) {
+      DEBUGF("(stat) %s read %,zd bytes", DescribeClient(), rc);
+      h2.n += rc;
+      return true;
+    } else if (!rc) {
+      h2.dead = true;
+      h2.why = "disconnect";
+    } else if (errno == EINTR) {
+      LockInc(&shared->c.readinterrupts);
+      errno = 0;
+      if (!killed && !terminated && !meltdown)
+        continue;
+    } else if (errno == EAGAIN) {
+      LockInc(&shared->c.readtimeouts);
+      h2.why = "read timeout";
+    } else if (errno == ECONNRESET) {
+      LockInc(&shared->c.readresets);
+      h2.dead = true;
+      h2.why = "read reset";
+    } else {
+      LockInc(&shared->c.readerrors);
+      WARNF("(clnt) %s read error: %m", DescribeClient());
+      h2.dead = true;
+      h2.why = "read error";
+    }
+    h2.closing = true;
+    return false;
+  }
+}
+
+// reads and handles frames while we're blocked on flow control
+static bool PumpHttp2(void) {
+  if (h2.closing || !ReadHttp2())
+    return false;
+  ProcessHttp2();
+  return !h2.dead;
+}
+
+// converts http/1.1 response head into an hpack header block
+static char *EncodeHttp2Head(char *q, const char *p, size_t n) {
+  size_t kn, vn;
+  const char *c, *e, *l, *v;
+  e = p + n;
+  if (n < 12 || !(l = memchr(p, '\n', n)))
+    return q;
+  q = EncodeHpack(q, ":status", 7, p + 9, 3);
+  for (p = l + 1; p < e && (l = memchr(p, '\n', e - p)); p = l + 1) {
+    if (!(c = memchr(p, ':', l - p)))
+      continue;
+    kn = c - p;
+    for (v = c + 1; v < l && (*v == ' ' || *v == '\t'); ++v) {
+    }
+    vn = l - v;
+    if (vn && v[vn - 1] == '\r')
+      --vn;
+    if (!IsHttp2Hop(p, kn)) {
+      q = EncodeHpack(q, p, kn, v, vn);
+    }
+  }
+  return q;
+}
+
+// sends part of the response to the current http/2 stream, where head
+// is the http/1.1 message head that'd otherwise have been transmitted
+static ssize_t SendHttp2(const char *head, size_t headlen,
+                         const struct iovec *body, int bodylen, bool end) {
+  int i, k, flags;
+  struct iovec v[8];
+  struct Http2Stream *s;
+  char *b, *q;
+  size_t n, m, off, sent, total;
+  if (!(s = GetHttp2Stream(h2.sid)) || s->reset || h2.dead)
+    return -1;
+  for (total = i = 0; i < bodylen; ++i) {
+    total += body[i].iov_len;
+  }
+  if (headlen) {
+    b = xmalloc(headlen * 4 + 64);
+    m = (q = EncodeHttp2Head(b, head, headlen)) - b;
+    for (off = 0;; off += n) {
+      n = MIN(m - off, h2.maxframe);
+      flags = off + n == m ? kHttp2FlagEndHeaders : 0;
+      if (!off && end && !total)
+        flags |= kHttp2FlagEndStream;
+      v[1].iov_base = b + off;
+      v[1].iov_len = n;
+      if (!SendHttp2Frame(off ? kHttp2Continuation : kHttp2Headers, flags,
+                          h2.sid, v, 2)) {
+        free(b);
+        return -1;
+      }
+      if (off + n == m)
+        break;
+    }
+    free(b);
+    h2.responded = true;
+  }
+  if (!total) {
+    if (end && !headlen &&
+        !SendHttp2Small(kHttp2Data, kHttp2FlagEndStream, h2.sid, 0, 0)) {
+      return -1;
+    }
+    return 0;
+  }
+  for (i = 0, off = 0, sent = 0; sent < total; sent += n) {
+    while (h2.window <= 0 || s->window <= 0) {
+      if (!PumpHttp2() || !(s = GetHttp2Stream(h2.sid)) || s->reset) {
+        return -1;
+      }
+    }
+    n = MIN(MIN(total - sent, h2.maxframe), MIN(h2.window, s->window));
+    for (k = 1, m = 0; m < n; ++k) {
+      while (off == body[i].iov_len) {
+        ++i;
+        off = 0;
+      }
+      v[k].iov_base = (char *)body[i].iov_base + off;
+      v[k].iov_len = MIN(n - m, body[i].iov_len - off);
+      off += v[k].iov_len;
+      m += v[k].iov_len;
+    }
+    flags = end && sent + n == total ? kHttp2FlagEndStream : 0;
+    if (!SendHttp2Frame(kHttp2Data, flags, h2.sid, v, k))
+      return -1;
+    h2.window -= n;
+    s->window -= n;
+  }
+  return sent;
+}
+
+// sends piece of a streamed response body, which is framed as a chunk
+// for http/1.1 clients, along with the message header if it's pending
+static ssize_t SendChunk(struct iovec v[3], size_t size) {
+  ssize_t rc;
+  struct iovec iov[6];
+  char *s, chunkbuf[23];
+  if (h2.sid) {
+    if ((rc = SendHttp2(hdrbuf.p, cpm.hdrpending, v, 3, false)) != -1)
+      cpm.hdrpending = 0;
+    return rc;
+  }
+  bzero(iov, sizeof(iov));
+  iov[0].iov_base = hdrbuf.p;
+  iov[0].iov_len = cpm.hdrpending;
+  memcpy(iov + 2, v, sizeof(*v) * 3);
+  if (cpm.msg.version >= 11) {
+    s = chunkbuf;
+    s += uint64toarray_radix16(size, s);
+    s = AppendCrlf(s);
+    iov[1].iov_base = chunkbuf;
+    iov[1].iov_len = s - chunkbuf;
+    iov[5].iov_base = "\r\n";
+    iov[5].iov_len = 2;
+  }
+  if ((rc = Send(iov, 6)) != -1)
+    cpm.hdrpending = 0;
+  return rc;
+}
+
+static bool IsSslCompressed(void) {
+  return usingssl && ssl.session->compression;
+}
+
+static char *CommitOutput(char *p) {
+  uint32_t crc;
+  size_t outbuflen;
+  if (!cpm.contentlength) {
+    outbuflen = appendz(cpm.outbuf).i;
+    if (cpm.istext && !cpm.isyielding && outbuflen >= 100) {
+      if (!IsTiny() && !IsSslCompressed()) {
+        p = stpcpy(p, "Vary: Accept-Encoding\r\n");
+      }
+      if (!IsTiny() &&            //
+          !IsSslCompressed() &&   //
+          ClientAcceptsGzip() &&  //
+          !ShouldAvoidGzip()) {
+        cpm.gzipped = outbuflen;
+        crc = crc32_z(0, cpm.outbuf, outbuflen);
+        WRITE32LE(gzip_footer + 0, crc);
+        WRITE32LE(gzip_footer + 4, outbuflen);
+        cpm.content =
+            FreeLater(Deflate(cpm.outbuf, outbuflen, &cpm.contentlength));
+        DropOutput();
+      } else {
+        UseOutput();
+      }
+    } else {
+      UseOutput();
+    }
+  } else {
+    DropOutput();
+  }
+  return p;
+}
+
+static char *ServeDefaultErrorPage(char *p, unsigned code, const char *reason,
+                                   const char *details) {
+  p = AppendContentType(p, "text/html; charset=UTF-8");
+  reason = FreeLater(EscapeHtml(reason, -1, 0));
+  appends(&cpm.outbuf, "\
+<!doctype html>\r\n\
+<title>");
+  appendf(&cpm.outbuf, "%d %s", code, reason);
+  appends(&cpm.outbuf, "\
+</title>\r\n\
+<style>\r\n\
+html { color: #111; font-family: sans-serif; }\r\n\
+img { vertical-align: middle; }\r\n\
+</style>\r\n\
+<h1>\r\n");
+  AppendLogo();
+  appendf(&cpm.outbuf, "%d %s\r\n", code, reason);
+  appends(&cpm.outbuf, "</h1>\r\n");
+  if (details) {
+    appendf(&cpm.outbuf, "<pre>%s</pre>\r\n",
+            FreeLater(EscapeHtml(details, -1, 0)));
+  }
+  UseOutput();
+  return p;
+}
+
+static char *ServeErrorImplDefault(unsigned code, const char *reason,
+                                   const char *details) {
+  size_t n;
+  char *p, *s;
+  struct Asset *a;
+  LockInc(&shared->c.errors);
+  DropOutput();
+  p = SetStatus(code, reason);
+  s = xasprintf("/%d.html", code);
+  a = GetAsset(s, strlen(s));
+  free(s);
+  if (!a) {
+    return ServeDefaultErrorPage(p, code, reason, details);
+  } else if (a->file) {
+    LockInc(&shared->c.slurps);
+    cpm.content = FreeLater(xslurp(a->file->path.s, &cpm.contentlength));
+    return AppendContentType(p, "text/html; charset=utf-8");
+  } else {
+    cpm.content = (char *)ZIP_LFILE_CONTENT(zmap + a->lf);
+    cpm.contentlength = GetZipCfileCompressedSize(zmap + a->cf);
+    if (IsCompressed(a)) {
+      n = GetZipLfileUncompressedSize(zmap + a->lf);
+      if ((s = FreeLater(malloc(n))) &&
+          Decompress(a, s, n, cpm.content, cpm.contentlength)) {
+        cpm.content = s;
+        cpm.contentlength = n;
+      } else {
+        return ServeDefaultErrorPage(p, code, reason, details);
+      }
+    }
+    if (Verify(cpm.content, cpm.contentlength, ZIP_LFILE_CRC32(zmap + a->lf))) {
+      return AppendContentType(p, "text/html; charset=utf-8");
+    } else {
+      return ServeDefaultErrorPage(p, code, reason, details);
+    }
+  }
+}
+
+static char *GetLuaResponse(void) {
+  return cpm.luaheaderp ? cpm.luaheaderp : SetStatus(200, "OK");
+}
+
+static char *ServeErrorImpl(unsigned code, const char *reason,
+                            const char *details) {
+  lua_State *L = GL;
+  if (hasonerror) {
+    lua_getglobal(L, "OnError");
+    lua_pushinteger(L, code);
+    lua_pushstring(L, reason);
+    lua_pushstring(L, details);
+    if (LuaCallWithTrace(L, 3, 0, NULL) == LUA_OK) {
+      return CommitOutput(GetLuaResponse());
+    } else {
+      return ServeErrorImplDefault(code, reason, details);
+    }
+  } else {
+    return ServeErrorImplDefault(code, reason, details);
+  }
+}
+
+static char *ServeErrorWithPath(unsigned code, const char *reason,
+                                const char *path, size_t pathlen) {
+  ERRORF("(srvr) server error: %d %s %`'.*s", code, reason, pathlen, path);
+  return ServeErrorImpl(code, reason, NULL);
+}
+
+static char *ServeErrorWithDetail(unsigned code, const char *reason,
+                                  const char *details) {
+  ERRORF("(srvr) server error: %d %s", code, reason);
+  return ServeErrorImpl(code, reason, details);
+}
+
+static char *ServeError(unsigned code, const char *reason) {
+  return ServeErrorWithDetail(code, reason, NULL);
+}
+
+static char *ServeFailure(unsigned code, const char *reason) {
+  char method[9] = {0};
+  WRITE64LE(method, cpm.msg.method);
+  ERRORF("(srvr) failure: %d %s %s HTTP%02d %s %`'.*s %`'.*s %`'.*s %`'.*s",
+         code, reason, DescribeClient(), cpm.msg.version, method,
          HeaderLength(kHttpHost), HeaderData(kHttpHost),
          cpm.msg.uri.b - cpm.msg.uri.a, inbuf.p + cpm.msg.uri.a,
          HeaderLength(kHttpReferer), HeaderData(kHttpReferer),
@@ -2666,7 +3770,9 @@ static char *ServeFailure(unsigned code, const char *reason) {
 
 static ssize_t YieldGenerator(struct iovec v[3]) {
   int nresults, status;
-  if (cpm.isyielding > 1) {
+  // EncodeJson(x, {stream=true}) yields only so headers get sent, so
+  // resume it right away if nothing was written before it was called
+  if (cpm.isyielding > 1 || (cpm.encoderyielded && !cpm.contentlength)) {
     do {
       if (!YL || lua_status(YL) != LUA_YIELD)
         return 0;  // done yielding
@@ -2700,6 +3806,7 @@ static int LuaCallWithYield(lua_State *L) {
   // need to fully restart the yield generator;
   // the second set of headers is not going to be sent
   struct sigaction sa, saold;
+  lua_State *old = YL;
   lua_State *co = lua_newthread(L);
   if (__ttyconf.replmode) {
     sa.sa_flags = SA_RESETHAND;
@@ -2707,17 +3814,19 @@ static int LuaCallWithYield(lua_State *L) {
     sigemptyset(&sa.sa_mask);
     sigaction(SIGINT, &sa, &saold);
   }
+  YL = co;  // so EncodeJson() can tell handler from user coroutines
   status = LuaCallWithTrace(L, 0, 0, co);
   if (__ttyconf.replmode) {
     sigaction(SIGINT, &saold, 0);
   }
   if (status == LUA_YIELD) {
     CHECK_GT(lua_gettop(L), 0);  // make sure that coroutine is anchored
-    YL = co;
     cpm.generator = YieldGenerator;
     if (!cpm.isyielding)
       cpm.isyielding = 1;
     status = LUA_OK;
+  } else {
+    YL = old;
   }
   return status;
 }
@@ -2890,14 +3999,277 @@ static inline char *ServeAssetPrecompressed(struct Asset *a) {
   return SetStatus(200, "OK");
 }
 
+static inline char *ServeAssetPrecompressedZstd(struct Asset *a) {
+  char *p;
+  DEBUGF("(srvr) ServeAssetPrecompressedZstd()");
+  LockInc(&shared->c.zstdresponses);
+  cpm.zstded = GetZipCfileUncompressedSize(zmap + a->cf);
+  p = SetStatus(200, "OK");
+  p = stpcpy(p, "Content-Encoding: zstd\r\n");
+  return p;
+}
+
+static ssize_t UnzstdGenerator(struct iovec v[3]) {
+  size_t rc;
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+  if (dg.t)
+    return 0;
+  in.src = cpm.content;
+  in.size = cpm.contentlength;
+  in.pos = dg.i;
+  out.dst = dg.b;
+  out.size = dg.z;
+  out.pos = 0;
+  do {
+    rc = ZSTD_decompressStream(zdctx, &out, &in);
+    if (ZSTD_isError(rc))
+      DIEF("(zip) ZSTD_decompressStream()→%s", ZSTD_getErrorName(rc));
+  } while (out.pos < out.size && in.pos < in.size);
+  dg.i = in.pos;
+  dg.c = crc32_z(dg.c, dg.b, out.pos);
+  if (!rc && in.pos == in.size) {
+    CHECK_EQ(ZIP_CFILE_CRC32(zmap + dg.a->cf), dg.c);
+    dg.t = 1;
+  } else if (out.pos < out.size) {
+    DIEF("(zip) zstd frame truncated");
+  }
+  v[0].iov_base = dg.b;
+  v[0].iov_len = out.pos;
+  return out.pos;
+}
+
+static char *ServeAssetUnzstd(struct Asset *a) {
+  char *p;
+  size_t size;
+  LockInc(&shared->c.decompressedresponses);
+  size = GetZipCfileUncompressedSize(zmap + a->cf);
+  DEBUGF("(srvr) ServeAssetUnzstd(%ld)→%ld", cpm.contentlength, size);
+  if (cpm.msg.method == kHttpHead) {
+    cpm.content = 0;
+    cpm.contentlength = size;
+    return SetStatus(200, "OK");
+  } else if (!IsTiny() && GetZstdContext()) {
+    LockInc(&shared->c.zstddecodes);
+    ZSTD_DCtx_reset(zdctx, ZSTD_reset_session_only);
+    dg.t = 0;
+    dg.i = 0;
+    dg.c = 0;
+    dg.a = a;
+    dg.z = ZSTD_DStreamOutSize();
+    cpm.generator = UnzstdGenerator;
+    dg.b = FreeLater(malloc(dg.z));
+    return SetStatus(200, "OK");
+  } else if ((p = FreeLater(malloc(size))) &&
+             Unzstd(p, size, cpm.content, cpm.contentlength) &&
+             Verify(p, size, ZIP_CFILE_CRC32(zmap + a->cf))) {
+    cpm.content = p;
+    cpm.contentlength = size;
+    return SetStatus(200, "OK");
+  } else {
+    return ServeError(500, "Internal Server Error");
+  }
+}
+
+static unsigned GetDeflateSlot(uint64_t cf, uint32_t crc) {
+  return (cf ^ crc) & (DEFLATE_CACHE_SLOTS - 1);
+}
+
+static struct DeflateVariant *GetDeflateVariant(struct DeflateArena *a,
+                                                uint64_t cf, uint32_t crc,
+                                                size_t size) {
+  unsigned i, step;
+  struct DeflateVariant *v;
+  for (i = GetDeflateSlot(cf, crc), step = 0; step < DEFLATE_CACHE_SLOTS;
+       ++i, ++step) {
+    v = a->p + (i & (DEFLATE_CACHE_SLOTS - 1));
+    if (!v->len || (v->cf == cf && v->crc == crc && v->size == size))
+      return v;
+  }
+  return 0;
+}
+
+// removes variant from its linear probing table by shifting back later
+// members of its cluster, since leaving a hole would hide them
+static void DropDeflateVariant(struct DeflateArena *a,
+                               struct DeflateVariant *v) {
+  unsigned i, j, h, m;
+  m = DEFLATE_CACHE_SLOTS - 1;
+  a->used -= ROUNDUP(v->len, 16);
+  a->count--;
+  for (i = j = v - a->p;;) {
+    j = (j + 1) & m;
+    if (!a->p[j].len)
+      break;
+    h = GetDeflateSlot(a->p[j].cf, a->p[j].crc);
+    if (((j - h) & m) >= ((j - i) & m)) {
+      a->p[i] = a->p[j];
+      i = j;
+    }
+  }
+  bzero(a->p + i, sizeof(a->p[i]));
+}
+
+static bool EvictDeflateVariant(struct DeflateArena *a) {
+  unsigned i;
+  struct DeflateVariant *v;
+  for (v = 0, i = 0; i < DEFLATE_CACHE_SLOTS; ++i) {
+    if (a->p[i].len && (!v || (int)(a->p[i].tick - v->tick) < 0)) {
+      v = a->p + i;
+    }
+  }
+  if (!v)
+    return false;
+  DropDeflateVariant(a, v);
+  LockInc(&shared->c.deflatecacheevictions);
+  return true;
+}
+
+// finds lowest offset in arena where n bytes fit between live variants
+static bool FindDeflateRoom(struct DeflateArena *a, size_t n, size_t *off) {
+  size_t i, j, o;
+  for (i = 0; i <= DEFLATE_CACHE_SLOTS; ++i) {
+    if (i == DEFLATE_CACHE_SLOTS) {
+      o = 0;
+    } else if (a->p[i].len) {
+      o = a->p[i].off + ROUNDUP(a->p[i].len, 16);
+    } else {
+      continue;
+    }
+    if (o + n > DEFLATE_CACHE_SIZE)
+      continue;
+    for (j = 0; j < DEFLATE_CACHE_SLOTS; ++j) {
+      if (a->p[j].len && a->p[j].off < o + n &&
+          o < a->p[j].off + ROUNDUP(a->p[j].len, 16)) {
+        break;
+      }
+    }
+    if (j == DEFLATE_CACHE_SLOTS) {
+      *off = o;
+      return true;
+    }
+  }
+  return false;
+}
+
+// stores variant in arena, evicting least recently used ones to fit it
+static void PutDeflateVariant(struct Asset *a, uint32_t crc, size_t size,
+                              const char *p, size_t len) {
+  size_t off;
+  struct DeflateArena *arena;
+  struct DeflateVariant *v;
+  arena = deflatecache->arena + (deflatecache->gen & 1);
+  if ((v = GetDeflateVariant(arena, a->cf, crc, size)) && v->len)
+    return;  // another worker beat us to it
+  while (arena->count >= DEFLATE_CACHE_SLOTS / 4 * 3 ||
+         !FindDeflateRoom(arena, ROUNDUP(len, 16), &off)) {
+    if (!EvictDeflateVariant(arena)) {
+      return;
+    }
+  }
+  v = GetDeflateVariant(arena, a->cf, crc, size);
+  memcpy(deflatecache->data[deflatecache->gen & 1] + off, p, len);
+  v->cf = a->cf;
+  v->crc = crc;
+  v->size = size;
+  v->off = off;
+  v->len = len;
+  v->tick = ++deflatecache->tick;
+  arena->used += ROUNDUP(len, 16);
+  arena->count++;
+}
+
+static bool IsDeflateCacheCurrent(void) {
+  return deflatecache->ino == zst.st_ino && deflatecache->zsize == zst.st_size;
+}
+
+// serves stored zip asset from compressed variants cache, where a miss
+// will compress the whole asset once, at a higher level than we'd use
+// when streaming, so the other workers won't have to redo it. variants
+// are copied out under the lock since a send can outlast an eviction.
+// it returns null if the asset can't be cached, in which case the
+// caller should serve it some other way
+static char *ServeAssetCached(struct Asset *a) {
+  char *p;
+  z_stream zs;
+  uint32_t crc;
+  size_t size, len;
+  struct DeflateArena *arena;
+  struct DeflateVariant *v;
+  if (!deflatecache || a->file || usingssl)
+    return 0;
+  crc = ZIP_CFILE_CRC32(zmap + a->cf);
+  size = cpm.contentlength;
+  if (compressBound(size) > DEFLATE_CACHE_SIZE / 8)
+    return 0;
+  unassert(!pthread_mutex_lock(&deflatecache->mu));
+  arena = deflatecache->arena + (deflatecache->gen & 1);
+  if ((v = GetDeflateVariant(arena, a->cf, crc, size)) && v->len) {
+    p = FreeLater(xmalloc(v->len));
+    memcpy(p, deflatecache->data[deflatecache->gen & 1] + v->off, v->len);
+    v->tick = ++deflatecache->tick;
+    cpm.content = p;
+    cpm.contentlength = v->len;
+    unassert(!pthread_mutex_unlock(&deflatecache->mu));
+    LockInc(&shared->c.deflatecachehits);
+    return ServeAssetPrecompressed(a);
+  }
+  if (!IsDeflateCacheCurrent()) {
+    // cache is for a zip we haven't indexed, so it wouldn't be stored
+    unassert(!pthread_mutex_unlock(&deflatecache->mu));
+    return 0;
+  }
+  unassert(!pthread_mutex_unlock(&deflatecache->mu));
+  LockInc(&shared->c.deflatecachemisses);
+  if (!Verify(cpm.content, size, crc))
+    return 0;
+  LockInc(&shared->c.deflates);
+  bzero(&zs, sizeof(zs));
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                   DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+    return 0;
+  len = deflateBound(&zs, size);
+  p = FreeLater(xmalloc(len));
+  zs.next_in = (void *)cpm.content;
+  zs.avail_in = size;
+  zs.next_out = (void *)p;
+  zs.avail_out = len;
+  CHECK_EQ(Z_STREAM_END, deflate(&zs, Z_FINISH));
+  len = zs.total_out;
+  CHECK_EQ(Z_OK, deflateEnd(&zs));
+  cpm.content = p;
+  cpm.contentlength = len;
+  unassert(!pthread_mutex_lock(&deflatecache->mu));
+  if (crc == ZIP_CFILE_CRC32(zmap + a->cf) && IsDeflateCacheCurrent())
+    PutDeflateVariant(a, crc, size, p, len);
+  unassert(!pthread_mutex_unlock(&deflatecache->mu));
+  return ServeAssetPrecompressed(a);
+}
+
+static bool GetAssetRange(long size, long *rangestart, long *rangelength) {
+  return ParseHttpRange(HeaderData(kHttpRange), HeaderLength(kHttpRange), size,
+                        rangestart, rangelength) &&
+         *rangestart >= 0 && *rangelength >= 0 && *rangestart < size &&
+         *rangestart + *rangelength <= size;
+}
+
+static char *ServeBadRange(long size) {
+  char *p;
+  LockInc(&shared->c.badranges);
+  WARNF("(client) bad range %`'.*s", HeaderLength(kHttpRange),
+        HeaderData(kHttpRange));
+  p = SetStatus(416, "Range Not Satisfiable");
+  p = AppendContentRange(p, -1, -1, size);
+  cpm.content = "";
+  cpm.contentlength = 0;
+  return p;
+}
+
 static char *ServeAssetRange(struct Asset *a) {
   char *p;
   long rangestart, rangelength;
   DEBUGF("(srvr) ServeAssetRange()");
-  if (ParseHttpRange(HeaderData(kHttpRange), HeaderLength(kHttpRange),
-                     cpm.contentlength, &rangestart, &rangelength) &&
-      rangestart >= 0 && rangelength >= 0 && rangestart < cpm.contentlength &&
-      rangestart + rangelength <= cpm.contentlength) {
+  if (GetAssetRange(cpm.contentlength, &rangestart, &rangelength)) {
     LockInc(&shared->c.partialresponses);
     p = SetStatus(206, "Partial Content");
     p = AppendContentRange(p, rangestart, rangelength, cpm.contentlength);
@@ -2905,15 +4277,221 @@ static char *ServeAssetRange(struct Asset *a) {
     cpm.contentlength = rangelength;
     return p;
   } else {
-    LockInc(&shared->c.badranges);
-    WARNF("(client) bad range %`'.*s", HeaderLength(kHttpRange),
-          HeaderData(kHttpRange));
-    p = SetStatus(416, "Range Not Satisfiable");
-    p = AppendContentRange(p, -1, -1, cpm.contentlength);
-    cpm.content = "";
-    cpm.contentlength = 0;
-    return p;
+    return ServeBadRange(cpm.contentlength);
+  }
+}
+
+// inflates whole deflate stream, recording an access point at the first
+// block boundary after every `span` bytes of output, which is technique
+// from zlib's examples/zran.c. the first point is the beginning of the
+// stream, which doesn't need a window.
+static struct InflatePoint *BuildInflateIndex(const char *p, size_t n,
+                                              size_t span,
+                                              unsigned *out_count) {
+  int rc;
+  z_stream zs;
+  size_t left, last;
+  unsigned count, cap;
+  unsigned char *window;
+  struct InflatePoint *pt, *pts;
+  bzero(&zs, sizeof(zs));
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    return 0;
+  window = xcalloc(1, sizeof(pt->window));
+  pts = xcalloc((cap = 8), sizeof(*pts));
+  count = 1;
+  last = 0;
+  zs.next_in = (void *)p;
+  zs.avail_in = n;
+  do {
+    if (!zs.avail_out) {
+      zs.next_out = window;
+      zs.avail_out = sizeof(pt->window);
+    }
+    rc = inflate(&zs, Z_BLOCK);
+    if (rc != Z_OK && rc != Z_STREAM_END)
+      goto OnError;  // Z_BUF_ERROR if truncated
+    if ((zs.data_type & 128) && !(zs.data_type & 64) &&
+        zs.total_out - last >= span) {
+      if (count == cap)
+        pts = xrealloc(pts, (cap *= 2) * sizeof(*pts));
+      pt = pts + count++;
+      pt->out = last = zs.total_out;
+      pt->in = zs.total_in;
+      pt->bits = zs.data_type & 7;
+      left = zs.avail_out;
+      memcpy(pt->window, window + sizeof(pt->window) - left, left);
+      memcpy(pt->window + left, window, sizeof(pt->window) - left);
+    }
+  } while (rc != Z_STREAM_END);
+  inflateEnd(&zs);
+  free(window);
+  *out_count = count;
+  return pts;
+OnError:
+  WARNF("(zip) failed to index compressed asset");
+  inflateEnd(&zs);
+  free(window);
+  free(pts);
+  return 0;
+}
+
+static struct InflateEntry *GetInflateEntry(struct InflateArena *a,
+                                            uint64_t cf, uint32_t crc) {
+  unsigned i, step;
+  struct InflateEntry *e;
+  for (i = cf ^ crc, step = 0; step < INFLATE_INDEX_SLOTS; ++i, ++step) {
+    e = a->p + (i & (INFLATE_INDEX_SLOTS - 1));
+    if (!e->points || (e->cf == cf && e->crc == crc))
+      return e;
+  }
+  return 0;
+}
+
+static const struct InflatePoint *FindInflatePoint(
+    const struct InflatePoint *pts, unsigned count, size_t start) {
+  unsigned l, r, m;
+  for (l = 0, r = count; r - l > 1;) {
+    m = l + (r - l) / 2;
+    if (pts[m].out <= start) {
+      l = m;
+    } else {
+      r = m;
+    }
+  }
+  return pts + l;
+}
+
+static bool HasInflateRoom(struct InflateArena *arena, unsigned count) {
+  return arena->count < INFLATE_INDEX_SLOTS / 4 * 3 &&
+         arena->used + count <= INFLATE_INDEX_POINTS;
+}
+
+// copies access point at or before uncompressed offset `start` to `pt`,
+// which is either looked up in the shared index, or added to it on miss.
+// returns false if the index is full, since it's cheaper to serve whole
+// asset than to inflate it from the beginning for every range request
+static bool GetInflatePoint(struct Asset *a, size_t start,
+                            struct InflatePoint *pt) {
+  uint32_t crc;
+  size_t size, span;
+  unsigned count;
+  struct InflateEntry *e;
+  struct InflateArena *arena;
+  struct InflatePoint *pts;
+  size = GetZipCfileUncompressedSize(zmap + a->cf);
+  if (size <= INFLATE_INDEX_SPAN) {
+    bzero(pt, offsetof(struct InflatePoint, window));
+    return true;
+  }
+  span = MAX(INFLATE_INDEX_SPAN, size / (INFLATE_INDEX_MAX - 1));
+  crc = ZIP_CFILE_CRC32(zmap + a->cf);
+  unassert(!pthread_mutex_lock(&inflateindex->mu));
+  arena = inflateindex->arena + (inflateindex->gen & 1);
+  if ((e = GetInflateEntry(arena, a->cf, crc)) && e->points) {
+    *pt = *FindInflatePoint(inflateindex->data[inflateindex->gen & 1] + e->off,
+                            e->points, start);
+    unassert(!pthread_mutex_unlock(&inflateindex->mu));
+    LockInc(&shared->c.inflateindexhits);
+    return true;
+  }
+  if (!e || !HasInflateRoom(arena, INFLATE_INDEX_MAX)) {
+    unassert(!pthread_mutex_unlock(&inflateindex->mu));
+    return false;
+  }
+  unassert(!pthread_mutex_unlock(&inflateindex->mu));
+  LockInc(&shared->c.inflateindexmisses);
+  LockInc(&shared->c.inflates);
+  if (!(pts = BuildInflateIndex(cpm.content, cpm.contentlength, span, &count)))
+    return false;
+  *pt = *FindInflatePoint(pts, count, start);
+  unassert(!pthread_mutex_lock(&inflateindex->mu));
+  if (crc == ZIP_CFILE_CRC32(zmap + a->cf) &&
+      inflateindex->ino == zst.st_ino && inflateindex->zsize == zst.st_size) {
+    arena = inflateindex->arena + (inflateindex->gen & 1);
+    if (HasInflateRoom(arena, count) &&
+        (e = GetInflateEntry(arena, a->cf, crc)) && !e->points) {
+      memcpy(inflateindex->data[inflateindex->gen & 1] + arena->used, pts,
+             count * sizeof(*pts));
+      e->cf = a->cf;
+      e->crc = crc;
+      e->off = arena->used;
+      e->points = count;
+      arena->used += count;
+      arena->count++;
+    }
+  }
+  unassert(!pthread_mutex_unlock(&inflateindex->mu));
+  free(pts);
+  return true;
+}
+
+static ssize_t InflateRangeGenerator(struct iovec v[3]) {
+  int rc;
+  size_t n;
+  while (dg.i) {
+    dg.s.next_out = dg.b;
+    dg.s.avail_out = MIN(dg.z, dg.k ? dg.k : dg.i);
+    rc = inflate(&dg.s, Z_NO_FLUSH);
+    n = (char *)dg.s.next_out - (char *)dg.b;
+    if ((rc != Z_OK && rc != Z_STREAM_END) ||
+        (!n && (rc == Z_STREAM_END || !dg.s.avail_in))) {
+      WARNF("(zip) inflate()→%d with %,zu bytes left", rc, dg.k + dg.i);
+      inflateEnd(&dg.s);
+      return -1;
+    }
+    if (dg.k) {
+      dg.k -= n;  // discard output between access point and range
+    } else {
+      dg.i -= n;
+      v[0].iov_base = dg.b;
+      v[0].iov_len = n;
+      return n;
+    }
+  }
+  inflateEnd(&dg.s);
+  return 0;
+}
+
+// serves byte range of compressed asset, by inflating from the nearest
+// access point in the inflate index. returns null if we can't do that,
+// in which case the caller should serve the whole thing
+static char *ServeAssetCompressedRange(struct Asset *a) {
+  char *p;
+  size_t size;
+  long rangestart, rangelength;
+  struct InflatePoint *pt;
+  if (!inflateindex)
+    return 0;
+  DEBUGF("(srvr) ServeAssetCompressedRange()");
+  size = GetZipCfileUncompressedSize(zmap + a->cf);
+  if (!GetAssetRange(size, &rangestart, &rangelength))
+    return ServeBadRange(size);
+  if (cpm.msg.method != kHttpHead) {
+    pt = FreeLater(xmalloc(sizeof(*pt)));
+    if (!GetInflatePoint(a, rangestart, pt))
+      return 0;
+    bzero(&dg.s, sizeof(dg.s));
+    CHECK_EQ(Z_OK, inflateInit2(&dg.s, -MAX_WBITS));
+    if (pt->bits)
+      inflatePrime(&dg.s, pt->bits,
+                   (cpm.content[pt->in - 1] & 255) >> (8 - pt->bits));
+    if (pt->out)
+      inflateSetDictionary(&dg.s, pt->window, sizeof(pt->window));
+    dg.s.next_in = (void *)(cpm.content + pt->in);
+    dg.s.avail_in = cpm.contentlength - pt->in;
+    dg.k = rangestart - pt->out;
+    dg.i = rangelength;
+    dg.z = 65536;
+    dg.b = FreeLater(malloc(dg.z));
+    cpm.generator = InflateRangeGenerator;
   }
+  LockInc(&shared->c.partialresponses);
+  p = SetStatus(206, "Partial Content");
+  p = AppendContentRange(p, rangestart, rangelength, size);
+  cpm.content = 0;
+  cpm.contentlength = rangelength;
+  return p;
 }
 
 static char *GetAssetPath(uint8_t *zcf, size_t *out_size) {
@@ -3200,6 +4778,10 @@ static void ServeCounters(void) {
   }
 }
 
+static long GetHitRate(long hits, long misses) {
+  return hits + misses ? hits * 100 / (hits + misses) : 0;
+}
+
 static char *ServeStatusz(void) {
   char *p;
   LockInc(&shared->c.statuszrequests);
@@ -3221,6 +4803,10 @@ static char *ServeStatusz(void) {
   AppendLong1("workers",
               atomic_load_explicit(&shared->workers, memory_order_relaxed));
   AppendLong1("assets.n", assets.n);
+  if (stagedirs.n) {
+    AppendLong1("statcache.hitrate",
+                GetHitRate(shared->c.statcachehits, shared->c.statcachemisses));
+  }
 #ifndef STATIC
   lua_State *L = GL;
   AppendLong1("lua.memory",
@@ -3305,30 +4891,113 @@ static char *LuaOnHttpRequest(void) {
   }
 }
 
+static void PushLuaPageKey(lua_State *L, struct Asset *a) {
+  char crc[10];
+  snprintf(crc, sizeof(crc), "%08x:", ZIP_CFILE_CRC32(zmap + a->cf));
+  lua_pushstring(L, crc);
+  lua_pushlstring(L, ZIP_CFILE_NAME(zmap + a->cf),
+                  ZIP_CFILE_NAMESIZE(zmap + a->cf));
+  lua_concat(L, 2);
+}
+
+// compiles the .lua pages in the zip, so forked workers inherit their
+// functions from the main process rather than parsing them each time.
+// if the zip also has a .luac file that was produced by string.dump()
+// and isn't older than its .lua source, then it's loaded in its place
+static void CompileLuaPages(void) {
+  long i;
+  struct Asset *a, *b;
+  lua_State *L = GL;
+  char *code, *name, *luac;
+  size_t n, count, codelen;
+  const char *s;
+  if (!L || IsTiny())
+    return;
+  count = 0;
+  lua_newtable(L);
+  for (i = 0; i < assets.n; ++i) {
+    if (!assets.index.tags[i])
+      continue;
+    a = assets.p + i;
+    s = ZIP_CFILE_NAME(zmap + a->cf);
+    n = ZIP_CFILE_NAMESIZE(zmap + a->cf);
+    if (n <= 4 || s[0] == '.' ||
+        READ32LE(s + n - 4) != ('.' | 'l' << 8 | 'u' << 16 | 'a' << 24)) {
+      continue;  // not a page, or hidden file like .init.lua or .lua/x.lua
+    }
+    luac = xasprintf("%.*sc", n, s);
+    if ((b = GetAssetZip(luac, n + 1)) && b->lastmodified >= a->lastmodified) {
+      code = LoadAsset(b, &codelen);
+    } else {
+      b = 0;
+      code = LoadAsset(a, &codelen);
+    }
+    free(luac);
+    if (!code)
+      continue;
+    name = xasprintf("@/%.*s", n, s);
+    if (luaL_loadbufferx(L, code, codelen, name, b ? "b" : "t") == LUA_OK) {
+      PushLuaPageKey(L, a);
+      lua_insert(L, -2);
+      lua_rawset(L, -3);
+      ++count;
+    } else {
+      DEBUGF("(lua) %s", lua_tostring(L, -1));
+      lua_pop(L, 1);
+    }
+    free(name);
+    free(code);
+  }
+  lua_setfield(L, LUA_REGISTRYINDEX, "redbean.pages");
+  DEBUGF("(lua) compiled %zu pages", count);
+}
+
+// pushes compiled function for zip asset if available
+static bool GetLuaPage(lua_State *L, struct Asset *a) {
+  if (a->file)
+    return false;
+  if (lua_getfield(L, LUA_REGISTRYINDEX, "redbean.pages") == LUA_TTABLE) {
+    PushLuaPageKey(L, a);
+    if (lua_rawget(L, -2) == LUA_TFUNCTION) {
+      lua_remove(L, -2);
+      LockInc(&shared->c.luapagehits);
+      return true;
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  LockInc(&shared->c.luapagemisses);
+  return false;
+}
+
 static char *ServeLua(struct Asset *a, const char *s, size_t n) {
+  int status;
   char *code;
   size_t codelen;
   lua_State *L = GL;
   LockInc(&shared->c.dynamicrequests);
   effectivepath.p = (void *)s;
   effectivepath.n = n;
-  if ((code = FreeLater(LoadAsset(a, &codelen)))) {
-    int status =
+  if (GetLuaPage(L, a)) {
+    status = LUA_OK;
+  } else if ((code = FreeLater(LoadAsset(a, &codelen)))) {
+    status =
         luaL_loadbuffer(L, code, codelen,
                         FreeLater(xasprintf("@%s", FreeLater(strndup(s, n)))));
-    if (status == LUA_OK && LuaCallWithYield(L) == LUA_OK) {
-      return CommitOutput(GetLuaResponse());
-    } else {
-      char *error;
-      LogLuaError("lua code", lua_tostring(L, -1));
-      error = ServeErrorWithDetail(
-          500, "Internal Server Error",
-          ShouldServeCrashReportDetails() ? lua_tostring(L, -1) : NULL);
-      lua_pop(L, 1);  // pop error
-      return error;
-    }
+  } else {
+    return ServeError(500, "Internal Server Error");
+  }
+  if (status == LUA_OK && LuaCallWithYield(L) == LUA_OK) {
+    return CommitOutput(GetLuaResponse());
+  } else {
+    char *error;
+    LogLuaError("lua code", lua_tostring(L, -1));
+    error = ServeErrorWithDetail(
+        500, "Internal Server Error",
+        ShouldServeCrashReportDetails() ? lua_tostring(L, -1) : NULL);
+    lua_pop(L, 1);  // pop error
+    return error;
   }
-  return ServeError(500, "Internal Server Error");
 }
 
 static char *HandleRedirect(struct Redirect *r) {
@@ -3376,6 +5045,7 @@ static char *HandleFolder(const char *path, size_t pathlen) {
 static bool Reindex(void) {
   if (OpenZip(false)) {
     LockInc(&shared->c.reindexes);
+    CompileLuaPages();
     return true;
   } else {
     return false;
@@ -4069,10 +5739,32 @@ static int LuaLog(lua_State *L) {
   return 0;
 }
 
+// sends what's been encoded so far once there's enough of it. this is
+// only used while the response is streaming, i.e. after a yield caused
+// the headers and earlier output to be committed.
+static int LuaEncodeFlush(char **buf) {
+  struct iovec v[3] = {0};
+  if ((v[0].iov_len = appendz(*buf).i) < STREAM_CHUNK_SIZE)
+    return 0;
+  v[0].iov_base = *buf;
+  if (SendChunk(v, v[0].iov_len) == -1)
+    return -1;
+  appendr(buf, 0);
+  return 0;
+}
+
+static int LuaEncodeSmth(lua_State *L, int Encoder(lua_State *, char **, int,
+                                                   struct EncoderConfig));
+
+static int LuaEncodeResume(lua_State *L, int status, lua_KContext ctx) {
+  return LuaEncodeSmth(L, (void *)ctx);
+}
+
 static int LuaEncodeSmth(lua_State *L, int Encoder(lua_State *, char **, int,
                                                    struct EncoderConfig)) {
   char *p = 0;
   int useoutput = false;
+  bool stream = false;
   struct EncoderConfig conf = {
       .maxdepth = 64,
       .sorted = true,
@@ -4086,6 +5778,10 @@ static int LuaEncodeSmth(lua_State *L, int Encoder(lua_State *, char **, int,
     if (ishandlingrequest && lua_isboolean(L, -1)) {
       useoutput = lua_toboolean(L, -1);
     }
+    lua_getfield(L, 2, "stream");
+    if (ishandlingrequest && lua_toboolean(L, -1)) {
+      useoutput = stream = true;
+    }
     lua_getfield(L, 2, "maxdepth");
     if (!lua_isnoneornil(L, -1)) {
       lua_Integer n = lua_tointeger(L, -1);
@@ -4105,6 +5801,17 @@ static int LuaEncodeSmth(lua_State *L, int Encoder(lua_State *, char **, int,
       }
     }
   }
+  if (stream) {
+    if (cpm.encoderyielded) {
+      conf.flush = LuaEncodeFlush;
+    } else if (L == YL && lua_isyieldable(L)) {
+      // yield so the headers get sent, then encode when we're resumed.
+      // a user coroutine would swallow our yield, so it just buffers
+      cpm.encoderyielded = true;
+      lua_settop(L, 2);
+      return lua_yieldk(L, 0, (lua_KContext)Encoder, LuaEncodeResume);
+    }
+  }
   lua_settop(L, 1);  // keep the passed argument on top
   if (Encoder(L, useoutput ? &cpm.outbuf : &p, -1, conf) == -1) {
     free(p);
@@ -4113,7 +5820,7 @@ static int LuaEncodeSmth(lua_State *L, int Encoder(lua_State *, char **, int,
   if (useoutput) {
     lua_pushboolean(L, true);
   } else {
-    lua_pushstring(L, p);
+    lua_pushlstring(L, p, appendz(p).i);
     free(p);
   }
   return 1;
@@ -4256,6 +5963,14 @@ static int LuaGetResponseBody(lua_State *L) {
              : cpm.gzipped == 0 ? cpm.contentlength
                                 : 0;
   OnlyCallDuringRequest(L, "GetResponseBody");
+  if (cpm.zstded) {
+    if (!(s = FreeLater(malloc(cpm.zstded))) ||
+        !Unzstd(s, cpm.zstded, cpm.content, cpm.contentlength)) {
+      return LuaNilError(L, "failed to decompress response");
+    }
+    lua_pushlstring(L, s, cpm.zstded);
+    return 1;
+  }
   if (cpm.gzipped > 0 &&
       (!(s = FreeLater(malloc(cpm.gzipped))) ||
        !Inflate(s, cpm.gzipped, cpm.content, cpm.contentlength))) {
@@ -4588,6 +6303,11 @@ static int LuaProgramSslTicketLifetime(lua_State *L) {
   return LuaProgramInt(L, ProgramSslTicketLifetime);
 }
 
+static int LuaProgramSslSessionCache(lua_State *L) {
+  OnlyCallFromInitLua(L, "ProgramSslSessionCache");
+  return LuaProgramInt(L, ProgramSslSessionCache);
+}
+
 static int LuaProgramUniprocess(lua_State *L) {
   OnlyCallFromInitLua(L, "ProgramUniprocess");
   if (!lua_isboolean(L, 1) && !lua_isnoneornil(L, 1)) {
@@ -4599,6 +6319,46 @@ static int LuaProgramUniprocess(lua_State *L) {
   return 1;
 }
 
+static int LuaProgramMultiplex(lua_State *L) {
+  OnlyCallFromInitLua(L, "ProgramMultiplex");
+  if (!lua_isboolean(L, 1) && !lua_isnoneornil(L, 1)) {
+    return luaL_argerror(L, 1, "invalid multiplex mode; boolean expected");
+  }
+  lua_pushboolean(L, multiplex);
+  if (lua_isboolean(L, 1))
+    multiplex = lua_toboolean(L, 1);
+  return 1;
+}
+
+static int LuaProgramListenBacklog(lua_State *L) {
+  OnlyCallFromInitLua(L, "ProgramListenBacklog");
+  return LuaProgramInt(L, ProgramListenBacklog);
+}
+
+static int LuaProgramTcpFastOpen(lua_State *L) {
+  OnlyCallFromInitLua(L, "ProgramTcpFastOpen");
+  return LuaProgramInt(L, ProgramTcpFastOpen);
+}
+
+static int LuaProgramTcpDeferAccept(lua_State *L) {
+  OnlyCallFromInitLua(L, "ProgramTcpDeferAccept");
+  return LuaProgramInt(L, ProgramTcpDeferAccept);
+}
+
+static int LuaProgramWorkerPool(lua_State *L) {
+  lua_Integer n;
+  OnlyCallFromInitLua(L, "ProgramWorkerPool");
+  lua_pushinteger(L, workerpool.n);
+  if (!lua_isnoneornil(L, 1)) {
+    n = luaL_checkinteger(L, 1);
+    if (!(0 <= n && n <= 4096)) {
+      return luaL_argerror(L, 1, "worker pool size should be 0 .. 4096");
+    }
+    workerpool.n = n;
+  }
+  return 1;
+}
+
 static int LuaProgramHeartbeatInterval(lua_State *L) {
   int64_t millis;
   OnlyCallFromMainProcess(L, "ProgramHeartbeatInterval");
@@ -4770,6 +6530,11 @@ static int LuaProgramSslRequired(lua_State *L) {
   return LuaProgramBool(L, &requiressl);
 }
 
+static int LuaProgramHttp2(lua_State *L) {
+  OnlyCallFromInitLua(L, "ProgramHttp2");
+  return LuaProgramBool(L, &http2);
+}
+
 static int LuaProgramSslFetchVerify(lua_State *L) {
   OnlyCallFromMainProcess(L, "ProgramSslFetchVerify");
   return LuaProgramBool(L, &sslfetchverify);
@@ -5200,17 +6965,23 @@ static const char *const kDontAutoComplete[] = {
     "ProgramBrand",              //
     "ProgramCertificate",        // TODO
     "ProgramGid",                //
+    "ProgramListenBacklog",      //
     "ProgramLogPath",            // TODO
     "ProgramMaxPayloadSize",     // TODO
+    "ProgramMultiplex",          //
     "ProgramPidPath",            // TODO
     "ProgramPort",               // TODO
     "ProgramPrivateKey",         // TODO
     "ProgramSslCiphersuite",     // TODO
     "ProgramSslClientVerify",    // TODO
+    "ProgramSslSessionCache",    //
     "ProgramSslTicketLifetime",  //
+    "ProgramTcpDeferAccept",     //
+    "ProgramTcpFastOpen",        //
     "ProgramTimeout",            // TODO
     "ProgramUid",                //
     "ProgramUniprocess",         //
+    "ProgramWorkerPool",         //
     "Respond",                   //
     "Route",                     //
     "RouteHost",                 //
@@ -5346,18 +7117,23 @@ static const luaL_Reg kLuaFuncs[] = {
     {"ProgramGid", LuaProgramGid},                              //
     {"ProgramHeader", LuaProgramHeader},                        //
     {"ProgramHeartbeatInterval", LuaProgramHeartbeatInterval},  //
+    {"ProgramListenBacklog", LuaProgramListenBacklog},          //
     {"ProgramLogBodies", LuaProgramLogBodies},                  //
     {"ProgramLogMessages", LuaProgramLogMessages},              //
     {"ProgramLogPath", LuaProgramLogPath},                      //
     {"ProgramMaxPayloadSize", LuaProgramMaxPayloadSize},        //
     {"ProgramMaxWorkers", LuaProgramMaxWorkers},                //
+    {"ProgramMultiplex", LuaProgramMultiplex},                  //
     {"ProgramPidPath", LuaProgramPidPath},                      //
     {"ProgramPort", LuaProgramPort},                            //
     {"ProgramRedirect", LuaProgramRedirect},                    //
+    {"ProgramTcpDeferAccept", LuaProgramTcpDeferAccept},        //
+    {"ProgramTcpFastOpen", LuaProgramTcpFastOpen},              //
     {"ProgramTimeout", LuaProgramTimeout},                      //
     {"ProgramTrustedIp", LuaProgramTrustedIp},                  // undocumented
     {"ProgramUid", LuaProgramUid},                              //
     {"ProgramUniprocess", LuaProgramUniprocess},                //
+    {"ProgramWorkerPool", LuaProgramWorkerPool},                //
     {"Rand64", LuaRand64},                                      //
     {"Rdrand", LuaRdrand},                                      //
     {"Rdseed", LuaRdseed},                                      //
@@ -5399,6 +7175,7 @@ static const luaL_Reg kLuaFuncs[] = {
     {"CountTokens", LuaCountTokens},                            //
     {"EvadeDragnetSurveillance", LuaEvadeDragnetSurveillance},  //
     {"GetSslIdentity", LuaGetSslIdentity},                      //
+    {"ProgramHttp2", LuaProgramHttp2},                          //
     {"ProgramCertificate", LuaProgramCertificate},              //
     {"ProgramPrivateKey", LuaProgramPrivateKey},                //
     {"ProgramSslCiphersuite", LuaProgramSslCiphersuite},        //
@@ -5407,6 +7184,7 @@ static const luaL_Reg kLuaFuncs[] = {
     {"ProgramSslInit", LuaProgramSslInit},                      //
     {"ProgramSslPresharedKey", LuaProgramSslPresharedKey},      //
     {"ProgramSslRequired", LuaProgramSslRequired},              //
+    {"ProgramSslSessionCache", LuaProgramSslSessionCache},      //
     {"ProgramSslTicketLifetime", LuaProgramSslTicketLifetime},  //
     {"ProgramTokenBucket", LuaProgramTokenBucket},              //
 #endif
@@ -5457,6 +7235,7 @@ static void LuaStart(void) {
   lua_State *L = GL = luaL_newstate();
   g_lua_path_default = DEFAULTLUAPATH;
   luaL_openlibs(L);
+  lsqlite3_zipvfs(FindZipDatabase);
   for (i = 0; i < ARRAYLEN(kLuaLibs); ++i) {
     luaL_requiref(L, kLuaLibs[i].name, kLuaLibs[i].func, 1);
     lua_pop(L, 1);
@@ -5619,7 +7398,12 @@ static void MemDestroy(void) {
   Free(&unmaplist.p), unmaplist.n = unmaplist.c = 0;
   Free(&freelist.p), freelist.n = freelist.c = 0;
   Free(&hdrbuf.p), hdrbuf.n = hdrbuf.c = 0;
+  for (int i = 0; i < PIPELINE_DEPTH; ++i) {
+    Free(&pipeline.ring[i].p), pipeline.ring[i].n = 0;
+  }
   Free(&servers.p), servers.n = 0;
+  Free(&workerpool.p), Free(&workerpool.fds), workerpool.n = 0;
+  Free(&conns.p), conns.n = conns.c = 0;
   Free(&ports.p), ports.n = 0;
   Free(&ips.p), ips.n = 0;
   Free(&cpm.outbuf);
@@ -5662,6 +7446,7 @@ static void LuaInit(void) {
   } else {
     DEBUGF("(srvr) no /.init.lua defined");
   }
+  CompileLuaPages();
 #endif
 }
 
@@ -5706,6 +7491,119 @@ static void LogClose(const char *reason) {
   }
 }
 
+// writes without blocking, queueing whatever the socket won't accept.
+// it's only used for one response at a time whose body is no bigger
+// than MULTIPLEX_OUTPUT, since bigger ones are deferred to a worker,
+// and the loop won't serve the conn again until poll() drains it
+static ssize_t WritevQueued(int fd, struct iovec *iov, int iovlen) {
+  int i;
+  ssize_t rc;
+  size_t wrote, total;
+  for (total = i = 0; i < iovlen; ++i) {
+    total += iov[i].iov_len;
+  }
+  wrote = 0;
+  if (!activeconn->out) {
+    if ((rc = writev(fd, iov, iovlen)) != -1) {
+      wrote = rc;
+    } else if (errno == EINTR || errno == EAGAIN) {
+      errno = 0;
+    } else {
+      return -1;
+    }
+  }
+  for (i = 0; i < iovlen; ++i) {
+    if (wrote >= iov[i].iov_len) {
+      wrote -= iov[i].iov_len;
+    } else {
+      appendd(&activeconn->out, (char *)iov[i].iov_base + wrote,
+              iov[i].iov_len - wrote);
+      wrote = 0;
+    }
+  }
+  return total;
+}
+
+static void EnterConn(struct Conn *c) {
+  activeconn = c;
+  client = c->fd;
+  clientaddr = c->addr;
+  serveraddr = c->server;
+  startconnection = c->start;
+  messageshandled = c->messages;
+  connectionclose = false;
+  writer = WritevQueued;
+  if ((amtread = c->amtread)) {
+    memcpy(inbuf.p, c->buf, amtread);
+    Free(&c->buf);
+    c->amtread = 0;
+  }
+}
+
+static void LeaveConn(struct Conn *c) {
+  if (amtread) {
+    c->buf = xmalloc(amtread);
+    memcpy(c->buf, inbuf.p, amtread);
+    c->amtread = amtread;
+    amtread = 0;
+  }
+  c->messages = messageshandled;
+  c->last = timespec_real();
+  writer = WritevAll;
+  activeconn = 0;
+}
+
+static void DropConn(size_t j) {
+  struct Conn *c;
+  c = conns.p + j;
+  free(c->buf);
+  free(c->out);
+  if (c->msg) {
+    DestroyHttpMessage(c->msg);
+    free(c->msg);
+  }
+  conns.p[j] = conns.p[--conns.n];
+  amtread = 0;
+  writer = WritevAll;
+  activeconn = 0;
+}
+
+static void CloseConn(size_t j, const char *reason) {
+  LogClose(reason);
+  close(conns.p[j].fd);
+  LockInc(&shared->c.connectionshandled);
+  DropConn(j);
+}
+
+static void CloseConns(void) {
+  while (conns.n) {
+    close(conns.p[conns.n - 1].fd);
+    DropConn(conns.n - 1);
+  }
+}
+
+// closes keep-alive connections that've been idle longer than timeout
+static void ExpireConns(void) {
+  size_t j;
+  struct timespec now, idle;
+  if (timeout.tv_sec < 0) {
+    idle = timespec_fromseconds(-timeout.tv_sec);
+  } else {
+    idle = timeval_totimespec(timeout);
+  }
+  if (!conns.n || !timespec_cmp(idle, timespec_zero))
+    return;
+  now = timespec_real();
+  for (j = conns.n; j--;) {
+    if (!conns.p[j].out &&
+        timespec_cmp(timespec_sub(now, conns.p[j].last), idle) >= 0) {
+      LockInc(&shared->c.readtimeouts);
+      EnterConn(conns.p + j);
+      CloseConn(j, "read timeout");
+    }
+  }
+}
+
 static ssize_t SendString(const char *s) {
   size_t n;
   ssize_t rc;
@@ -5716,6 +7614,7 @@ static ssize_t SendString(const char *s) {
   if (logmessages) {
     LogMessage("sending", s, n);
   }
+  FlushPipeline();
   for (;;) {
     if ((rc = writer(client, &iov, 1)) != -1 || errno != EINTR) {
       return rc;
@@ -5877,6 +7776,7 @@ static void HandleFrag(size_t got) {
 
 static void HandleReload(void) {
   LockInc(&shared->c.reloads);
+  InvalidateStatCache();
   LuaOnServerReload(Reindex());
   invalidated = false;
 }
@@ -5892,6 +7792,7 @@ static void HandleHeartbeat(void) {
   CallSimpleHookIfDefined("OnServerHeartbeat");
   CollectGarbage();
 #endif
+  ExpireConns();
   for (i = 1; i < servers.n; ++i) {
     if (polls[i].fd < 0) {
       polls[i].fd = -polls[i].fd;
@@ -5913,6 +7814,9 @@ static char *OpenAsset(struct Asset *a) {
     } else {
     OpenAgain:
       if ((fd = open(a->file->path.s, O_RDONLY)) != -1) {
+        if (statcache && fstat(fd, &a->file->st) != -1) {
+          size = a->file->st.st_size;  // cached size might be stale
+        }
         data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
         if (data != MAP_FAILED) {
           LockInc(&shared->c.maps);
@@ -6247,11 +8151,31 @@ static inline bool IsLua(struct Asset *a) {
          READ32LE(p + n - 4) == ('.' | 'l' << 8 | 'u' << 16 | 'a' << 24);
 }
 
+// releases state of a generator that won't get to run
+static void DropGenerator(void) {
+  if (cpm.generator == DeflateGenerator) {
+    deflateEnd(&dg.s);
+  } else if (cpm.generator == InflateGenerator ||
+             cpm.generator == InflateRangeGenerator) {
+    inflateEnd(&dg.s);
+  }
+  cpm.generator = 0;
+}
+
+// tells the event loop to hand the connection off to a forked worker
+static char *DeferRequest(void) {
+  multiplexdefer = true;
+  return hdrbuf.p;
+}
+
 static char *HandleAsset(struct Asset *a, const char *path, size_t pathlen) {
   char *p;
 #ifndef STATIC
-  if (IsLua(a))
+  if (IsLua(a)) {
+    if (ismultiplexing)
+      return DeferRequest();
     return ServeLua(a, path, pathlen);
+  }
 #endif
   if (cpm.msg.method == kHttpGet || cpm.msg.method == kHttpHead) {
     LockInc(&shared->c.staticrequests);
@@ -6287,6 +8211,15 @@ static bool IsNotModified(struct Asset *a) {
                            HeaderLength(kHttpIfModifiedSince));
 }
 
+static bool ShouldCompressAsset(struct Asset *a, const char *ct) {
+  return !IsTiny() && cpm.msg.method != kHttpHead && !IsSslCompressed() &&
+         ClientAcceptsGzip() && !ShouldAvoidGzip() &&
+         !(a->file && IsNoCompressExt(a->file->path.s, a->file->path.n)) &&
+         ((cpm.contentlength >= 100 && startswithi(ct, "text/")) ||
+          (cpm.contentlength >= 1000 &&
+           MeasureEntropy(cpm.content, 1000) < 7));
+}
+
 static char *ServeAsset(struct Asset *a, const char *path, size_t pathlen) {
   char *p;
   const char *ct;
@@ -6301,30 +8234,37 @@ static char *ServeAsset(struct Asset *a, const char *path, size_t pathlen) {
     } else if ((p = OpenAsset(a))) {
       return p;
     }
-    if (IsCompressed(a)) {
+    if (IsZstd(a)) {
+      if (ClientAcceptsZstd()) {
+        p = ServeAssetPrecompressedZstd(a);
+      } else {
+        p = ServeAssetUnzstd(a);
+      }
+    } else if (IsCompressed(a)) {
       if (ClientAcceptsGzip()) {
         p = ServeAssetPrecompressed(a);
+      } else if (cpm.msg.version >= 11 && HasHeader(kHttpRange) &&
+                 (p = ServeAssetCompressedRange(a))) {
+        // served from nearest access point
       } else {
         p = ServeAssetDecompressed(a);
       }
     } else if (cpm.msg.version >= 11 && HasHeader(kHttpRange)) {
       p = ServeAssetRange(a);
     } else if (!a->file) {
-      LockInc(&shared->c.identityresponses);
-      DEBUGF("(zip) ServeAssetZipIdentity(%`'s)", ct);
-      if (Verify(cpm.content, cpm.contentlength,
-                 ZIP_LFILE_CRC32(zmap + a->lf))) {
-        p = SetStatus(200, "OK");
+      if (ShouldCompressAsset(a, ct) && (p = ServeAssetCached(a))) {
+        VERBOSEF("serving cached compressed asset");
       } else {
-        return ServeError(500, "Internal Server Error");
+        LockInc(&shared->c.identityresponses);
+        DEBUGF("(zip) ServeAssetZipIdentity(%`'s)", ct);
+        if (Verify(cpm.content, cpm.contentlength,
+                   ZIP_LFILE_CRC32(zmap + a->lf))) {
+          p = SetStatus(200, "OK");
+        } else {
+          return ServeError(500, "Internal Server Error");
+        }
       }
-    } else if (!IsTiny() && cpm.msg.method != kHttpHead && !IsSslCompressed() &&
-               ClientAcceptsGzip() && !ShouldAvoidGzip() &&
-               !(a->file &&
-                 IsNoCompressExt(a->file->path.s, a->file->path.n)) &&
-               ((cpm.contentlength >= 100 && startswithi(ct, "text/")) ||
-                (cpm.contentlength >= 1000 &&
-                 MeasureEntropy(cpm.content, 1000) < 7))) {
+    } else if (ShouldCompressAsset(a, ct)) {
       VERBOSEF("serving compressed asset");
       p = ServeAssetCompressed(a);
     } else {
@@ -6338,7 +8278,8 @@ static char *ServeAsset(struct Asset *a, const char *path, size_t pathlen) {
     if (!cpm.gotcachecontrol) {
       p = AppendCache(p, cacheseconds, cachedirective);
     }
-    if (!IsCompressed(a)) {
+    if (!IsCompressed(a) ||
+        (inflateindex && !IsZstd(a) && !ClientAcceptsGzip())) {
       p = stpcpy(p, "Accept-Ranges: bytes\r\n");
     }
   }
@@ -6377,8 +8318,94 @@ static inline bool MustNotIncludeMessageBody(void) { /* RFC2616 § 4.4 */
          cpm.statuscode == 204 || cpm.statuscode == 304;
 }
 
+static void SetCork(int x) {
+  if (TCP_CORK) {
+    setsockopt(client, IPPROTO_TCP, TCP_CORK, &x, sizeof(x));
+  }
+}
+
+// returns true if response body can be copied from zip by the kernel
+static bool ShouldSendFile(void) {
+  return writer == WritevAll && zmapfd != -1 &&
+         cpm.contentlength >= SENDFILE_THRESHOLD &&
+         (uint8_t *)cpm.content >= zmap &&
+         (uint8_t *)cpm.content + cpm.contentlength <= zmap + zsize;
+}
+
+// sends response, where body in iov[i] is transmitted using sendfile()
+// from the zip executable, so its pages never get touched in userspace
+static void SendFileResponse(struct iovec *iov, int iovlen, int i) {
+  ssize_t rc;
+  int64_t off;
+  size_t sent;
+  SetCork(1);
+  if (Send(iov, i) != -1) {
+    off = (uint8_t *)iov[i].iov_base - zmap;
+    for (sent = 0; sent < iov[i].iov_len;) {
+      if ((rc = sendfile(client, zmapfd, &off, iov[i].iov_len - sent)) > 0) {
+        sent += rc;
+      } else if (rc == -1 && errno == EINTR) {
+        LockInc(&shared->c.writeinterruputs);
+        errno = 0;
+        if (killed || IsTakingTooLong()) {
+          connectionclose = true;
+          SetCork(0);
+          return;
+        }
+      } else if (!sent && (rc == 0 || errno == ENOSYS || errno == EINVAL ||
+                           errno == EOPNOTSUPP)) {
+        // kernel can't send this file so fall back to writev()
+        errno = 0;
+        break;
+      } else {
+        HandleSendError();
+        SetCork(0);
+        return;
+      }
+    }
+    if (sent) {
+      LockInc(&shared->c.sendfiles);
+      iov[i].iov_base = (char *)iov[i].iov_base + sent;
+      iov[i].iov_len -= sent;
+    }
+    Send(iov + i, iovlen - i);
+  }
+  SetCork(0);
+}
+
+// returns true if response may wait until we're about to read again,
+// which is the case when client has already sent us another request
+static bool ShouldPipeline(void) {
+  return ispipelining && !connectionclose && !killed && cpm.msgsize &&
+         cpm.msgsize < amtread && cpm.msg.version >= 10;
+}
+
+// adds response to pipeline, taking ownership of hdrbuf
+static void PipelineResponse(struct iovec *iov, int iovlen) {
+  int i, j;
+  struct Buffer t;
+  if (pipeline.n == PIPELINE_DEPTH) {
+    FlushPipeline();
+  }
+  i = pipeline.n++;
+  if (!pipeline.ring[i].p) {
+    pipeline.ring[i].n = hdrbuf.n;
+    pipeline.ring[i].p = xmalloc(hdrbuf.n);
+  }
+  t = pipeline.ring[i];
+  pipeline.ring[i] = hdrbuf;
+  hdrbuf = t;
+  for (j = 0; j < iovlen; ++j) {
+    if (iov[j].iov_base == gzip_footer) {
+      memcpy(pipeline.footers[i], gzip_footer, sizeof(gzip_footer));
+      iov[j].iov_base = pipeline.footers[i];
+    }
+    pipeline.iov[pipeline.iovlen++] = iov[j];
+  }
+}
+
 static bool TransmitResponse(char *p) {
-  int iovlen;
+  int iovlen, bodyidx;
   struct iovec iov[4];
   long actualcontentlength;
   if (cpm.msg.version >= 10) {
@@ -6396,12 +8423,14 @@ static bool TransmitResponse(char *p) {
     iov[0].iov_base = hdrbuf.p;
     iov[0].iov_len = p - hdrbuf.p;
     iovlen = 1;
+    bodyidx = -1;
     if (!MustNotIncludeMessageBody()) {
       if (cpm.gzipped) {
         iov[iovlen].iov_base = (void *)kGzipHeader;
         iov[iovlen].iov_len = sizeof(kGzipHeader);
         ++iovlen;
       }
+      bodyidx = iovlen;
       iov[iovlen].iov_base = cpm.content;
       iov[iovlen].iov_len = cpm.contentlength;
       ++iovlen;
@@ -6415,17 +8444,26 @@ static bool TransmitResponse(char *p) {
     iov[0].iov_base = cpm.content;
     iov[0].iov_len = cpm.contentlength;
     iovlen = 1;
+    bodyidx = -1;
+  }
+  if (h2.sid) {
+    SendHttp2(iov[0].iov_base, iov[0].iov_len, iov + 1, iovlen - 1, true);
+  } else if (bodyidx != -1 && ShouldSendFile()) {
+    FlushPipeline();
+    SendFileResponse(iov, iovlen, bodyidx);
+  } else if (ShouldPipeline()) {
+    PipelineResponse(iov, iovlen);
+  } else {
+    Send(iov, iovlen);
   }
-  Send(iov, iovlen);
   LockInc(&shared->c.messageshandled);
   ++messageshandled;
   return true;
 }
 
 static bool StreamResponse(char *p) {
-  int rc;
-  struct iovec iov[6];
-  char *s, chunkbuf[23];
+  ssize_t rc;
+  struct iovec iov[3];
   assert(!MustNotIncludeMessageBody());
   if (cpm.msg.version >= 11) {
     p = stpcpy(p, "Transfer-Encoding: chunked\r\n");
@@ -6437,41 +8475,28 @@ static bool StreamResponse(char *p) {
   if (logmessages) {
     LogMessage("sending", hdrbuf.p, p - hdrbuf.p);
   }
-  bzero(iov, sizeof(iov));
   if (cpm.msg.version >= 10) {
-    iov[0].iov_base = hdrbuf.p;
-    iov[0].iov_len = p - hdrbuf.p;
-  }
-  if (cpm.msg.version >= 11) {
-    iov[5].iov_base = "\r\n";
-    iov[5].iov_len = 2;
+    cpm.hdrpending = p - hdrbuf.p;
   }
   for (;;) {
-    iov[2].iov_base = 0;
-    iov[2].iov_len = 0;
-    iov[3].iov_base = 0;
-    iov[3].iov_len = 0;
-    iov[4].iov_base = 0;
-    iov[4].iov_len = 0;
-    if ((rc = cpm.generator(iov + 2)) <= 0)
+    bzero(iov, sizeof(iov));
+    if ((rc = cpm.generator(iov)) <= 0)
       break;
-    if (cpm.msg.version >= 11) {
-      s = chunkbuf;
-      s += uint64toarray_radix16(rc, s);
-      s = AppendCrlf(s);
-      iov[1].iov_base = chunkbuf;
-      iov[1].iov_len = s - chunkbuf;
-    }
-    if (Send(iov, 6) == -1)
+    if (SendChunk(iov, rc) == -1)
       break;
-    iov[0].iov_base = 0;
-    iov[0].iov_len = 0;
   }
-  if (rc != -1) {
+  if (rc != -1 && h2.sid) {
+    SendHttp2(hdrbuf.p, cpm.hdrpending, 0, 0, true);
+  } else if (rc != -1) {
+    bzero(iov, sizeof(iov));
+    iov[0].iov_base = hdrbuf.p;
+    iov[0].iov_len = cpm.hdrpending;
     if (cpm.msg.version >= 11) {
-      iov[0].iov_base = "0\r\n\r\n";
-      iov[0].iov_len = 5;
-      Send(iov, 1);
+      iov[1].iov_base = "0\r\n\r\n";
+      iov[1].iov_len = 5;
+    }
+    if (iov[0].iov_len + iov[1].iov_len) {
+      Send(iov, 2);
     }
   } else {
     connectionclose = true;
@@ -6479,6 +8504,13 @@ static bool StreamResponse(char *p) {
   return true;
 }
 
+// returns true if event loop can serve message without forking, which
+// requires it to have no payload and not be routed through lua hooks
+static bool IsMultiplexable(void) {
+  return !hasonhttprequest && !HasHeader(kHttpContentLength) &&
+         !HasHeader(kHttpTransferEncoding) && !HasHeader(kHttpExpect);
+}
+
 static bool HandleMessageActual(void) {
   int rc;
   long reqtime, contime;
@@ -6488,10 +8520,23 @@ static bool HandleMessageActual(void) {
     if (!rc)
       return false;
     hdrsize = rc;
+    if (ismultiplexing && !IsMultiplexable()) {
+      DeferRequest();
+      return true;
+    }
     if (logmessages) {
       LogMessage("received", inbuf.p, hdrsize);
     }
     p = HandleRequest();
+    if (multiplexdefer)
+      return true;
+    if (ismultiplexing &&
+        (cpm.generator || cpm.contentlength > MULTIPLEX_OUTPUT)) {
+      // the body would pile up in the conn's output queue
+      DropGenerator();
+      DeferRequest();
+      return true;
+    }
   } else {
     LockInc(&shared->c.badmessages);
     connectionclose = true;
@@ -6548,18 +8593,146 @@ static bool HandleMessageActual(void) {
   }
 }
 
-static bool HandleMessage(void) {
-  bool r;
-  ishandlingrequest = true;
-  r = HandleMessageActual();
-  ishandlingrequest = false;
-  return r;
-}
-
-static void InitRequest(void) {
-  assert(!cpm.outbuf);
-  bzero(&cpm, sizeof(cpm));
-}
+static bool HandleMessage(void) {
+  bool r;
+  ishandlingrequest = true;
+  r = HandleMessageActual();
+  ishandlingrequest = false;
+  return r;
+}
+
+static void InitRequest(void) {
+  assert(!cpm.outbuf);
+  bzero(&cpm, sizeof(cpm));
+}
+
+#ifndef UNSECURE
+
+static void SendHttp2Status(const char *status) {
+  char *p, buf[128];
+  p = stpcpy(stpcpy(buf, "HTTP/1.1 "), status);
+  p = stpcpy(p, "\r\nContent-Length: 0\r\n\r\n");
+  SendHttp2(buf, p - buf, 0, 0, true);
+}
+
+// returns stream whose request arrived in full the longest time ago
+static struct Http2Stream *GetReadyHttp2Stream(void) {
+  size_t i;
+  struct Http2Stream *s, *r;
+  for (r = 0, i = 0; i < h2.streams.n; ++i) {
+    s = h2.streams.p + i;
+    if (s->ended && !s->reset && (!r || s->seq < r->seq)) {
+      r = s;
+    }
+  }
+  return r;
+}
+
+// serves stream by feeding it to HandleMessage() as http/1.1 message
+static void ServeHttp2Stream(struct Http2Stream *s) {
+  char *p;
+  size_t n, m;
+  InitRequest();
+  h2.sid = s->id;
+  h2.responded = false;
+  startrequest = timespec_real();
+  n = appendz(s->head).i;
+  m = appendz(s->body).i;
+  if (s->huge) {
+    LockInc(&shared->c.hugepayloads);
+    SendHttp2Status("413 Payload Too Large");
+  } else if (s->toobig || n + m + 32 > inbuf.n) {
+    LockInc(&shared->c.hugepayloads);
+    SendHttp2Status("431 Request Header Fields Too Large");
+  } else {
+    p = mempcpy(inbuf.p, s->head, n);
+    if (m || !s->getlike)
+      p = AppendContentLength(p, m);
+    p = AppendCrlf(p);
+    p = mempcpy(p, s->body, m);
+    amtread = p - inbuf.p;
+    Free(&s->head);
+    Free(&s->body);
+    HandleMessage();  // may read frames and move streams
+    if (!h2.responded) {
+      SendHttp2Status("400 Bad Request");
+    }
+  }
+  DropHttp2Stream(h2.sid);
+  CollectGarbage();
+  amtread = 0;
+  connectionclose = false;
+  h2.sid = 0;
+}
+
+static void HandleHttp2(void) {
+  size_t i;
+  unsigned char b[18];
+  struct Http2Stream *s;
+  LockInc(&shared->c.http2);
+  DEBUGF("(clnt) %s negotiated http/2", DescribeClient());
+  bzero(&h2, sizeof(h2));
+  h2.maxframe = kHttp2DefaultFrameSize;
+  h2.window = kHttp2DefaultWindow;
+  h2.initwindow = kHttp2DefaultWindow;
+  h2.p = xmalloc(HTTP2_BUFFER);
+  InitHpack(&h2.hpack, kHpackTableSize);
+  WRITE16BE(b + 0, kHttp2SettingsMaxConcurrentStreams);
+  WRITE32BE(b + 2, HTTP2_MAX_STREAMS);
+  WRITE16BE(b + 6, kHttp2SettingsInitialWindowSize);
+  WRITE32BE(b + 8, HTTP2_WINDOW);
+  WRITE16BE(b + 12, kHttp2SettingsMaxHeaderListSize);
+  WRITE32BE(b + 14, HTTP2_HEADER_LIST);
+  SendHttp2Small(kHttp2Settings, 0, 0, b, sizeof(b));
+  SendHttp2WindowUpdate(0, HTTP2_WINDOW - kHttp2DefaultWindow);
+  while (h2.n < sizeof(kHttp2Preface) - 1) {
+    if (!ReadHttp2())
+      goto Finish;
+  }
+  if (memcmp(h2.p, kHttp2Preface, sizeof(kHttp2Preface) - 1)) {
+    Http2Error(kHttp2ProtocolError, "sent bad preface");
+    goto Finish;
+  }
+  h2.n -= sizeof(kHttp2Preface) - 1;
+  memmove(h2.p, h2.p + sizeof(kHttp2Preface) - 1, h2.n);
+  for (;;) {
+    ProcessHttp2();
+    while (!h2.dead && !killed && (s = GetReadyHttp2Stream())) {
+      ServeHttp2Stream(s);
+      if (invalidated) {
+        HandleReload();
+      }
+    }
+    if (h2.closing || killed || terminated || meltdown ||
+        (h2.goaway && !h2.streams.n)) {
+      break;
+    }
+    if (invalidated) {
+      HandleReload();
+    }
+    if (!ReadHttp2())
+      break;
+  }
+Finish:
+  if (!h2.dead) {
+    WRITE32BE(b, h2.lastsid);
+    WRITE32BE(b + 4, kHttp2NoError);
+    SendHttp2Small(kHttp2Goaway, 0, 0, b, 8);
+    NotifyClose();
+    TlsFlush(&g_bio, 0, 0);
+  }
+  LogClose(h2.why ? h2.why : DescribeClose());
+  for (i = 0; i < h2.streams.n; ++i) {
+    free(h2.streams.p[i].head);
+    free(h2.streams.p[i].body);
+  }
+  DestroyHpack(&h2.hpack);
+  free(h2.block);
+  free(h2.p);
+  bzero(&h2, sizeof(h2));
+}
+
+#endif /* UNSECURE */
 
 static bool IsSsl(unsigned char c) {
   if (c == 22)
@@ -6571,11 +8744,12 @@ static bool IsSsl(unsigned char c) {
   return true;
 }
 
-static void HandleMessages(void) {
+static void HandleMessagesActual(void) {
   bool once;
   ssize_t rc;
   size_t got;
   (void)once;
+  ispipelining = true;
   for (once = false;;) {
     InitRequest();
     startread = timespec_real();
@@ -6585,6 +8759,7 @@ static void HandleMessages(void) {
         if (HandleMessage())
           break;
       }
+      FlushPipeline();
       if ((rc = reader(client, inbuf.p + amtread, inbuf.n - amtread)) != -1) {
         startrequest = timespec_real();
         got = rc;
@@ -6596,6 +8771,10 @@ static void HandleMessages(void) {
             if (!unsecure) {
               if (IsSsl(inbuf.p[0])) {
                 if (TlsSetup()) {
+                  if (http2 && IsHttp2Negotiated()) {
+                    HandleHttp2();
+                    return;
+                  }
                   continue;
                 } else {
                   return;
@@ -6685,18 +8864,45 @@ static void HandleMessages(void) {
         return;
       }
     }
-    CollectGarbage();
+    if (!pipeline.n) {
+      CollectGarbage();
+    } else {
+      // bodies of pipelined responses are still referenced
+      __log_level = oldloglevel;
+      DestroyHttpMessage(&cpm.msg);
+    }
     if (invalidated) {
+      FlushPipeline();
       HandleReload();
     }
   }
 }
 
+// serves connection, where responses still waiting in the pipeline when
+// we bail out early, e.g. because we got killed, are dropped along with
+// the bodies they reference, so they can't leak into the next client
+static void HandleMessages(void) {
+  HandleMessagesActual();
+  if (pipeline.n) {
+    DEBUGF("(rsp) %s dropping %d pipelined responses", DescribeClient(),
+           pipeline.n);
+    pipeline.n = 0;
+    pipeline.iovlen = 0;
+  }
+  CollectGarbage();
+}
+
 static void CloseServerFds(void) {
   size_t i;
   for (i = 0; i < servers.n; ++i) {
     close(servers.p[i].fd);
   }
+  if (workerpool.fds) {
+    for (i = servers.n; i < workerpool.n * servers.n; ++i) {
+      close(workerpool.fds[i]);
+    }
+    Free(&workerpool.fds);
+  }
 }
 
 static int ExitWorker(void) {
@@ -6736,13 +8942,84 @@ static int EnableSandbox(void) {
   }
 }
 
+static void EnterWorker(void) {
+  lua_repl_wock();
+  lua_repl_lock();
+  meltdown = false;
+  __isworker = true;
+  if (!IsTiny() && systrace) {
+    kStartTsc = rdtsc();
+  }
+  TRACE_BEGIN;
+  if (sandboxed) {
+    CHECK_NE(-1, EnableSandbox());
+  }
+  if (hasonworkerstart) {
+    CallSimpleHook("OnWorkerStart");
+  }
+}
+
+// hands accepted client over to the event loop
+static void AdoptConn(void) {
+  struct Conn *c;
+  if (conns.n == conns.c) {
+    conns.c = conns.c ? conns.c + (conns.c >> 1) : 16;
+    conns.p = xrealloc(conns.p, conns.c * sizeof(*conns.p));
+    polls = xrealloc(polls, (1 + servers.n + conns.c) * sizeof(*polls));
+  }
+  c = conns.p + conns.n++;
+  bzero(c, sizeof(*c));
+  c->fd = client;
+  c->addr = clientaddr;
+  c->server = serveraddr;
+  c->start = c->last = startconnection;
+  fcntl(client, F_SETFL, O_NONBLOCK);
+  LockInc(&shared->c.multiplexedconnections);
+}
+
+// linux tcp_info prefix, where for listening sockets the unacked and
+// sacked fields hold the accept queue length and backlog respectively
+struct LinuxTcpInfo {
+  uint8_t state, ca_state, retransmits, probes, backoff, options, wscale, misc;
+  uint32_t rto, ato, snd_mss, rcv_mss;
+  uint32_t unacked, sacked, lost, retrans, fackets;
+  uint32_t last_data_sent, last_ack_sent, last_data_recv, last_ack_recv;
+};
+
+// samples how long clients wait to be accepted and how often the listen
+// queue is full, which costs two system calls, so the counters are only
+// updated for one in every ACCEPT_SAMPLE_RATE accepts and then scaled
+static void MeasureAccept(int server) {
+  uint32_t n;
+  struct LinuxTcpInfo ti;
+  static unsigned long accepts;
+  if (!IsLinux() || accepts++ % ACCEPT_SAMPLE_RATE)
+    return;
+  n = sizeof(ti);
+  if (!getsockopt(client, SOL_TCP, TCP_INFO, &ti, &n) && n >= sizeof(ti)) {
+    atomic_fetch_add_explicit(&shared->c.acceptlatencyms,
+                              (long)ti.last_ack_recv * ACCEPT_SAMPLE_RATE,
+                              memory_order_relaxed);
+  }
+  n = sizeof(ti);
+  if (!getsockopt(server, SOL_TCP, TCP_INFO, &ti, &n) && n >= sizeof(ti) &&
+      ti.sacked && ti.unacked >= ti.sacked) {
+    atomic_fetch_add_explicit(&shared->c.listenoverflows, ACCEPT_SAMPLE_RATE,
+                              memory_order_relaxed);
+  }
+}
+
 static int HandleConnection(size_t i) {
   uint32_t ip;
   int pid, tok, rc = 0;
   clientaddrsize = sizeof(clientaddr);
   if ((client = accept4(servers.p[i].fd, (struct sockaddr *)&clientaddr,
                         &clientaddrsize, SOCK_CLOEXEC)) != -1) {
+    // pool listeners are non-blocking and bsd accept() inherits that
+    if (workerpool.n && !IsLinux())
+      fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
     LockInc(&shared->c.accepts);
+    MeasureAccept(servers.p[i].fd);
     GetClientAddr(&ip, 0);
     if (tokenbucket.cidr && tokenbucket.reject >= 0) {
       if (!IsTrustedIp(ip)) {
@@ -6779,7 +9056,7 @@ static int HandleConnection(size_t i) {
       DEBUGF("(token) can't acquire accept() token for client");
     }
     startconnection = timespec_real();
-    if (UNLIKELY(maxworkers) &&
+    if (UNLIKELY(maxworkers) && !workerpool.n &&
         atomic_load_explicit(&shared->workers, memory_order_relaxed) >=
             maxworkers) {
       EnterMeltdownMode();
@@ -6796,24 +9073,19 @@ static int HandleConnection(size_t i) {
     if (uniprocess) {
       pid = -1;
       connectionclose = true;
+    } else if (workerpool.n) {
+      // we're a long-lived worker, since the pool's main process never
+      // polls its listeners, so serve the connection in this process
+      pid = -1;
+      connectionclose = false;
+    } else if (multiplex) {
+      AdoptConn();
+      return 0;
     } else {
       switch ((pid = fork())) {
         case 0:
-          lua_repl_wock();
-          lua_repl_lock();
-          meltdown = false;
-          __isworker = true;
           connectionclose = false;
-          if (!IsTiny() && systrace) {
-            kStartTsc = rdtsc();
-          }
-          TRACE_BEGIN;
-          if (sandboxed) {
-            CHECK_NE(-1, EnableSandbox());
-          }
-          if (hasonworkerstart) {
-            CallSimpleHook("OnWorkerStart");
-          }
+          EnterWorker();
           break;
         case -1:
           HandleForkFailure();
@@ -6840,6 +9112,9 @@ static int HandleConnection(size_t i) {
       }
       rc = ExitWorker();
     } else {
+      if (workerpool.n) {
+        LockInc(&shared->c.connectionshandled);
+      }
       close(client);
       oldin.p = 0;
       oldin.n = 0;
@@ -6904,6 +9179,165 @@ static int HandleConnection(size_t i) {
   return rc;
 }
 
+// forks a worker to serve the rest of a multiplexed connection, which
+// happens when a message needs lua or a payload that'd block the loop
+static int DeferConn(size_t j) {
+  int pid;
+  size_t k;
+  LockInc(&shared->c.multiplexdefers);
+  writer = WritevAll;
+  activeconn = 0;
+  switch ((pid = fork())) {
+    case 0:
+      connectionclose = false;
+      EnterWorker();
+      fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+      if (!IsWindows()) {
+        CloseServerFds();
+        for (k = 0; k < conns.n; ++k) {
+          if (k != j) {
+            close(conns.p[k].fd);
+          }
+        }
+      }
+      HandleMessages();
+      DEBUGF("(stat) %s closing after %,ldµs", DescribeClient(),
+             timespec_tomicros(timespec_sub(timespec_real(), startconnection)));
+      if (hasonworkerstop) {
+        CallSimpleHook("OnWorkerStop");
+      }
+      return ExitWorker();
+    case -1:
+      HandleForkFailure();
+      DropConn(j);
+      return 1;
+    default:
+      LockInc(&shared->workers);
+      close(client);
+      DropConn(j);
+      ReseedRng(&rng, "parent");
+      if (hasonprocesscreate) {
+        LuaOnProcessCreate(pid);
+      }
+      return 1;
+  }
+}
+
+// serves buffered messages until one is incomplete or output backs up
+// returning -1 if we're a worker that's exiting, 1 if conn was handed
+// off to a worker, or otherwise 0
+static int ServeConn(size_t j) {
+  struct Conn *c;
+  c = conns.p + j;
+  while (amtread && !c->out && !c->closing) {
+    InitRequest();
+    if (c->msg) {
+      cpm.msg = *c->msg;
+      Free(&c->msg);
+    }
+    startrequest = timespec_real();
+    multiplexdefer = false;
+    ismultiplexing = true;
+    if (!HandleMessage()) {
+      ismultiplexing = false;
+      // save parser state so it resumes when more data arrives
+      c->msg = xmalloc(sizeof(*c->msg));
+      *c->msg = cpm.msg;
+      bzero(&cpm.msg, sizeof(cpm.msg));
+      break;
+    }
+    ismultiplexing = false;
+    if (multiplexdefer) {
+      CollectGarbage();
+      return DeferConn(j);
+    }
+    if (cpm.msgsize && cpm.msgsize < amtread) {
+      LockInc(&shared->c.pipelinedrequests);
+      DEBUGF("(stat) %,ld pipelinedrequest bytes", amtread - cpm.msgsize);
+      memmove(inbuf.p, inbuf.p + cpm.msgsize, amtread - cpm.msgsize);
+      amtread -= cpm.msgsize;
+    } else {
+      amtread = 0;
+    }
+    CollectGarbage();
+    if (connectionclose || killed || terminated || meltdown) {
+      c->closing = true;
+    }
+  }
+  return 0;
+}
+
+// handles readiness of a client connection owned by the event loop
+static int HandleConnEvent(size_t j, int revents) {
+  int rc;
+  ssize_t got;
+  struct Conn *c;
+  unsigned char b;
+  c = conns.p + j;
+  EnterConn(c);
+  if (c->out) {
+    if ((got = write(client, c->out + c->outi,
+                     appendz(c->out).i - c->outi)) != -1) {
+      if ((c->outi += got) == appendz(c->out).i) {
+        Free(&c->out);
+        c->outi = 0;
+      }
+    } else if (errno == EINTR || errno == EAGAIN) {
+      errno = 0;
+    } else {
+      LockInc(&shared->c.writeerrors);
+      CloseConn(j, "write error");
+      return 0;
+    }
+  } else if (revents & (POLLIN | POLLHUP | POLLERR)) {
+    if (!c->sniffed) {
+      if (unsecure) {
+        c->sniffed = true;
+      } else if ((got = recv(client, &b, 1, MSG_PEEK | MSG_DONTWAIT)) == 1) {
+        c->sniffed = true;
+        if (IsSsl(b)) {
+          return DeferConn(j) == -1 ? -1 : 0;
+        } else if (requiressl) {
+          INFOF("(clnt) %s didn't send an ssl hello", DescribeClient());
+          CloseConn(j, "disconnect");
+          return 0;
+        }
+      } else if (got == -1 && (errno == EINTR || errno == EAGAIN)) {
+        errno = 0;  // spurious wakeup, so wait for poll() to say again
+        LeaveConn(c);
+        return 0;
+      }
+    }
+    startread = timespec_real();
+    if ((got = read(client, inbuf.p + amtread, inbuf.n - amtread)) > 0) {
+      DEBUGF("(stat) %s read %,zd bytes", DescribeClient(), got);
+      amtread += got;
+    } else if (!got) {
+      CloseConn(j, "disconnect");
+      return 0;
+    } else if (errno == EINTR || errno == EAGAIN) {
+      errno = 0;
+    } else if (errno == ECONNRESET) {
+      LockInc(&shared->c.readresets);
+      CloseConn(j, "read reset");
+      return 0;
+    } else {
+      LockInc(&shared->c.readerrors);
+      WARNF("(clnt) %s read error: %m", DescribeClient());
+      CloseConn(j, "read error");
+      return 0;
+    }
+  }
+  if ((rc = ServeConn(j)))
+    return rc == -1 ? -1 : 0;
+  if (c->closing && !c->out) {
+    CloseConn(j, DescribeClose());
+  } else {
+    LeaveConn(c);
+  }
+  return 0;
+}
+
 static void MakeExecutableModifiable(void) {
 #ifdef __x86_64__
   int ft;
@@ -6922,6 +9356,7 @@ static void MakeExecutableModifiable(void) {
   if ((zfd = __open_executable()) == -1) {
     WARNF("(srvr) can't open executable for modification: %m");
   }
+  zmapfd = zfd;
   if (ft > 0) {
     __ftrace = 0;
     ftrace_install();
@@ -6975,11 +9410,31 @@ static int HandleReadline(void) {
 
 static int HandlePoll(int ms) {
   int rc, nfds;
-  size_t pollid, serverid;
-  if ((nfds = poll(polls, 1 + servers.n, ms)) != -1) {
+  size_t npolls, pollid, serverid, nconns, connid;
+  // the pool's main process only supervises, its workers do the accepting
+  npolls = 1 + (workerpool.n ? 0 : servers.n);
+  for (connid = 0, nconns = conns.n; connid < nconns; ++connid) {
+    polls[npolls + connid].fd = conns.p[connid].fd;
+    polls[npolls + connid].events = conns.p[connid].out ? POLLOUT : POLLIN;
+    polls[npolls + connid].revents = 0;
+  }
+  if ((nfds = poll(polls, npolls + nconns, ms)) != -1) {
     if (nfds) {
+      // handle multiplexed clients in reverse since closing a connection
+      // will move the last one into its slot
+      for (connid = nconns; connid--;) {
+        if (!polls[npolls + connid].revents)
+          continue;
+        lua_repl_lock();
+        ishandlingconnection = true;
+        rc = HandleConnEvent(connid, polls[npolls + connid].revents);
+        ishandlingconnection = false;
+        lua_repl_unlock();
+        if (rc == -1)
+          return -1;
+      }
       // handle pollid/o events
-      for (pollid = 0; pollid < 1 + servers.n; ++pollid) {
+      for (pollid = 0; pollid < npolls; ++pollid) {
         if (!polls[pollid].revents)
           continue;
         if (polls[pollid].fd < 0)
@@ -7028,6 +9483,87 @@ static int HandlePoll(int ms) {
   return 0;
 }
 
+static void TuneListener(int fd) {
+  int x;
+  if (TCP_FASTOPEN) {
+    x = tcpfastopen;
+    setsockopt(fd, SOL_TCP, TCP_FASTOPEN, &x, sizeof(x));
+  }
+  if (tcpdeferaccept) {
+    x = tcpdeferaccept;
+    if (!TCP_DEFER_ACCEPT ||
+        setsockopt(fd, SOL_TCP, TCP_DEFER_ACCEPT, &x, sizeof(x)) == -1) {
+      WARNF("(srvr) TCP_DEFER_ACCEPT unavailable: %m");
+      tcpdeferaccept = 0;
+    }
+  }
+}
+
+static int GetListenBacklog(void) {
+  return listenbacklog ? listenbacklog : SOMAXCONN;
+}
+
+static bool SetReusePort(int fd) {
+  int one = 1;
+  return SO_REUSEPORT &&
+         !setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+}
+
+static int ListenReusePort(const struct sockaddr_in *addr) {
+  int fd;
+  if ((fd = GoodSocket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP, true,
+                       &timeout)) == -1) {
+    return -1;
+  }
+  TuneListener(fd);
+  if (!SetReusePort(fd) ||
+      bind(fd, (const struct sockaddr *)addr, sizeof(*addr)) == -1 ||
+      listen(fd, GetListenBacklog()) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// creates a listening socket per server per worker, so the kernel can
+// load balance incoming connections across the worker pool. otherwise
+// all workers fall back to competing for accept() on the same sockets
+static void ListenWorkerPool(void) {
+  size_t i, k;
+  if (!servers.n) {
+    workerpool.n = 0;
+    return;
+  }
+  workerpool.p = xcalloc(workerpool.n, sizeof(*workerpool.p));
+  if (workerpool.reuseport) {
+    workerpool.fds = xcalloc(workerpool.n * servers.n, sizeof(int));
+    for (i = 0; i < servers.n; ++i) {
+      workerpool.fds[i] = servers.p[i].fd;
+    }
+    for (k = servers.n; k < workerpool.n * servers.n; ++k) {
+      if ((workerpool.fds[k] =
+               ListenReusePort(&servers.p[k % servers.n].addr)) == -1) {
+        WARNF("(srvr) failed to create reuseport listener: %m");
+        while (k-- > servers.n) {
+          close(workerpool.fds[k]);
+        }
+        Free(&workerpool.fds);
+        workerpool.reuseport = false;
+        break;
+      }
+    }
+  }
+  // workers race to accept() so a listener mustn't block the loser
+  for (i = 0; i < servers.n; ++i) {
+    fcntl(servers.p[i].fd, F_SETFL, O_NONBLOCK);
+  }
+  for (k = servers.n; workerpool.fds && k < workerpool.n * servers.n; ++k) {
+    fcntl(workerpool.fds[k], F_SETFL, O_NONBLOCK);
+  }
+  INFOF("(srvr) spawning pool of %d workers%s", workerpool.n,
+        workerpool.reuseport ? " with SO_REUSEPORT" : "");
+}
+
 static void Listen(void) {
   char ipbuf[16];
   size_t i, j, n;
@@ -7036,6 +9572,8 @@ static void Listen(void) {
   if (!ports.n) {
     ProgramPort(8080);
   }
+  // only linux load balances connections across reuseport sockets
+  workerpool.reuseport = workerpool.n > 1 && IsLinux();
   if (!ips.n) {
     if (interfaces && *interfaces) {
       for (ifp = interfaces; *ifp; ++ifp) {
@@ -7058,19 +9596,24 @@ static void Listen(void) {
                                         IPPROTO_TCP, true, &timeout)) == -1) {
         DIEF("(srvr) socket: %m");
       }
+      TuneListener(servers.p[n].fd);
       if (hasonserverlisten &&
           LuaOnServerListen(servers.p[n].fd, ips.p[i], ports.p[j])) {
         close(servers.p[n].fd);
         n--;  // skip this server instance
         continue;
       }
+      if (workerpool.reuseport && !SetReusePort(servers.p[n].fd)) {
+        WARNF("(srvr) SO_REUSEPORT unavailable: %m");
+        workerpool.reuseport = false;
+      }
 
       if (bind(servers.p[n].fd, (struct sockaddr *)&servers.p[n].addr,
                sizeof(servers.p[n].addr)) == -1) {
         DIEF("(srvr) bind error: %m: %hhu.%hhu.%hhu.%hhu:%hu", ips.p[i] >> 24,
              ips.p[i] >> 16, ips.p[i] >> 8, ips.p[i], ports.p[j]);
       }
-      if (listen(servers.p[n].fd, 10) == -1) {
+      if (listen(servers.p[n].fd, GetListenBacklog()) == -1) {
         DIEF("(srvr) listen error: %m");
       }
       addrsize = sizeof(servers.p[n].addr);
@@ -7103,27 +9646,154 @@ static void Listen(void) {
     polls[1 + i].events = POLLIN;
     polls[1 + i].revents = 0;
   }
+  if (workerpool.n) {
+    ListenWorkerPool();
+  }
+}
+
+static void SignalWorkers(int sig) {
+  int i;
+  for (i = 0; i < workerpool.n; ++i) {
+    if (workerpool.p[i].pid) {
+      LOGIFNEG1(kill(workerpool.p[i].pid, sig));
+    }
+  }
 }
 
 static void HandleShutdown(void) {
   CloseServerFds();
+  CloseConns();
   INFOF("(srvr) received %s", strsignal(shutdownsig));
   if (shutdownsig != SIGINT && shutdownsig != SIGQUIT) {
     if (!killed)
       terminated = false;
     INFOF("(srvr) killing process group");
     KillGroup();
+  } else if (workerpool.n) {
+    SignalWorkers(SIGTERM);
   }
   WaitAll();
   INFOF("(srvr) shutdown complete");
 }
 
+static void AdoptWorkerListeners(size_t k) {
+  size_t i, j;
+  if (workerpool.fds) {
+    for (j = 0; j < workerpool.n * servers.n; ++j) {
+      if (j / servers.n != k) {
+        close(workerpool.fds[j]);
+      }
+    }
+    for (i = 0; i < servers.n; ++i) {
+      servers.p[i].fd = workerpool.fds[k * servers.n + i];
+    }
+    Free(&workerpool.fds);
+  }
+  polls[0].fd = -1;
+  for (i = 0; i < servers.n; ++i) {
+    polls[1 + i].fd = servers.p[i].fd;
+  }
+}
+
+// long-lived worker that accepts connections on its own listeners
+static int WorkerPoolMain(size_t k) {
+  int rc, nfds;
+  size_t i;
+  struct timespec t;
+  EnterWorker();
+  AdoptWorkerListeners(k);
+  DEBUGF("(srvr) worker %zu of %d started", k, workerpool.n);
+  while (!terminated) {
+    errno = 0;
+    meltdown = false;
+    if (invalidated) {
+      invalidated = false;
+      Reindex();
+    } else if (timespec_cmp(timespec_sub((t = timespec_real()), lastheartbeat),
+                            heartbeatinterval) >= 0) {
+      lastheartbeat = t;
+      UpdateCurrentDate(t);
+      Reindex();
+      CollectGarbage();
+    } else if ((nfds = poll(polls + 1, servers.n,
+                            timespec_tomillis(heartbeatinterval))) != -1) {
+      for (i = 0; nfds && i < servers.n; ++i) {
+        if (!polls[1 + i].revents)
+          continue;
+        if (polls[1 + i].fd < 0)
+          continue;
+        serveraddr = &servers.p[i].addr;
+        ishandlingconnection = true;
+        rc = HandleConnection(i);
+        ishandlingconnection = false;
+        if (rc == -1)
+          return -1;
+      }
+    } else if (errno == EINTR || errno == EAGAIN) {
+      LockInc(&shared->c.pollinterrupts);
+    } else if (errno == ENOMEM) {
+      LockInc(&shared->c.enomems);
+      WARNF("(srvr) poll error: ran out of memory");
+    } else {
+      DIEF("(srvr) poll error: %m");
+    }
+  }
+  if (hasonworkerstop) {
+    CallSimpleHook("OnWorkerStop");
+  }
+  return ExitWorker();
+}
+
+// forks workers into vacant pool slots, which returns -1 in the child
+// once it's done serving, otherwise the number of slots left vacant
+static int SpawnWorkers(void) {
+  int k, pid, vacant;
+  struct timespec now;
+  now = timespec_real();
+  for (vacant = k = 0; k < workerpool.n; ++k) {
+    if (workerpool.p[k].pid)
+      continue;
+    // don't hammer the system if workers are crashing on startup
+    if (timespec_cmp(timespec_sub(now, workerpool.p[k].born),
+                     timespec_fromseconds(1)) < 0) {
+      ++vacant;
+      continue;
+    }
+    workerpool.p[k].born = now;
+    switch ((pid = fork())) {
+      case 0:
+        return WorkerPoolMain(k);
+      case -1:
+        LockInc(&shared->c.forkerrors);
+        WARNF("(srvr) failed to spawn pool worker: %m");
+        ++vacant;
+        break;
+      default:
+        workerpool.p[k].pid = pid;
+        LockInc(&shared->workers);
+        ReseedRng(&rng, "parent");
+        if (hasonprocesscreate) {
+          LuaOnProcessCreate(pid);
+        }
+        break;
+    }
+  }
+  return vacant;
+}
+
 // this function coroutines with linenoise
 int EventLoop(int ms) {
+  int rc;
   struct timespec t;
   DEBUGF("(repl) event loop");
   while (!terminated) {
     errno = 0;
+    if (workerpool.n && (rc = SpawnWorkers())) {
+      if (rc == -1)
+        break;
+      if (ms < 0 || ms > 1000)
+        ms = 1000;
+    }
     if (zombied) {
       lua_repl_lock();
       ReapZombies();
@@ -7132,6 +9802,9 @@ int EventLoop(int ms) {
       lua_repl_lock();
       HandleReload();
       lua_repl_unlock();
+      if (workerpool.n) {
+        SignalWorkers(SIGUSR1);
+      }
     } else if (meltdown) {
       lua_repl_lock();
       EnterMeltdownMode();
@@ -7178,6 +9851,172 @@ static void SigInit(void) {
   InstallSignalHandler(SIGPIPE, SIG_IGN);
 }
 
+#ifndef UNSECURE
+
+static int *GetSslCacheBucket(const unsigned char *id, size_t idlen) {
+  size_t i;
+  uint32_t h;
+  for (h = i = 0; i < idlen; ++i) {
+    h = (h ^ id[i]) * 0x01000193;
+  }
+  return sslcache->buckets + (h & (sslcache->m - 1));
+}
+
+static int FindSslCache(const unsigned char *id, size_t idlen) {
+  int i;
+  for (i = *GetSslCacheBucket(id, idlen); i != -1; i = sslcache->p[i].chain) {
+    if (sslcache->p[i].idlen == idlen &&
+        !timingsafe_bcmp(sslcache->p[i].id, id, idlen)) {
+      break;
+    }
+  }
+  return i;
+}
+
+static void UnchainSslCache(int i) {
+  int *b;
+  struct SslCacheEntry *e = sslcache->p + i;
+  for (b = GetSslCacheBucket(e->id, e->idlen); *b != i;
+       b = &sslcache->p[*b].chain) {
+    unassert(*b != -1);
+  }
+  *b = e->chain;
+}
+
+static void UnlinkSslCache(int i) {
+  struct SslCacheEntry *e = sslcache->p + i;
+  if (e->prev != -1) {
+    sslcache->p[e->prev].next = e->next;
+  } else {
+    sslcache->head = e->next;
+  }
+  if (e->next != -1) {
+    sslcache->p[e->next].prev = e->prev;
+  } else {
+    sslcache->tail = e->prev;
+  }
+}
+
+static void PushSslCache(int i) {
+  struct SslCacheEntry *e = sslcache->p + i;
+  e->prev = -1;
+  e->next = sslcache->head;
+  if (sslcache->head != -1) {
+    sslcache->p[sslcache->head].prev = i;
+  } else {
+    sslcache->tail = i;
+  }
+  sslcache->head = i;
+}
+
+static int TlsGetCache(void *ctx, mbedtls_ssl_session *session) {
+  int i, len;
+  struct SslCacheEntry *e;
+  mbedtls_ssl_session tmp;
+  unsigned char buf[SSL_CACHE_DATA];
+  len = 0;
+  unassert(!pthread_mutex_lock(&sslcache->mu));
+  if ((i = FindSslCache(session->id, session->id_len)) != -1) {
+    e = sslcache->p + i;
+    if (e->expires > timespec_real().tv_sec &&
+        e->ciphersuite == session->ciphersuite &&
+        e->compression == session->compression) {
+      memcpy(buf, e->data, (len = e->len));
+      UnlinkSslCache(i);
+      PushSslCache(i);
+    }
+  }
+  unassert(!pthread_mutex_unlock(&sslcache->mu));
+  if (len) {
+    mbedtls_ssl_session_init(&tmp);
+    if (!mbedtls_ssl_session_load(&tmp, buf, len)) {
+      mbedtls_platform_zeroize(buf, len);
+      mbedtls_ssl_session_free(session);
+      *session = tmp;
+      LockInc(&shared->c.sslcachehits);
+      return 0;
+    }
+    mbedtls_platform_zeroize(buf, len);
+    mbedtls_ssl_session_free(&tmp);
+  }
+  LockInc(&shared->c.sslcachemisses);
+  return 1;
+}
+
+static int TlsSetCache(void *ctx, const mbedtls_ssl_session *session) {
+  int i, *b;
+  size_t len;
+  struct SslCacheEntry *e;
+  unsigned char buf[SSL_CACHE_DATA];
+  if (!session->id_len || session->id_len > sizeof(e->id))
+    return 1;
+  if (mbedtls_ssl_session_save(session, buf, sizeof(buf), &len)) {
+    DEBUGF("(ssl) session too large to cache");
+    return 1;
+  }
+  unassert(!pthread_mutex_lock(&sslcache->mu));
+  if ((i = FindSslCache(session->id, session->id_len)) != -1) {
+    UnlinkSslCache(i);
+  } else {
+    if (sslcache->used < sslcache->n) {
+      i = sslcache->used++;
+    } else {
+      i = sslcache->tail;
+      UnlinkSslCache(i);
+      UnchainSslCache(i);
+      LockInc(&shared->c.sslcacheevictions);
+    }
+    e = sslcache->p + i;
+    e->idlen = session->id_len;
+    memcpy(e->id, session->id, session->id_len);
+    b = GetSslCacheBucket(e->id, e->idlen);
+    e->chain = *b;
+    *b = i;
+  }
+  PushSslCache(i);
+  e = sslcache->p + i;
+  e->len = len;
+  e->ciphersuite = session->ciphersuite;
+  e->compression = session->compression;
+  e->expires = timespec_real().tv_sec +
+               (sslticketlifetime > 0 ? sslticketlifetime : 24 * 60 * 60);
+  memcpy(e->data, buf, len);
+  unassert(!pthread_mutex_unlock(&sslcache->mu));
+  mbedtls_platform_zeroize(buf, len);
+  return 0;
+}
+
+static void MapSslCache(void) {
+  int i, m;
+  char *p;
+  size_t size;
+  pthread_mutexattr_t attr;
+  for (m = 1; m < sslcachesize; m *= 2) {
+  }
+  size = ROUNDUP(sizeof(struct SslCache), 16) + m * sizeof(int) +
+         sslcachesize * sizeof(struct SslCacheEntry);
+  if ((p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+    WARNF("(ssl) failed to map session cache: %m");
+    return;
+  }
+  sslcache = (struct SslCache *)p;
+  sslcache->n = sslcachesize;
+  sslcache->m = m;
+  sslcache->head = sslcache->tail = -1;
+  sslcache->p = (struct SslCacheEntry *)(p + ROUNDUP(sizeof(*sslcache), 16));
+  sslcache->buckets = (int *)(sslcache->p + sslcachesize);
+  for (i = 0; i < m; ++i) {
+    sslcache->buckets[i] = -1;
+  }
+  unassert(!pthread_mutexattr_init(&attr));
+  unassert(!pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED));
+  unassert(!pthread_mutex_init(&sslcache->mu, &attr));
+  unassert(!pthread_mutexattr_destroy(&attr));
+}
+
+#endif /* UNSECURE */
+
 static void TlsInit(void) {
 #ifndef UNSECURE
   int suite;
@@ -7215,6 +10054,12 @@ static void TlsInit(void) {
     mbedtls_ssl_conf_session_tickets_cb(&conf, mbedtls_ssl_ticket_write,
                                         mbedtls_ssl_ticket_parse, &ssltick);
   }
+  if (sslcachesize && !sslcache) {
+    MapSslCache();
+  }
+  if (sslcache) {
+    mbedtls_ssl_conf_session_cache(&conf, sslcache, TlsGetCache, TlsSetCache);
+  }
 
   if (sslinitialized)
     return;
@@ -7238,7 +10083,8 @@ static void TlsInit(void) {
   }
   mbedtls_ssl_set_bio(&ssl, &g_bio, TlsSend, 0, TlsRecv);
   conf.disable_compression = confcli.disable_compression = true;
-  DCHECK_EQ(0, mbedtls_ssl_conf_alpn_protocols(&conf, (void *)kAlpn));
+  DCHECK_EQ(0, mbedtls_ssl_conf_alpn_protocols(
+                   &conf, (void *)(http2 ? kAlpnHttp2 : kAlpn)));
   DCHECK_EQ(0, mbedtls_ssl_conf_alpn_protocols(&confcli, (void *)kAlpn));
   DCHECK_EQ(0, mbedtls_ssl_setup(&ssl, &conf));
   DCHECK_EQ(0, mbedtls_ssl_setup(&sslcli, &confcli));
@@ -7282,6 +10128,7 @@ static void GetOpts(int argc, char *argv[]) {
       CASE('a', logrusage = true);
       CASE('J', requiressl = true);
       CASE('u', uniprocess = true);
+      CASE('Y', multiplex = true);
       CASE('g', loglatency = true);
       CASE('m', logmessages = true);
       CASE('w', launchbrowser = strdup(optarg));
@@ -7303,6 +10150,10 @@ static void GetOpts(int argc, char *argv[]) {
         CASE('t', ProgramTimeout(ParseInt(optarg)));
         CASE('h', PrintUsage(1, EXIT_SUCCESS));
         CASE('M', ProgramMaxPayloadSize(ParseInt(optarg)));
+        CASE('N', ProgramWorkerPool(ParseInt(optarg)));
+        CASE('Q', ProgramListenBacklog(ParseInt(optarg)));
+        CASE('O', ProgramTcpFastOpen(ParseInt(optarg)));
+        CASE('x', ProgramTcpDeferAccept(ParseInt(optarg)));
 #if !IsTiny()
       case 'f':
         funtrace = true;
@@ -7329,6 +10180,7 @@ static void GetOpts(int argc, char *argv[]) {
         break;
 #endif
 #ifndef UNSECURE
+        CASE('2', http2 = true);
         CASE('B', suiteb = true);
         CASE('V', ++mbedtls_debug_threshold);
         CASE('k', sslfetchverify = false);
@@ -7385,6 +10237,33 @@ void RedBean(int argc, char *argv[]) {
   unassert(!pthread_mutex_init(&shared->server_mu, &attr));
   unassert(!pthread_mutex_init(&shared->children_mu, &attr));
   unassert(!pthread_mutex_init(&shared->lastmeltdown_mu, &attr));
+  if (!IsTiny()) {
+    if ((deflatecache = mmap(NULL, sizeof(struct DeflateCache),
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                             -1, 0)) != MAP_FAILED) {
+      unassert(!pthread_mutex_init(&deflatecache->mu, &attr));
+    } else {
+      WARNF("(zip) failed to map compressed variants cache: %m");
+      deflatecache = 0;
+    }
+    if ((inflateindex = mmap(NULL, sizeof(struct InflateIndex),
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                             -1, 0)) != MAP_FAILED) {
+      unassert(!pthread_mutex_init(&inflateindex->mu, &attr));
+    } else {
+      WARNF("(zip) failed to map inflate index: %m");
+      inflateindex = 0;
+    }
+    if ((statcache = mmap(NULL, sizeof(struct StatCache),
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                          -1, 0)) != MAP_FAILED) {
+      unassert(!pthread_mutex_init(&statcache->mu, &attr));
+      statcache->gen = 1;
+    } else {
+      WARNF("(srvr) failed to map stat cache: %m");
+      statcache = 0;
+    }
+  }
   unassert(!pthread_mutexattr_destroy(&attr));
   if (daemonize) {
     for (int i = 0; i < 256; ++i) {
@@ -7414,6 +10293,14 @@ void RedBean(int argc, char *argv[]) {
   oldloglevel = __log_level;
   if (uniprocess) {
     shared->workers = 1;
+    if (workerpool.n) {
+      WARNF("(cfg) worker pool is ignored in uniprocess mode");
+      workerpool.n = 0;
+    }
+  }
+  if (multiplex && (uniprocess || workerpool.n)) {
+    WARNF("(cfg) multiplex mode is ignored with uniprocess or worker pool");
+    multiplex = false;
   }
   if (daemonize) {
     if (!logpath)
@@ -22,8 +22,19 @@
 #include "libc/stdio/stdio.h"
 #include "libc/thread/thread.h"
 
+// measures how well malloc() scales across threads
+//
+// the first test has each thread free its own allocations. the second
+// test has each thread free the allocations made by its neighbor, like
+// a producer handing requests to a consumer. run it again with
+// COSMOPOLITAN_TCACHE=0 in the environment to see how things go when
+// every call has to take an arena lock.
+
 #define ALLOCATIONS 1000
 
+void **ptrs;
+pthread_barrier_t barrier;
+
 void *worker(void *arg) {
   void **ptrs = malloc(ALLOCATIONS * sizeof(void *));
   for (int i = 0; i < ALLOCATIONS; ++i)
@@ -34,16 +45,33 @@ void *worker(void *arg) {
   return 0;
 }
 
-void test(int n) {
+void *handoff(void *arg) {
+  int n = (intptr_t)arg >> 16;
+  int k = (intptr_t)arg & 0xffff;
+  void **mine = ptrs + k * ALLOCATIONS;
+  void **theirs = ptrs + (k + 1) % n * ALLOCATIONS;
+  for (int i = 0; i < ALLOCATIONS; ++i)
+    mine[i] = malloc(1 + i % 128);
+  pthread_barrier_wait(&barrier);
+  for (int i = 0; i < ALLOCATIONS; ++i)
+    free(theirs[i]);
+  return 0;
+}
+
+void test(int n, void *(*f)(void *), const char *name) {
+  ptrs = malloc(sizeof(void *) * ALLOCATIONS * n);
+  pthread_barrier_init(&barrier, 0, n);
   struct timespec start = timespec_mono();
   pthread_t *th = malloc(sizeof(pthread_t) * n);
   for (int i = 0; i < n; ++i)
-    pthread_create(th + i, 0, worker, 0);
+    pthread_create(th + i, 0, f, (void *)(intptr_t)(n << 16 | i));
   for (int i = 0; i < n; ++i)
     pthread_join(th[i], 0);
   free(th);
   struct timespec end = timespec_mono();
-  printf("%2d threads * %d allocs = %ld us\n", n, ALLOCATIONS,
+  pthread_barrier_destroy(&barrier);
+  free(ptrs);
+  printf("%2d threads * %d allocs %-7s = %ld us\n", n, ALLOCATIONS, name,
          timespec_tomicros(timespec_sub(end, start)));
 }
 
@@ -52,5 +80,7 @@ int main(int argc, char *argv[]) {
   if (n < 8)
     n = 8;
   for (int i = 1; i <= n; ++i)
-    test(i);
+    test(i, worker, "local");
+  for (int i = 1; i <= n; ++i)
+    test(i, handoff, "handoff");
 }